@@ -8,6 +8,8 @@
 
 #include "utils.hpp"
 
+#include "../support/logger.hpp"
+
 #include <cerrno>
 #include <cstring>
 #include <ctime>
@@ -48,13 +50,13 @@ namespace ucommon
     struct timeval timeout;
     MS_TO_TIMEVAL(timeout_ms, timeout);
       if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        std::cerr << "Failed to set socket timeout: " << strerror(errno) << std::endl;
+        UFW_LOG_WARN("Failed to set socket timeout: ", utils::Errno{errno});
         return -4;
     }
 
     std::ofstream outFile(file, std::ios::binary | std::ios::trunc);
       if (!outFile.is_open()) {
-        std::cerr << "Failed to open file: " << file << std::endl;
+        UFW_LOG_WARN("Failed to open file: ", file);
         return -1;
     }
 
@@ -64,28 +66,28 @@ namespace ucommon
         ssize_t bytesReceived = recv(socket, buffer, toReceive, 0);
           if (bytesReceived < 0) {
               if (errno == EWOULDBLOCK || errno == EAGAIN) {
-                std::cerr << "Receive timeout reached" << std::endl;
+                UFW_LOG_WARN("Receive timeout reached");
                 outFile.close();
                 return -5;  // timeout
               } else {
-                std::cerr << "Receive error: " << strerror(errno) << std::endl;
+                UFW_LOG_WARN("Receive error: ", utils::Errno{errno});
                 outFile.close();
                 return -2;
               }
           } else if (bytesReceived == 0) {
-            std::cerr << "Connection closed by peer" << std::endl;
+            UFW_LOG_WARN("Connection closed by peer");
             outFile.close();
             return -6;
         }
         outFile.write(buffer, bytesReceived);
           if (!outFile) {
-            std::cerr << "File write error" << std::endl;
+            UFW_LOG_WARN("File write error");
             outFile.close();
             return -3;
         }
         outFile.flush();
         totalReceived += bytesReceived;
-        std::cout << "Received :" << totalReceived << " of " << size << " bytes" << std::endl;
+        UFW_LOG_DEBUG("Received :", totalReceived, " of ", size, " bytes");
       }
     outFile.close();
     return 0;
@@ -107,7 +109,7 @@ namespace ucommon
   {
     std::ifstream file(path);
       if (!file) {
-        std::cout << ("Unable to open file: " + path) << std::endl;
+        UFW_LOG_WARN("Unable to open file: ", path);
         return {};
     }
     std::ostringstream out_stream;
@@ -119,7 +121,7 @@ namespace ucommon
   {
     std::ofstream outFile(path, std::ios::binary | std::ios::trunc);
       if (!outFile.is_open()) {
-        std::cerr << "Failed to open file: " << path << std::endl;
+        UFW_LOG_WARN("Failed to open file: ", path);
         return false;
     }
     outFile << data;
@@ -136,13 +138,13 @@ namespace ucommon
     timeout.tv_sec = 5;
     timeout.tv_usec = 0;
       if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        std::cerr << "Failed to set socket timeout: " << strerror(errno) << std::endl;
+        UFW_LOG_WARN("Failed to set socket timeout: ", utils::Errno{errno});
         return -4;
     }
 
     int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
       if (fd < 0) {
-        std::cerr << "Failed to open file: " << strerror(errno) << std::endl;
+        UFW_LOG_WARN("Failed to open file: ", utils::Errno{errno});
         return -1;
     }
 
@@ -152,23 +154,23 @@ namespace ucommon
         ssize_t bytesReceived = recv(socket, buffer, toReceive, 0);
           if (bytesReceived < 0) {
               if (errno == EWOULDBLOCK || errno == EAGAIN) {
-                std::cerr << "Receive timeout reached" << std::endl;
+                UFW_LOG_WARN("Receive timeout reached");
                 close(fd);
                 return -5;
               } else {
-                std::cerr << "Receive error: " << strerror(errno) << std::endl;
+                UFW_LOG_WARN("Receive error: ", utils::Errno{errno});
                 close(fd);
                 return -2;
               }
           } else if (bytesReceived == 0) {
-            std::cerr << "Connection closed by peer" << std::endl;
+            UFW_LOG_WARN("Connection closed by peer");
             close(fd);
             return -6;
         }
 
         ssize_t bytesWritten = write(fd, buffer, bytesReceived);
           if (bytesWritten < 0) {
-            std::cerr << "Write error: " << strerror(errno) << std::endl;
+            UFW_LOG_WARN("Write error: ", utils::Errno{errno});
             close(fd);
             return -3;
         }
@@ -0,0 +1,243 @@
+/**
+ * @file affinity.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "affinity.hpp"
+
+#include "../support/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace utils
+{
+  namespace
+  {
+    std::string read_line(const std::string& path)
+    {
+      std::ifstream file(path);
+      std::string line;
+      std::getline(file, line);
+      return line;
+    }
+
+    std::string format_list(const std::vector<int>& values)
+    {
+      std::ostringstream out;
+        for (size_t i = 0; i < values.size();) {
+          size_t j = i;
+          while ((j + 1 < values.size()) && (values[j + 1] == values[j] + 1)) ++j;
+          if (i > 0) out << ',';
+          out << values[i];
+          if (j > i) out << '-' << values[j];
+          i = j + 1;
+      }
+      return out.str();
+    }
+
+    // IRQ numbers of the interface's MSI vectors, one per queue on multi-queue NICs
+    std::vector<int> nic_irqs(const std::string& interface)
+    {
+      std::vector<int> irqs;
+        if (DIR* dir = opendir(("/sys/class/net/" + interface + "/device/msi_irqs").c_str())) {
+            while (dirent* entry = readdir(dir)) {
+              if (entry->d_name[0] != '.') irqs.push_back(std::atoi(entry->d_name));
+            }
+          closedir(dir);
+      }
+        if (irqs.empty()) {
+          // Drivers without MSI sysfs entries still name their vectors after the interface: "eth0-TxRx-3"
+          std::ifstream interrupts("/proc/interrupts");
+          std::string line;
+            while (std::getline(interrupts, line)) {
+              if (line.find(interface) == std::string::npos) continue;
+              auto colon = line.find(':');
+              if (colon == std::string::npos) continue;
+              char* end = nullptr;
+              long irq = std::strtol(line.c_str(), &end, 10);
+              if ((end != line.c_str()) && (irq >= 0)) irqs.push_back(static_cast<int>(irq));
+            }
+      }
+      std::sort(irqs.begin(), irqs.end());
+      return irqs;
+    }
+  }  // namespace
+
+  std::string CpuPlacement::toString() const
+  {
+    if (cpus.empty()) return node < 0 ? "any" : "node " + std::to_string(node);
+    std::string text = (cpus.size() == 1 ? "cpu " : "cpus ") + format_list(cpus);
+    if (node >= 0) text += " node " + std::to_string(node);
+    return text;
+  }
+
+  const CpuTopology& CpuTopology::current()
+  {
+    static const CpuTopology topology;
+    return topology;
+  }
+
+  CpuTopology::CpuTopology()
+  {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+      if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        UFW_LOG_WARN("sched_getaffinity failed, assuming every online cpu. Errno: ", Errno{errno});
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &allowed);
+    }
+    auto usable = [&allowed](std::vector<int> cpus) {
+      cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                [&allowed](int cpu) { return (cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &allowed); }),
+                 cpus.end());
+      return cpus;
+    };
+
+    m_cpus = usable(parseList(read_line("/sys/devices/system/cpu/online")));
+      if (m_cpus.empty()) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+          if (CPU_ISSET(cpu, &allowed)) m_cpus.push_back(cpu);
+    }
+      for (int node: parseList(read_line("/sys/devices/system/node/online"))) {
+        auto cpus = usable(parseList(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")));
+        // Memory-only nodes have nothing to run on
+        if (!cpus.empty()) m_nodes.emplace_back(node, std::move(cpus));
+    }
+    if (m_nodes.empty()) m_nodes.emplace_back(0, m_cpus);
+  }
+
+  int CpuTopology::nodeOf(int cpu) const
+  {
+      for (const auto& [node, cpus]: m_nodes) {
+        if (std::binary_search(cpus.begin(), cpus.end(), cpu)) return node;
+    }
+    return -1;
+  }
+
+  std::vector<int> CpuTopology::nicQueueCpus(const std::string& interface)
+  {
+    std::vector<int> cpus;
+      for (int irq: nic_irqs(interface)) {
+        std::string prefix = "/proc/irq/" + std::to_string(irq);
+        // The CPU the interrupt is delivered to, the configured mask may allow several
+        auto affinity = parseList(read_line(prefix + "/effective_affinity_list"));
+        if (affinity.empty()) affinity = parseList(read_line(prefix + "/smp_affinity_list"));
+        if (!affinity.empty()) cpus.push_back(affinity.front());
+    }
+    return cpus;
+  }
+
+  std::vector<int> CpuTopology::parseList(const std::string& list)
+  {
+    std::vector<int> values;
+    std::istringstream in(list);
+    std::string range;
+      while (std::getline(in, range, ',')) {
+        if (range.empty()) continue;
+        char* end = nullptr;
+        long first = std::strtol(range.c_str(), &end, 10);
+        if ((end == range.c_str()) || (first < 0)) continue;
+        long last = first;
+        if (*end == '-') last = std::strtol(end + 1, nullptr, 10);
+        for (long value = first; value <= last; ++value) values.push_back(static_cast<int>(value));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+  }
+
+  AffinityPolicy AffinityPolicy::cpuSet(std::vector<int> cpus)
+  {
+    const auto& topology = CpuTopology::current();
+    AffinityPolicy policy;
+      for (int cpu: cpus) {
+          if (topology.nodeOf(cpu) < 0) {
+            UFW_LOG_WARN("Cpu ", cpu, " is not available to this process, leaving it out");
+            continue;
+        }
+        policy.m_slots.push_back({{cpu}, topology.nodeOf(cpu)});
+    }
+      if (policy.enabled()) {
+        std::vector<int> used;
+        for (const auto& slot: policy.m_slots) used.push_back(slot.cpus.front());
+        std::sort(used.begin(), used.end());
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+        policy.m_description = "cpu set " + format_list(used);
+    }
+    return policy;
+  }
+
+  AffinityPolicy AffinityPolicy::spreadNodes()
+  {
+    const auto& topology = CpuTopology::current();
+    AffinityPolicy policy;
+    // Round robin over the nodes, within a node over its CPUs
+      for (size_t round = 0;; ++round) {
+        bool placed = false;
+          for (size_t i = 0; i < topology.nodeCount(); ++i) {
+            const auto& [node, cpus] = topology.node(i);
+            if (round >= cpus.size()) continue;
+            policy.m_slots.push_back({{cpus[round]}, node});
+            placed = true;
+        }
+        if (!placed) break;
+      }
+    if (policy.enabled()) policy.m_description = "spread over " + std::to_string(topology.nodeCount()) + " node(s)";
+    return policy;
+  }
+
+  AffinityPolicy AffinityPolicy::nicQueues(const std::string& interface)
+  {
+    const auto& topology = CpuTopology::current();
+    AffinityPolicy policy;
+      for (int cpu: CpuTopology::nicQueueCpus(interface)) {
+        if (topology.nodeOf(cpu) >= 0) policy.m_slots.push_back({{cpu}, topology.nodeOf(cpu)});
+    }
+      if (!policy.enabled()) {
+        UFW_LOG_WARN("No queue interrupts of ", interface, " on cpus available to this process, threads stay unpinned");
+        return policy;
+    }
+    policy.m_description = "queues of " + interface;
+    return policy;
+  }
+
+  CpuPlacement AffinityPolicy::placementOf(size_t index) const
+  {
+    if (m_slots.empty()) return {};
+    return m_slots[index % m_slots.size()];
+  }
+
+  bool applyPlacement(const CpuPlacement& placement)
+  {
+    if (placement.cpus.empty()) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+      for (int cpu: placement.cpus) {
+        if ((cpu >= 0) && (cpu < CPU_SETSIZE)) CPU_SET(cpu, &set);
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return false;
+      if ((placement.node >= 0) && (CpuTopology::current().nodeCount() > 1)) {
+        // Preferred, not bound: a full node falls back to the others instead of failing allocations.
+        // Pages land on first touch, so buffers the thread fills itself come from its node
+        constexpr size_t kBits = sizeof(unsigned long) * 8;
+        unsigned long mask[4]{};
+          if (static_cast<size_t>(placement.node) < kBits * 4) {
+            mask[placement.node / kBits] = 1UL << (placement.node % kBits);
+              if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, kBits * 4 + 1) != 0) {
+                UFW_LOG_WARN("Failed to prefer memory of node ", placement.node, ". Errno: ", Errno{errno});
+            }
+        }
+    }
+    return true;
+  }
+
+}  // namespace utils
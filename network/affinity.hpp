@@ -0,0 +1,148 @@
+/**
+ * @file affinity.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief CPU and NUMA placement of server threads
+ * @brief Reads the CPU topology from sysfs and maps the threads of a group to CPUs: a given set,
+ *        spread over the NUMA nodes or next to the interrupts of a NIC's queues
+ * @version 0.1
+ * @date 2025-02-15
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_AFFINITY_HPP
+#define UFW_AFFINITY_HPP
+
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @brief CPUs a thread may run on and the NUMA node its memory should come from.
+   * No CPUs leaves the thread to the scheduler, node -1 to the default memory policy.
+   */
+  struct CpuPlacement
+  {
+    std::vector<int> cpus;
+    int node{-1};
+
+    /**
+     * @brief "cpu 3 node 0", "cpus 0-7 node 1" or "any".
+     */
+    std::string toString() const;
+  };
+
+  /**
+   * @brief The placement chosen for one named thread of a server, for diagnostics.
+   */
+  struct ThreadPlacement
+  {
+    std::string thread;
+    CpuPlacement placement;
+  };
+
+  /**
+   * @class CpuTopology
+   * @brief CPUs this process may use (sched_getaffinity()) grouped by NUMA node.
+   * A machine without /sys/devices/system/node is one node 0.
+   */
+  class CpuTopology
+  {
+  public:
+    /**
+     * @brief Topology read on first use.
+     */
+    static const CpuTopology& current();
+
+    const std::vector<int>& cpus() const noexcept
+    {
+      return m_cpus;
+    }
+    size_t nodeCount() const noexcept
+    {
+      return m_nodes.size();
+    }
+    /**
+     * @brief Node id and its usable CPUs, @p index < nodeCount().
+     */
+    const std::pair<int, std::vector<int>>& node(size_t index) const
+    {
+      return m_nodes[index];
+    }
+    /**
+     * @brief Node of @p cpu, -1 for a CPU this process can't use.
+     */
+    int nodeOf(int cpu) const;
+
+    /**
+     * @brief CPUs serving the interrupts of @p interface, in IRQ order, which is queue order for
+     * multi-queue NICs. Empty if the interface has no MSI interrupts to find.
+     */
+    static std::vector<int> nicQueueCpus(const std::string& interface);
+    /**
+     * @brief Parses a sysfs CPU or node list like "0-3,8,10-11".
+     */
+    static std::vector<int> parseList(const std::string& list);
+
+  private:
+    std::vector<int> m_cpus;
+    std::vector<std::pair<int, std::vector<int>>> m_nodes;
+
+    CpuTopology();
+  };
+
+  /**
+   * @class AffinityPolicy
+   * @brief Maps the `i`-th thread of a group (loops, pool workers) to a CpuPlacement.
+   *
+   * The mapping is resolved against the topology when the policy is made and wraps around when
+   * a group has more threads than the policy has slots. A default constructed policy places nothing.
+   */
+  class AffinityPolicy
+  {
+  public:
+    AffinityPolicy() = default;
+
+    /**
+     * @brief Thread `i` on `cpus[i % cpus.size()]`. CPUs this process can't use are dropped.
+     */
+    static AffinityPolicy cpuSet(std::vector<int> cpus);
+    /**
+     * @brief Consecutive threads on different nodes, one CPU each: node 0 CPU 0, node 1 CPU 0,
+     * node 0 CPU 1... Every thread keeps its memory on its node.
+     */
+    static AffinityPolicy spreadNodes();
+    /**
+     * @brief Thread `i` on the CPU handling the interrupt of queue `i` of @p interface, so a
+     * loop finds the packets of its connections in the cache of its own CPU. Places nothing if
+     * the interrupts can't be found (virtual NICs, no sysfs).
+     */
+    static AffinityPolicy nicQueues(const std::string& interface);
+
+    bool enabled() const noexcept
+    {
+      return !m_slots.empty();
+    }
+    CpuPlacement placementOf(size_t index) const;
+    const std::string& description() const noexcept
+    {
+      return m_description;
+    }
+
+  private:
+    std::vector<CpuPlacement> m_slots;
+    std::string m_description{"none"};
+  };
+
+  /**
+   * @brief Moves the calling thread to @p placement: CPU affinity and, on machines with several
+   * nodes, memory preferably from the placement's node, so buffers the thread allocates are local.
+   * @return false if the kernel refused the CPUs.
+   */
+  bool applyPlacement(const CpuPlacement& placement);
+
+}  // namespace utils
+
+#endif  // UFW_AFFINITY_HPP
@@ -0,0 +1,421 @@
+/**
+ * @file asynctcpclient.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "asynctcpclient.hpp"
+
+#include "../support/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  constexpr size_t kReadChunk = 64 * 1024;
+
+  std::string endpoint_key(const utils::SocketAddress& address)
+  {
+    return std::string(reinterpret_cast<const char*>(address.data()), address.size());
+  }
+}  // namespace
+
+struct AsyncTcpClient::Request
+{
+  AsyncTcpClient* client{nullptr};
+  std::string data;
+  Callback done;
+  utils::TimingWheel::TimerId timer{0};
+  std::weak_ptr<Connection> connection;  // the one it was sent on
+  bool finished{false};
+
+  ~Request()
+  {
+    // Dropped uncompleted: the client stopped with it queued somewhere
+      if (!finished) {
+        client->m_cancelled.fetch_add(1, std::memory_order_relaxed);
+        if (done) done(Result{Status::Cancelled, {}});
+    }
+  }
+};
+
+struct AsyncTcpClient::Connection
+{
+  int fd{-1};
+  Endpoint* endpoint{nullptr};
+  bool connected{false};
+  bool closed{false};
+  bool writing{false};  // waiting for EPOLLOUT
+  bool dirty{false};
+  bool in_ready{false};
+  utils::TimingWheel::TimerId connect_timer{0};
+  std::string in;
+  std::string out;
+  size_t out_offset{0};
+  std::deque<RequestPtr> in_flight;  // in the order they were sent
+};
+
+struct AsyncTcpClient::Endpoint
+{
+  utils::SocketAddress address;
+  std::deque<RequestPtr> pending;  // waiting for a connection with room
+  std::vector<ConnectionPtr> ready;  // connected with room for a request, dropped lazily once closed or full
+  size_t connections{0};
+  size_t connecting{0};
+};
+
+AsyncTcpClient::AsyncTcpClient(): AsyncTcpClient(Options{}) {}
+
+AsyncTcpClient::AsyncTcpClient(Options options): m_options(std::move(options)), m_read_buffer(kReadChunk)
+{
+  if (!m_options.framer) m_options.framer = std::make_shared<utils::RawFramer>();
+  // Raw responses have no boundaries, two of them in flight would run into each other
+  if (std::dynamic_pointer_cast<const utils::RawFramer>(m_options.framer)) m_options.pipeline_depth = 1;
+  m_options.pipeline_depth = std::max<size_t>(1, m_options.pipeline_depth);
+  m_options.max_connections = std::max<size_t>(1, m_options.max_connections);
+}
+
+AsyncTcpClient::~AsyncTcpClient()
+{
+  stop();
+}
+
+bool AsyncTcpClient::start()
+{
+  if (m_running) return true;
+  if (!m_reactor.start()) return false;
+  m_running = true;
+  return true;
+}
+
+void AsyncTcpClient::stop()
+{
+  if (!m_running.exchange(false)) return;
+  // The loop's timers and tasks let their requests go, which completes them as cancelled
+  m_reactor.stop();
+  for (auto& [fd, connection]: m_connections) close(fd);
+  m_open_connections = 0;
+  auto connections = std::move(m_connections);
+  auto endpoints = std::move(m_endpoints);
+  m_connections.clear();
+  m_endpoints.clear();
+  m_dirty.clear();
+  connections.clear();
+  endpoints.clear();
+}
+
+bool AsyncTcpClient::isRunning() const
+{
+  return m_running;
+}
+
+void AsyncTcpClient::request(const utils::SocketAddress& address, std::string data, std::chrono::milliseconds timeout,
+                             Callback done)
+{
+  auto request = std::make_shared<Request>();
+  request->client = this;
+  request->data = std::move(data);
+  request->done = std::move(done);
+  m_requests.fetch_add(1, std::memory_order_relaxed);
+  // Not submitted requests are released here or with the loop's tasks, and cancelled
+  if (!m_running) return;
+    if (m_reactor.isInLoopThread()) {
+      submit(request, address, timeout);
+      return;
+  }
+  m_reactor.post([this, request, address, timeout]() { submit(request, address, timeout); });
+}
+
+std::future<AsyncTcpClient::Result> AsyncTcpClient::request(const utils::SocketAddress& address, std::string data,
+                                                            std::chrono::milliseconds timeout)
+{
+  auto promise = std::make_shared<std::promise<Result>>();
+  auto result = promise->get_future();
+  request(address, std::move(data), timeout, [promise](Result response) { promise->set_value(std::move(response)); });
+  return result;
+}
+
+AsyncTcpClient::Stats AsyncTcpClient::stats() const
+{
+  Stats stats;
+  stats.requests = m_requests.load(std::memory_order_relaxed);
+  stats.completed = m_completed.load(std::memory_order_relaxed);
+  stats.timeouts = m_timeouts.load(std::memory_order_relaxed);
+  stats.failures = m_failures.load(std::memory_order_relaxed);
+  stats.cancelled = m_cancelled.load(std::memory_order_relaxed);
+  uint64_t done = stats.completed + stats.timeouts + stats.failures + stats.cancelled;
+  stats.outstanding = stats.requests > done ? stats.requests - done : 0;
+  stats.connects = m_connects.load(std::memory_order_relaxed);
+  stats.connect_failures = m_connect_failures.load(std::memory_order_relaxed);
+  stats.connections = m_open_connections.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void AsyncTcpClient::submit(const RequestPtr& request, const utils::SocketAddress& address,
+                            std::chrono::milliseconds timeout)
+{
+  auto& endpoint = m_endpoints[endpoint_key(address)];
+    if (!endpoint) {
+      endpoint = std::make_unique<Endpoint>();
+      endpoint->address = address;
+  }
+  std::weak_ptr<Request> weak = request;
+  request->timer = m_reactor.runAfter(timeout, [this, weak]() {
+    if (auto expired = weak.lock()) on_timeout(expired);
+  });
+  endpoint->pending.push_back(request);
+  pump(*endpoint);
+}
+
+void AsyncTcpClient::pump(Endpoint& endpoint)
+{
+    while (!endpoint.pending.empty()) {
+        if (endpoint.pending.front()->finished) {
+          endpoint.pending.pop_front();
+          continue;
+      }
+      // The most recently freed connection first, its buffers are warm
+        while (!endpoint.ready.empty() && (endpoint.ready.back()->closed ||
+                                           endpoint.ready.back()->in_flight.size() >= m_options.pipeline_depth)) {
+          endpoint.ready.back()->in_ready = false;
+          endpoint.ready.pop_back();
+        }
+      if (endpoint.ready.empty()) break;
+      auto connection = endpoint.ready.back();
+      send_request(connection, endpoint.pending.front());
+      endpoint.pending.pop_front();
+    }
+
+  // Connections being opened take the queue as far as their depth goes
+    while ((endpoint.pending.size() > endpoint.connecting * m_options.pipeline_depth) &&
+           (endpoint.connections < m_options.max_connections)) {
+      if (!open_connection(endpoint)) break;
+    }
+
+  auto dirty = std::move(m_dirty);
+  m_dirty.clear();
+    for (const auto& connection: dirty) {
+      connection->dirty = false;
+      if (!connection->closed) flush(connection);
+    }
+}
+
+bool AsyncTcpClient::open_connection(Endpoint& endpoint)
+{
+  int fd = socket(endpoint.address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      UFW_LOG_WARN("Failed to create a client socket. Reason: ", utils::Errno{errno});
+      m_connect_failures.fetch_add(1, std::memory_order_relaxed);
+      return false;
+  }
+  m_options.tuning.apply(fd, utils::SocketTuning::Side::Client);
+
+  auto connection = std::make_shared<Connection>();
+  connection->fd = fd;
+  connection->endpoint = &endpoint;
+  ++endpoint.connections;
+  ++endpoint.connecting;
+  m_connections[fd] = connection;
+
+  int result = ::connect(fd, endpoint.address.data(), endpoint.address.size());
+    if ((result < 0) && (errno != EINPROGRESS)) {
+      on_connect_failed(connection, errno);
+      return false;
+  }
+  m_reactor.add(fd, EPOLLOUT, [this, connection](uint32_t events) { on_event(connection, events); });
+    if (result == 0) {
+      // Unix sockets and TCP Fast Open connect at once
+      on_connected(connection);
+      return true;
+  }
+  std::weak_ptr<Connection> weak = connection;
+  connection->connect_timer = m_reactor.runAfter(m_options.connect_timeout, [this, weak]() {
+    auto late = weak.lock();
+    if (late && !late->closed && !late->connected) on_connect_failed(late, ETIMEDOUT);
+  });
+  return true;
+}
+
+void AsyncTcpClient::on_event(const ConnectionPtr& connection, uint32_t events)
+{
+  if (connection->closed) return;
+    if (!connection->connected) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if (getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) error = errno;
+      if (error != 0) on_connect_failed(connection, error);
+      else on_connected(connection);
+      return;
+  }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+      read_responses(connection);
+      if (connection->closed) return;
+  }
+  if (events & EPOLLOUT) flush(connection);
+}
+
+void AsyncTcpClient::on_connected(const ConnectionPtr& connection)
+{
+  auto& endpoint = *connection->endpoint;
+  if (connection->connect_timer != 0) m_reactor.cancelTimer(connection->connect_timer);
+  connection->connected = true;
+  --endpoint.connecting;
+  m_connects.fetch_add(1, std::memory_order_relaxed);
+  m_open_connections.fetch_add(1, std::memory_order_relaxed);
+  m_reactor.modify(connection->fd, EPOLLIN);
+  connection->in_ready = true;
+  endpoint.ready.push_back(connection);
+  pump(endpoint);
+}
+
+void AsyncTcpClient::on_connect_failed(const ConnectionPtr& connection, int error)
+{
+  auto& endpoint = *connection->endpoint;
+  UFW_LOG_WARN("Connection to ", endpoint.address.toString(), " failed. Reason: ", utils::Errno{error});
+  m_connect_failures.fetch_add(1, std::memory_order_relaxed);
+  close_connection(connection, Status::ConnectFailed);
+  if (endpoint.connections > 0) return;
+  // Nothing left to wait for, the queue would sit there until the deadlines
+  auto pending = std::move(endpoint.pending);
+  endpoint.pending.clear();
+  for (const auto& request: pending) finish(request, Status::ConnectFailed);
+}
+
+void AsyncTcpClient::on_timeout(const RequestPtr& request)
+{
+  if (request->finished) return;
+  request->timer = 0;
+  finish(request, Status::Timeout);
+  auto connection = request->connection.lock();
+  // A late raw response can't be told apart from the next one
+  if (connection && std::dynamic_pointer_cast<const utils::RawFramer>(m_options.framer))
+    close_connection(connection, Status::Closed);
+}
+
+void AsyncTcpClient::send_request(const ConnectionPtr& connection, const RequestPtr& request)
+{
+  m_options.framer->encode(request->data, connection->out);
+  request->data = std::string();
+  request->connection = connection;
+  connection->in_flight.push_back(request);
+    if (!connection->dirty) {
+      connection->dirty = true;
+      m_dirty.push_back(connection);
+  }
+}
+
+void AsyncTcpClient::flush(const ConnectionPtr& connection)
+{
+    while (connection->out_offset < connection->out.size()) {
+      ssize_t sent = send(connection->fd, connection->out.data() + connection->out_offset,
+                          connection->out.size() - connection->out_offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+          if (errno == EINTR) continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                if (!connection->writing) {
+                  connection->writing = true;
+                  m_reactor.modify(connection->fd, EPOLLIN | EPOLLOUT);
+              }
+              return;
+          }
+          close_connection(connection, Status::Closed);
+          return;
+      }
+      connection->out_offset += static_cast<size_t>(sent);
+    }
+  connection->out.clear();
+  connection->out_offset = 0;
+    if (connection->writing) {
+      connection->writing = false;
+      m_reactor.modify(connection->fd, EPOLLIN);
+  }
+}
+
+void AsyncTcpClient::read_responses(const ConnectionPtr& connection)
+{
+  bool peer_closed = false;
+    for (;;) {
+      ssize_t received = recv(connection->fd, m_read_buffer.data(), m_read_buffer.size(), 0);
+        if (received > 0) {
+          connection->in.append(m_read_buffer.data(), static_cast<size_t>(received));
+          if (static_cast<size_t>(received) < m_read_buffer.size()) break;
+          continue;
+      }
+      if ((received < 0) && (errno == EINTR)) continue;
+      if ((received < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) break;
+      peer_closed = true;
+      break;
+    }
+
+  // Completed after the parsing: callbacks may send on this connection or close it
+  std::vector<std::pair<RequestPtr, std::string>> responses;
+  std::string_view data = connection->in;
+  utils::IFramer::Frame frame;
+  bool malformed = false;
+    while (!data.empty()) {
+        if (connection->in_flight.empty()) {
+          malformed = true;
+          break;
+      }
+      auto status = m_options.framer->next(data, frame);
+      if (status == utils::IFramer::Status::Incomplete) break;
+        if (status == utils::IFramer::Status::Error) {
+          malformed = true;
+          break;
+      }
+      responses.emplace_back(std::move(connection->in_flight.front()), std::string(frame.payload));
+      connection->in_flight.pop_front();
+      data.remove_prefix(frame.consumed);
+    }
+  connection->in.erase(0, connection->in.size() - data.size());
+
+  auto& endpoint = *connection->endpoint;
+    if (!connection->closed && !connection->in_ready && !responses.empty()) {
+      connection->in_ready = true;
+      endpoint.ready.push_back(connection);
+  }
+  for (auto& [request, response]: responses) finish(request, Status::Ok, std::move(response));
+    if (malformed && !connection->closed) {
+      UFW_LOG_WARN("Malformed or unexpected response from ", endpoint.address.toString(), ". Closing connection");
+      close_connection(connection, Status::Closed);
+  }
+  if (peer_closed && !connection->closed) close_connection(connection, Status::Closed);
+  pump(endpoint);
+}
+
+void AsyncTcpClient::close_connection(const ConnectionPtr& connection, Status status)
+{
+  if (connection->closed) return;
+  connection->closed = true;
+  auto& endpoint = *connection->endpoint;
+  if (connection->connect_timer != 0) m_reactor.cancelTimer(connection->connect_timer);
+  m_reactor.remove(connection->fd);
+  close(connection->fd);
+  m_connections.erase(connection->fd);
+  --endpoint.connections;
+  if (connection->connected) m_open_connections.fetch_sub(1, std::memory_order_relaxed);
+  else --endpoint.connecting;
+
+  auto in_flight = std::move(connection->in_flight);
+  connection->in_flight.clear();
+  for (const auto& request: in_flight) finish(request, status);
+}
+
+void AsyncTcpClient::finish(const RequestPtr& request, Status status, std::string response)
+{
+  if (request->finished) return;
+  request->finished = true;
+  if (request->timer != 0) m_reactor.cancelTimer(request->timer);
+    switch (status) {
+      case Status::Ok: m_completed.fetch_add(1, std::memory_order_relaxed); break;
+      case Status::Timeout: m_timeouts.fetch_add(1, std::memory_order_relaxed); break;
+      case Status::Cancelled: m_cancelled.fetch_add(1, std::memory_order_relaxed); break;
+      default: m_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+  auto done = std::move(request->done);
+  if (done) done(Result{status, std::move(response)});
+}
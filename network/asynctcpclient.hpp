@@ -0,0 +1,160 @@
+/**
+ * @file asynctcpclient.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Non-blocking TCP client multiplexing many requests over many connections on one epoll thread
+ * @brief Non-blocking connects, per-request deadlines in a timing wheel, completion by callback or future
+ * @version 0.1
+ * @date 2025-03-29
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_ASYNCTCPCLIENT_HPP
+#define UFW_ASYNCTCPCLIENT_HPP
+
+#include "epollreactor.hpp"
+#include "framer.hpp"
+#include "socketaddress.hpp"
+#include "sockettuning.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class AsyncTcpClient
+ * @brief Sends requests to any number of servers from one loop thread and completes each through a
+ * callback or a future, so one thread keeps thousands of requests outstanding.
+ *
+ * Every server address (endpoint) gets up to max_connections connections, opened with a non-blocking
+ * connect() as requests queue up and kept open for the next ones. A connection carries up to
+ * pipeline_depth requests at once, their responses are cut from the stream by the framer and matched
+ * in order. With the default utils::RawFramer a response is whatever one read returns, as with
+ * TcpClient::request(), and a connection carries one request at a time.
+ *
+ * The deadline of a request covers waiting for a connection, connecting, sending and the response.
+ * It lives in the loop's timing wheel (10 ms ticks), arming and cancelling cost no syscall. A timed
+ * out request completes at once; with a framer its late response is read and dropped, without one
+ * the connection is closed as there is no telling where the late response ends.
+ *
+ * Callbacks run on the loop thread and must not block, they may send further requests.
+ */
+class AsyncTcpClient
+{
+public:
+  enum class Status
+  {
+    Ok,
+    Timeout,
+    ConnectFailed,  // no connection to the endpoint could be opened
+    Closed,  // the connection broke or the response violated the framing
+    Cancelled  // the client was stopped or not running
+  };
+
+  struct Result
+  {
+    Status status{Status::Cancelled};
+    std::string response;
+  };
+
+  using Callback = std::function<void(Result)>;
+
+  struct Options
+  {
+    std::shared_ptr<const utils::IFramer> framer;  // nullptr is utils::RawFramer
+    size_t max_connections{64};  // per endpoint
+    size_t pipeline_depth{1};  // requests in flight per connection, 1 with utils::RawFramer
+    std::chrono::milliseconds connect_timeout{1000};
+    utils::SocketTuning tuning{utils::SocketTuning::defaults()};
+  };
+
+  struct Stats
+  {
+    uint64_t requests{0};
+    uint64_t completed{0};
+    uint64_t timeouts{0};
+    uint64_t failures{0};  // ConnectFailed and Closed
+    uint64_t cancelled{0};
+    uint64_t outstanding{0};  // sent or waiting for a connection now
+    uint64_t connects{0};
+    uint64_t connect_failures{0};
+    uint64_t connections{0};  // open now
+  };
+
+  AsyncTcpClient();
+  explicit AsyncTcpClient(Options options);
+  ~AsyncTcpClient();
+
+  AsyncTcpClient(const AsyncTcpClient&) = delete;
+  AsyncTcpClient& operator=(const AsyncTcpClient&) = delete;
+
+  bool start();
+  /**
+   * @brief Closes every connection, outstanding requests complete with Status::Cancelled.
+   * Not from a callback.
+   */
+  void stop();
+
+  [[nodiscard]]
+  bool isRunning() const;
+
+  /**
+   * @brief Sends @p data to @p address, @p done gets the response or why there is none, once.
+   * Thread-safe. A client that is not running completes with Status::Cancelled right away.
+   */
+  void request(const utils::SocketAddress& address, std::string data, std::chrono::milliseconds timeout,
+               Callback done);
+  std::future<Result> request(const utils::SocketAddress& address, std::string data,
+                              std::chrono::milliseconds timeout);
+
+  [[nodiscard]]
+  Stats stats() const;
+
+private:
+  struct Request;
+  struct Connection;
+  struct Endpoint;
+  using RequestPtr = std::shared_ptr<Request>;
+  using ConnectionPtr = std::shared_ptr<Connection>;
+
+  Options m_options;
+  std::atomic<bool> m_running{false};
+  utils::EpollReactor m_reactor;
+
+  // Owned by the loop thread
+  std::unordered_map<std::string, std::unique_ptr<Endpoint>> m_endpoints;  // by sockaddr bytes
+  std::unordered_map<int, ConnectionPtr> m_connections;
+  std::vector<ConnectionPtr> m_dirty;  // requests appended, not sent yet
+  std::vector<char> m_read_buffer;
+
+  std::atomic<uint64_t> m_requests{0};
+  std::atomic<uint64_t> m_completed{0};
+  std::atomic<uint64_t> m_timeouts{0};
+  std::atomic<uint64_t> m_failures{0};
+  std::atomic<uint64_t> m_cancelled{0};
+  std::atomic<uint64_t> m_connects{0};
+  std::atomic<uint64_t> m_connect_failures{0};
+  std::atomic<uint64_t> m_open_connections{0};
+
+  void submit(const RequestPtr& request, const utils::SocketAddress& address, std::chrono::milliseconds timeout);
+  void pump(Endpoint& endpoint);
+  bool open_connection(Endpoint& endpoint);
+  void on_event(const ConnectionPtr& connection, uint32_t events);
+  void on_connected(const ConnectionPtr& connection);
+  void on_connect_failed(const ConnectionPtr& connection, int error);
+  void on_timeout(const RequestPtr& request);
+  void send_request(const ConnectionPtr& connection, const RequestPtr& request);
+  void flush(const ConnectionPtr& connection);
+  void read_responses(const ConnectionPtr& connection);
+  void close_connection(const ConnectionPtr& connection, Status status);
+  void finish(const RequestPtr& request, Status status, std::string response = {});
+};
+
+#endif  // UFW_ASYNCTCPCLIENT_HPP
@@ -0,0 +1,120 @@
+/**
+ * @file batcher.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "batcher.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace utils
+{
+  RequestBatcher::RequestBatcher(Handler handler): m_handler(std::move(handler)) {}
+
+  RequestBatcher::~RequestBatcher()
+  {
+    stop();
+  }
+
+  void RequestBatcher::setLimits(Limits limits)
+  {
+    limits.max_size = std::max<size_t>(1, limits.max_size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limits = limits;
+  }
+
+  RequestBatcher::Limits RequestBatcher::limits() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limits;
+  }
+
+  bool RequestBatcher::start()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) return true;
+    m_sizes.reset();
+    m_running = true;
+    m_thread = std::thread(&RequestBatcher::loop, this);
+    return true;
+  }
+
+  void RequestBatcher::stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_running = false;
+    }
+    m_wakeup.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+    std::vector<Pending> dropped;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      dropped.swap(m_pending);
+    }
+    // Dropping the completions answers the requests, which may post to loops: not under the lock
+    dropped.clear();
+  }
+
+  bool RequestBatcher::submit(int socket, const BufferSlice& request, IAsyncHandler::Completion done)
+  {
+    bool first = false;
+    bool full = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_running) return false;
+      m_pending.push_back({{socket, request, {}}, std::move(done), std::chrono::steady_clock::now()});
+      first = m_pending.size() == 1;
+      full = m_pending.size() == m_limits.max_size;
+    }
+    // The thread only waits for the first request and for a full batch, other submits don't wake it
+    if (first || full) m_wakeup.notify_one();
+    return true;
+  }
+
+  size_t RequestBatcher::queued() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending.size();
+  }
+
+  void RequestBatcher::loop()
+  {
+    std::vector<Pending> taken;
+    std::vector<BatchRequest> batch;
+    std::vector<IAsyncHandler::Completion> completions;
+    std::unique_lock<std::mutex> lock(m_mutex);
+      while (m_running) {
+        m_wakeup.wait(lock, [this]() { return !m_running || !m_pending.empty(); });
+        if (!m_running) break;
+        // A request left over from the previous batch may be due already
+        auto deadline = m_pending.front().queued + m_limits.max_delay;
+        m_wakeup.wait_until(lock, deadline,
+                            [this]() { return !m_running || (m_pending.size() >= m_limits.max_size); });
+        if (!m_running) break;
+        size_t count = std::min(m_pending.size(), m_limits.max_size);
+          if (count == m_pending.size()) {
+            taken.swap(m_pending);
+          } else {
+            std::move(m_pending.begin(), m_pending.begin() + count, std::back_inserter(taken));
+            m_pending.erase(m_pending.begin(), m_pending.begin() + count);
+          }
+        lock.unlock();
+
+          for (auto& pending: taken) {
+            batch.push_back(std::move(pending.item));
+            completions.push_back(std::move(pending.done));
+          }
+        taken.clear();
+        m_handler(batch);
+        m_sizes.record(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) completions[i](std::move(batch[i].response));
+        batch.clear();
+        completions.clear();
+        lock.lock();
+      }
+  }
+
+}  // namespace utils
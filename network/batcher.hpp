@@ -0,0 +1,120 @@
+/**
+ * @file batcher.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Collects requests of many connections and hands them to a handler in batches
+ * @brief A batch is cut when it is full or its oldest request has waited long enough
+ * @version 0.1
+ * @date 2025-02-22
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_BATCHER_HPP
+#define UFW_BATCHER_HPP
+
+#include "ihandler.hpp"
+#include "response.hpp"
+#include "stats.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @brief One request of a batch. The handler fills in the response, an empty one sends nothing back.
+   */
+  struct BatchRequest
+  {
+    int socket{-1};
+    BufferSlice request;
+    Response response;
+  };
+
+  /**
+   * @class RequestBatcher
+   * @brief Queue of requests drained by a thread of its own, one handler call per batch.
+   *
+   * The thread waits for the first request, then for more until the batch holds max_size of them
+   * or max_delay passed since the first one arrived. While the handler runs the next batch fills
+   * up, so under load batches grow on their own and max_delay only matters when traffic is light.
+   * The handler runs on the batcher thread only, it may block. Responses go back through the
+   * completion of each request, in any order.
+   */
+  class RequestBatcher
+  {
+  public:
+    using Handler = std::function<void(std::vector<BatchRequest>& batch)>;
+
+    struct Limits
+    {
+      size_t max_size{64};
+      std::chrono::microseconds max_delay{500};
+    };
+
+    explicit RequestBatcher(Handler handler);
+    ~RequestBatcher();
+
+    RequestBatcher(const RequestBatcher&) = delete;
+    RequestBatcher& operator=(const RequestBatcher&) = delete;
+
+    /**
+     * @brief Limits of the batches cut from now on.
+     */
+    void setLimits(Limits limits);
+    [[nodiscard]]
+    Limits limits() const;
+
+    /**
+     * @brief Starts the batcher thread and clears the batch size histogram.
+     */
+    bool start();
+    /**
+     * @brief Finishes the batch being handled and joins the thread. Queued requests are dropped,
+     * their completions answer with an empty response.
+     */
+    void stop();
+
+    /**
+     * @brief Queues @p request. @p done is called on the batcher thread once the batch is handled.
+     * @return false if the batcher is not running, @p done is dropped then.
+     */
+    bool submit(int socket, const BufferSlice& request, IAsyncHandler::Completion done);
+
+    /**
+     * @brief Requests per handler call, count() is the number of calls.
+     */
+    const LatencyHistogram& batchSizes() const noexcept
+    {
+      return m_sizes;
+    }
+    size_t queued() const;
+
+  private:
+    struct Pending
+    {
+      BatchRequest item;
+      IAsyncHandler::Completion done;
+      std::chrono::steady_clock::time_point queued;
+    };
+
+    Handler m_handler;
+    Limits m_limits;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::vector<Pending> m_pending;
+    bool m_running{false};
+    std::thread m_thread;
+    LatencyHistogram m_sizes;  // written by the batcher thread only
+
+    void loop();
+  };
+
+}  // namespace utils
+
+#endif  // UFW_BATCHER_HPP
@@ -0,0 +1,139 @@
+/**
+ * @file echo_bench.cpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Echo round-trip benchmark comparing TcpServer I/O engines over loopback
+ *
+ * Every client thread owns one connection and runs request/response round trips
+ * of a fixed payload. Results go to stderr, so server diagnostics printed to stdout
+ * can be silenced with `> /dev/null`.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. echo_bench.cpp ../tcpserver.cpp ../socketaddress.cpp ../epollreactor.cpp \
+ *        ../sockettuning.cpp ../sockutils.cpp ../iouring.cpp ../framer.cpp ../bufferpool.cpp ../response.cpp \
+ *        ../affinity.cpp ../batcher.cpp ../responsecache.cpp ../threadpool.cpp \
+ *        ../timingwheel.cpp ../stats.cpp ../../support/logger.cpp -o echo_bench -lpthread
+ * Usage: echo_bench [connections=16] [requests=20000] [payload=64] [port=19090]
+ *
+ * @version 0.1
+ * @date 2024-11-09
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "../tcpserver.hpp"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  struct BenchConfig
+  {
+    int connections{16};
+    int requests{20000};
+    size_t payload{64};
+    int port{19090};
+  };
+
+  int connect_loopback(int port)
+  {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+  }
+
+  // One request/response round trip, the echo is read back completely
+  bool round_trip(int fd, const std::string& payload, std::string& buffer)
+  {
+    if (send(fd, payload.data(), payload.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(payload.size())) return false;
+    size_t received = 0;
+      while (received < payload.size()) {
+        auto n = recv(fd, buffer.data() + received, buffer.size() - received, 0);
+        if (n <= 0) return false;
+        received += n;
+      }
+    return true;
+  }
+
+  void run_mode(const char* name, TcpServer::IoMode mode, const BenchConfig& config)
+  {
+    TcpServer server([](int, const std::string& input) { return input; });
+      if (!server.start(config.port, mode)) {
+        std::cerr << name << ": failed to start server" << std::endl;
+        return;
+    }
+
+    const std::string payload(config.payload, 'x');
+    std::atomic<long> completed{0};
+    std::atomic<int> failed{0};
+    std::vector<std::thread> clients;
+
+    auto begin = std::chrono::steady_clock::now();
+      for (int c = 0; c < config.connections; ++c) {
+        clients.emplace_back([&]() {
+          int fd = connect_loopback(config.port);
+            if (fd < 0) {
+              ++failed;
+              return;
+          }
+          std::string buffer(config.payload, '\0');
+            for (int i = 0; i < config.requests; ++i) {
+                if (!round_trip(fd, payload, buffer)) {
+                  ++failed;
+                  break;
+              }
+              ++completed;
+            }
+          close(fd);
+        });
+      }
+    for (auto& client: clients) client.join();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    const char* engine = server.ioMode() == mode ? "" : " (fallback)";
+    server.stop();
+
+    double rps = completed / elapsed;
+    std::cerr << std::left << std::setw(10) << name << std::right << std::setw(12) << std::fixed
+              << std::setprecision(0) << rps << " req/s" << std::setw(10) << std::setprecision(1)
+              << (elapsed * 1e6 * config.connections / std::max<long>(1, completed)) << " us/rtt"
+              << "  failed connections: " << failed << engine << std::endl;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  BenchConfig config;
+  if (argc > 1) config.connections = std::atoi(argv[1]);
+  if (argc > 2) config.requests = std::atoi(argv[2]);
+  if (argc > 3) config.payload = std::strtoul(argv[3], nullptr, 10);
+  if (argc > 4) config.port = std::atoi(argv[4]);
+
+  std::cerr << "connections=" << config.connections << " requests=" << config.requests
+            << " payload=" << config.payload << std::endl;
+  // Blocking mode serves at most 30 connections at once (one pool thread each)
+  run_mode("blocking", TcpServer::IoMode::Blocking, config);
+  run_mode("reactor", TcpServer::IoMode::Reactor, config);
+  run_mode("io_uring", TcpServer::IoMode::IoUring, config);
+  return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * @file file_bench.cpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief File responses sent from the page cache (sendfile/splice) against reading them into memory
+ *
+ * The server answers a request naming a file size with that file, two ways:
+ * - copy: read the whole file into a vector as ucommon::ReadWholeFile does, copy it into a string
+ *   and send that, opening the file on every request
+ * - sendfile: utils::FileCache hands out the open descriptor and the response names a region of it,
+ *   the Reactor and Blocking engines send it with sendfile(), the io_uring one splices it through a pipe
+ * One client connection reads every response completely. Reported per size and path: MB/s, the
+ * median request in microseconds and the CPU time of the whole process (server and client) per
+ * request. The files are created once in `dir` and left there, the first run pays for writing them.
+ * Results go to stderr, server diagnostics to stdout.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. file_bench.cpp ../tcpserver.cpp ../socketaddress.cpp ../epollreactor.cpp \
+ *        ../sockettuning.cpp ../sockutils.cpp ../iouring.cpp ../framer.cpp ../bufferpool.cpp ../response.cpp \
+ *        ../affinity.cpp ../batcher.cpp ../responsecache.cpp ../filecache.cpp ../threadpool.cpp \
+ *        ../timingwheel.cpp ../stats.cpp ../../support/logger.cpp -o file_bench -lpthread
+ * Usage: file_bench [engine=reactor|uring|blocking] [max_size=1G] [dir=/tmp] [port=19590]
+ *
+ * @version 0.1
+ * @date 2025-03-08
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "../filecache.hpp"
+#include "../stats.hpp"
+#include "../tcpserver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  const std::vector<std::pair<const char*, size_t>> kSizes = {
+          {"4K", 4096},
+          {"64K", 64 * 1024},
+          {"1M", 1024 * 1024},
+          {"16M", 16 * 1024 * 1024},
+          {"256M", 256 * 1024 * 1024},
+          {"1G", 1024 * 1024 * 1024}};
+
+  std::string file_path(const std::string& dir, const char* name)
+  {
+    return dir + "/ufw_file_bench_" + name;
+  }
+
+  bool prepare_file(const std::string& path, size_t size)
+  {
+    struct stat st;
+    if ((stat(path.c_str(), &st) == 0) && (static_cast<size_t>(st.st_size) == size)) return true;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    std::string chunk(1024 * 1024, '\0');
+    for (size_t i = 0; i < chunk.size(); ++i) chunk[i] = static_cast<char>('a' + i % 26);
+    size_t written = 0;
+      while (written < size) {
+        auto n = write(fd, chunk.data(), std::min(chunk.size(), size - written));
+          if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        written += n;
+      }
+    close(fd);
+    return true;
+  }
+
+  // What handlers do today, see ucommon::ReadWholeFile()
+  std::vector<uint8_t> read_whole_file(int fd)
+  {
+    std::vector<uint8_t> buffer;
+    struct stat st;
+    if (fstat(fd, &st) == 0) buffer.reserve(st.st_size);
+    uint8_t chunk[64 * 1024];
+      for (;;) {
+        auto n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) break;
+        buffer.insert(buffer.end(), chunk, chunk + n);
+      }
+    return buffer;
+  }
+
+  double cpu_seconds()
+  {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  }
+
+  bool send_all(int fd, const std::string& data)
+  {
+    size_t sent = 0;
+      while (sent < data.size()) {
+        auto n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+      }
+    return true;
+  }
+
+  bool receive_exactly(int fd, std::vector<char>& buffer, size_t size)
+  {
+    size_t received = 0;
+      while (received < size) {
+        auto n = recv(fd, buffer.data(), std::min(buffer.size(), size - received), 0);
+        if (n <= 0) return false;
+        received += n;
+      }
+    return true;
+  }
+
+  struct Result
+  {
+    double mb_per_s{0.0};
+    double p50_us{0.0};
+    double cpu_ms{0.0};
+  };
+
+  Result measure(const utils::SocketAddress& address, const std::string& request, size_t size)
+  {
+    Result result;
+    int fd = socket(address.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return result;
+      if (connect(fd, address.data(), address.size()) < 0) {
+        close(fd);
+        return result;
+    }
+    // Enough requests for a second or two of transfer at loopback speeds, at least a few
+    int count = static_cast<int>(std::clamp<size_t>((2048ull * 1024 * 1024) / size, 4, 2000));
+    std::vector<char> buffer(1024 * 1024);
+    utils::LatencyHistogram latency;
+    double cpu = cpu_seconds();
+    auto begin = Clock::now();
+    int done = 0;
+      for (; done < count; ++done) {
+        auto started = Clock::now();
+        if (!send_all(fd, request) || !receive_exactly(fd, buffer, size)) break;
+        latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+      }
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    cpu = cpu_seconds() - cpu;
+    close(fd);
+    if (done == 0) return result;
+    result.mb_per_s = done * (size / 1e6) / elapsed;
+    result.p50_us = latency.percentile(50) / 1000.0;
+    result.cpu_ms = cpu * 1000.0 / done;
+    return result;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  TcpServer::IoMode mode = TcpServer::IoMode::Reactor;
+  std::string engine = "reactor";
+  size_t max_size = kSizes.back().second;
+  std::string dir = "/tmp";
+  uint16_t port = 19590;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto eq = arg.find('=');
+        if (eq == std::string::npos) {
+          std::cerr << "Expected key=value, got " << arg << std::endl;
+          return 1;
+      }
+      std::string key = arg.substr(0, eq);
+      std::string value = arg.substr(eq + 1);
+        if (key == "engine") {
+          engine = value;
+          if (value == "uring") mode = TcpServer::IoMode::IoUring;
+          else if (value == "blocking") mode = TcpServer::IoMode::Blocking;
+        } else if (key == "max_size") {
+          for (const auto& [name, size]: kSizes)
+            if (value == name) max_size = size;
+        } else if (key == "dir") {
+          dir = value;
+        } else if (key == "port") {
+          port = static_cast<uint16_t>(std::atoi(value.c_str()));
+        }
+    }
+
+  utils::FileCache files;
+  // Requests are "c 16M" to copy the 16 MiB file, "s 16M" to send it as a file region
+  TcpServer server(
+          TcpServer::ResponseHandler([&dir, &files](int, const utils::BufferSlice& input, utils::Response& response) {
+            std::string request(input.view());
+            if (request.size() < 3) return;
+            std::string path = file_path(dir, request.c_str() + 2);
+              if (request[0] == 'c') {
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) return;
+                auto bytes = read_whole_file(fd);
+                close(fd);
+                response.append(std::string(bytes.begin(), bytes.end()));
+              } else if (auto file = files.open(path)) {
+                response.appendFile(file->fd, 0, file->size, file);
+              }
+          }),
+          nullptr);
+  auto address = *utils::SocketAddress::ip("127.0.0.1", port);
+    if (!server.start(address, mode)) {
+      std::cerr << "Failed to start the server" << std::endl;
+      return 1;
+  }
+  std::cerr << "engine " << (server.ioMode() == mode ? engine : std::string("reactor (fallback)")) << "\n";
+  std::cerr << std::left << std::setw(8) << "size" << std::right << std::setw(14) << "copy MB/s" << std::setw(14)
+            << "file MB/s" << std::setw(14) << "copy p50 us" << std::setw(14) << "file p50 us" << std::setw(14)
+            << "copy cpu ms" << std::setw(14) << "file cpu ms" << std::endl;
+    for (const auto& [name, size]: kSizes) {
+      if (size > max_size) break;
+        if (!prepare_file(file_path(dir, name), size)) {
+          std::cerr << name << ": failed to create " << file_path(dir, name) << std::endl;
+          continue;
+      }
+      auto copy = measure(address, std::string("c ") + name, size);
+      auto file = measure(address, std::string("s ") + name, size);
+      std::cerr << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(0)
+                << std::setw(14) << copy.mb_per_s << std::setw(14) << file.mb_per_s << std::setprecision(1)
+                << std::setw(14) << copy.p50_us << std::setw(14) << file.p50_us << std::setprecision(3)
+                << std::setw(14) << copy.cpu_ms << std::setw(14) << file.cpu_ms << std::endl;
+    }
+  server.stop();
+  auto stats = files.stats();
+  std::cerr << "file cache: " << stats.hits << " hits, " << stats.misses << " opens, " << stats.files << " open"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,556 @@
+/**
+ * @file loadgen.cpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Load generator measuring throughput and latency percentiles of TcpServer over loopback
+ *
+ * Closed loop: every connection sends its next request as soon as the previous response is in,
+ * the offered load follows the server. Open loop: requests are due at a fixed overall rate spread
+ * over the connections, one outstanding per connection. A request that can't leave on time because
+ * its connection still waits for a response is sent late, and its latency is counted from the time
+ * it was due (coordinated omission correction, as wrk2 does). The uncorrected latency, from the
+ * actual send, is reported next to it: a gap between the two means the server stalls.
+ *
+ * Requests are `payload` bytes, the server echoes them through a FixedSizeFramer after sleeping
+ * `delay_us` on a worker pool, so the loops themselves never block. Without `target` a local
+ * TcpServer is started for every engine in turn, with it an external server is measured.
+ * Responses whose request was due in the warmup are not counted, those missing after the run plus
+ * one second are counted as errors. Results go to stderr, server diagnostics to stdout;
+ * `csv=FILE` appends one row per run for comparisons against a baseline.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. loadgen.cpp ../tcpserver.cpp ../socketaddress.cpp ../epollreactor.cpp \
+ *        ../sockettuning.cpp ../sockutils.cpp ../iouring.cpp ../framer.cpp ../bufferpool.cpp ../response.cpp \
+ *        ../affinity.cpp ../batcher.cpp ../responsecache.cpp ../threadpool.cpp \
+ *        ../timingwheel.cpp ../stats.cpp ../../support/logger.cpp -o loadgen -lpthread
+ * Usage: loadgen [key=value ...]
+ *        engine=all|blocking|reactor|uring|sharded  loop=closed|open  connections=64  rate=0 (open loop, req/s)
+ *        duration=10  warmup=1 (seconds)  payload=64  delay_us=0  workers=64  threads=2 (client loops)
+ *        port=19390  target=ADDRESS (SocketAddress::parse() syntax)  csv=FILE
+ * Example: loadgen engine=sharded loop=open rate=200000 connections=10000 delay_us=100
+ *
+ * The blocking engine serves 30 connections at once, more of them wait for a free thread.
+ * C10K needs about twice as many descriptors with the local server, the soft limit is raised to
+ * the hard one.
+ *
+ * @version 0.1
+ * @date 2025-02-01
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "../framer.hpp"
+#include "../socketaddress.hpp"
+#include "../stats.hpp"
+#include "../tcpserver.hpp"
+#include "../threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;  // CLOCK_MONOTONIC, the clock of the timerfd
+
+  constexpr auto kDrainTime = std::chrono::seconds(1);  // wait for responses after the run
+  constexpr size_t kReadChunk = 64 * 1024;
+
+  struct LoadConfig
+  {
+    std::string engine{"all"};
+    bool open_loop{false};
+    int connections{64};
+    double rate{0};
+    double duration{10};
+    double warmup{1};
+    size_t payload{64};
+    int delay_us{0};
+    int workers{64};
+    int threads{2};
+    uint16_t port{19390};
+    std::string target;
+    std::string csv;
+  };
+
+  struct Connection
+  {
+    int fd{-1};
+    bool busy{false};
+    bool writing{false};  // waiting for EPOLLOUT to finish a request
+    size_t sent{0};
+    size_t received{0};
+    Clock::time_point due;  // when the request was meant to leave
+    Clock::time_point started;  // when it actually left
+  };
+
+  struct Result
+  {
+    utils::LatencyHistogram corrected;
+    utils::LatencyHistogram uncorrected;
+    uint64_t completed{0};
+    uint64_t errors{0};
+  };
+
+  // The run's timeline, shared by every client loop
+  struct Schedule
+  {
+    Clock::time_point begin;  // first requests are due
+    Clock::time_point measured;  // end of the warmup
+    Clock::time_point end;  // no request is due after this
+    std::chrono::nanoseconds interval{0};  // between two requests of one connection, open loop
+  };
+
+  int connect_to(const utils::SocketAddress& address)
+  {
+    int fd = socket(address.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int enable = 1;
+    if (!address.isUnix()) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+      if (connect(fd, address.data(), address.size()) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+  }
+
+  void raise_fd_limit(size_t needed)
+  {
+    rlimit limit{};
+    if ((getrlimit(RLIMIT_NOFILE, &limit) < 0) || (limit.rlim_cur >= needed)) return;
+    limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, needed);
+    setrlimit(RLIMIT_NOFILE, &limit);
+      if (limit.rlim_cur < needed) {
+        std::cerr << "warning: " << needed << " descriptors needed, the hard limit is " << limit.rlim_max
+                  << std::endl;
+    }
+  }
+
+  /**
+   * One client thread: an epoll loop over its share of the connections and a timerfd waking it
+   * when the next open loop request is due.
+   */
+  class ClientLoop
+  {
+  public:
+    ClientLoop(const LoadConfig& config, const Schedule& schedule, std::vector<int> fds):
+        m_config(config), m_schedule(schedule), m_payload(config.payload, 'x'), m_buffer(kReadChunk, '\0')
+    {
+      m_connections.resize(fds.size());
+      for (size_t i = 0; i < fds.size(); ++i) m_connections[i].fd = fds[i];
+    }
+
+    ~ClientLoop()
+    {
+        for (auto& conn: m_connections) {
+          if (conn.fd >= 0) close(conn.fd);
+        }
+      if (m_timer >= 0) close(m_timer);
+      if (m_epoll >= 0) close(m_epoll);
+    }
+
+    // Connection i of this loop is connection first + i * stride of the run
+    void run(size_t first, size_t stride)
+    {
+      m_epoll = epoll_create1(EPOLL_CLOEXEC);
+      m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if ((m_epoll < 0) || (m_timer < 0)) {
+          m_result.errors += m_connections.size();
+          return;
+      }
+      epoll_event timer_event{EPOLLIN, {}};
+      timer_event.data.u64 = UINT64_MAX;
+      epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &timer_event);
+        for (size_t i = 0; i < m_connections.size(); ++i) {
+          epoll_event event{EPOLLIN, {}};
+          event.data.u64 = i;
+          epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_connections[i].fd, &event);
+          // Open loop starts are spread evenly over the first interval, not sent in one burst
+          auto position = static_cast<int64_t>(first + i * stride);
+          auto offset = m_config.open_loop ? m_schedule.interval * position / m_config.connections
+                                           : std::chrono::nanoseconds(0);
+          m_due.push({m_schedule.begin + offset, i});
+        }
+
+      std::vector<epoll_event> events(256);
+      bool issuing = true;
+        while (true) {
+          auto now = Clock::now();
+          if (issuing && (now >= m_schedule.end)) issuing = false;
+          if (!issuing && ((m_outstanding == 0) || (now >= m_schedule.end + kDrainTime))) break;
+            while (issuing && !m_due.empty() && (m_due.top().first <= now)) {
+              auto [due, index] = m_due.top();
+              m_due.pop();
+              issue(index, due, now);
+            }
+          arm_timer(issuing);
+
+          int count = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), 100);
+            for (int e = 0; e < count; ++e) {
+              uint64_t index = events[e].data.u64;
+                if (index == UINT64_MAX) {
+                  uint64_t expirations = 0;
+                  ssize_t n = read(m_timer, &expirations, sizeof(expirations));
+                  (void)n;
+                  continue;
+              }
+              auto& conn = m_connections[index];
+              if (conn.fd < 0) continue;
+              if ((events[e].events & EPOLLOUT) && !write_request(index)) continue;
+              if (events[e].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) read_response(index);
+            }
+        }
+      // Whatever is still outstanding never came back in time
+      m_result.errors += m_outstanding;
+    }
+
+    const Result& result() const noexcept
+    {
+      return m_result;
+    }
+
+  private:
+    using Due = std::pair<Clock::time_point, size_t>;
+
+    const LoadConfig& m_config;
+    const Schedule& m_schedule;
+    const std::string m_payload;
+    std::string m_buffer;
+    std::vector<Connection> m_connections;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> m_due;  // idle connections by due time
+    size_t m_outstanding{0};
+    int m_epoll{-1};
+    int m_timer{-1};
+    Result m_result;
+
+    void issue(size_t index, Clock::time_point due, Clock::time_point now)
+    {
+      auto& conn = m_connections[index];
+      if (conn.fd < 0) return;
+      conn.busy = true;
+      conn.due = due;
+      conn.started = now;
+      conn.sent = 0;
+      conn.received = 0;
+      ++m_outstanding;
+      write_request(index);
+    }
+
+    // Sends what's left of the request, false if the connection failed
+    bool write_request(size_t index)
+    {
+      auto& conn = m_connections[index];
+        while (conn.sent < m_payload.size()) {
+          ssize_t n = send(conn.fd, m_payload.data() + conn.sent, m_payload.size() - conn.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+              conn.sent += n;
+            } else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+              set_writing(conn, index, true);
+              return true;
+            } else {
+              fail(index);
+              return false;
+            }
+        }
+      set_writing(conn, index, false);
+      return true;
+    }
+
+    void set_writing(Connection& conn, size_t index, bool writing)
+    {
+      if (conn.writing == writing) return;
+      conn.writing = writing;
+      epoll_event event{writing ? uint32_t(EPOLLIN | EPOLLOUT) : uint32_t(EPOLLIN), {}};
+      event.data.u64 = index;
+      epoll_ctl(m_epoll, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    void read_response(size_t index)
+    {
+      auto& conn = m_connections[index];
+        while (true) {
+          ssize_t n = recv(conn.fd, m_buffer.data(), m_buffer.size(), 0);
+            if (n > 0) {
+              conn.received += n;
+              continue;
+            } else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+              break;
+            } else {
+              fail(index);
+              return;
+            }
+        }
+        if (!conn.busy || (conn.received > m_payload.size())) {
+          // Bytes nobody asked for: the server doesn't echo
+          fail(index);
+          return;
+      }
+      if (conn.received == m_payload.size()) complete(index);
+    }
+
+    void complete(size_t index)
+    {
+      auto& conn = m_connections[index];
+      auto now = Clock::now();
+      conn.busy = false;
+      --m_outstanding;
+        if (conn.due >= m_schedule.measured) {
+          m_result.corrected.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - conn.due).count());
+          m_result.uncorrected.record(
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(now - conn.started).count());
+          ++m_result.completed;
+      }
+      // A request overdue already leaves right away, late, but still counted from its due time
+      auto next = m_config.open_loop ? conn.due + m_schedule.interval : now;
+      if (next < m_schedule.end) m_due.push({next, index});
+    }
+
+    void fail(size_t index)
+    {
+      auto& conn = m_connections[index];
+      ++m_result.errors;
+      if (conn.busy) --m_outstanding;
+      conn.busy = false;
+      close(conn.fd);
+      conn.fd = -1;
+    }
+
+    void arm_timer(bool issuing)
+    {
+      itimerspec spec{};
+        if (issuing && !m_due.empty()) {
+          auto at = m_due.top().first.time_since_epoch();
+          auto seconds = std::chrono::duration_cast<std::chrono::seconds>(at);
+          spec.it_value.tv_sec = seconds.count();
+          spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(at - seconds).count();
+          // A zero value would disarm the timer
+          if ((spec.it_value.tv_sec == 0) && (spec.it_value.tv_nsec == 0)) spec.it_value.tv_nsec = 1;
+      }
+      timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+  };
+
+  std::unique_ptr<TcpServer> start_server(TcpServer::IoMode mode, const LoadConfig& config,
+                                          const utils::SocketAddress& address, utils::ThreadPool* workers)
+  {
+    auto framer = std::make_shared<utils::FixedSizeFramer>(config.payload);
+    std::unique_ptr<TcpServer> server;
+      if (config.delay_us > 0) {
+        auto delay = std::chrono::microseconds(config.delay_us);
+        auto handler = [delay](int, const std::string& input) {
+          std::this_thread::sleep_for(delay);
+          return input;
+        };
+        server = std::make_unique<TcpServer>(TcpServer::makeAsync(handler, workers), framer);
+      } else {
+        server = std::make_unique<TcpServer>(
+                TcpServer::FrameHandler([](int, std::string_view input) { return std::string(input); }), framer);
+      }
+    server->setBacklog(std::max(config.connections, 128));
+    if (!server->start(address, mode)) server.reset();
+    return server;
+  }
+
+  double micros(uint64_t nanoseconds)
+  {
+    return nanoseconds / 1000.0;
+  }
+
+  void print_latency(const char* name, const utils::LatencyHistogram& histogram)
+  {
+    std::cerr << "  " << std::left << std::setw(13) << name << std::right << std::fixed << std::setprecision(1);
+      for (auto [label, p]: {std::pair{"p50", 50.0}, {"p90", 90.0}, {"p99", 99.0}, {"p99.9", 99.9}, {"p99.99", 99.99}}) {
+        std::cerr << "  " << label << " " << std::setw(9) << micros(histogram.percentile(p));
+      }
+    std::cerr << "  max " << std::setw(10) << micros(histogram.max()) << std::endl;
+  }
+
+  void append_csv(const LoadConfig& config, const std::string& engine, double throughput, const Result& result)
+  {
+    std::ifstream existing(config.csv);
+    bool header = !existing.good() || (existing.peek() == std::ifstream::traits_type::eof());
+    existing.close();
+    std::ofstream out(config.csv, std::ios::app);
+      if (header) {
+        out << "engine,loop,connections,rate,payload,delay_us,throughput,p50_us,p90_us,p99_us,p999_us,max_us,"
+               "uncorrected_p99_us,errors\n";
+    }
+    const auto& latency = result.corrected;
+    out << engine << ',' << (config.open_loop ? "open" : "closed") << ',' << config.connections << ','
+        << config.rate << ',' << config.payload << ',' << config.delay_us << ',' << std::fixed << std::setprecision(1)
+        << throughput << ',' << micros(latency.percentile(50)) << ',' << micros(latency.percentile(90)) << ','
+        << micros(latency.percentile(99)) << ',' << micros(latency.percentile(99.9)) << ','
+        << micros(latency.max()) << ',' << micros(result.uncorrected.percentile(99)) << ',' << result.errors << '\n';
+  }
+
+  void run_load(const std::string& engine, const utils::SocketAddress& address, const LoadConfig& config)
+  {
+    std::vector<int> fds;
+    fds.reserve(config.connections);
+      for (int c = 0; c < config.connections; ++c) {
+        int fd = connect_to(address);
+        if (fd < 0) break;
+        fds.push_back(fd);
+      }
+      if (fds.size() < static_cast<size_t>(config.connections)) {
+        std::cerr << engine << ": connected " << fds.size() << " of " << config.connections << " connections"
+                  << std::endl;
+        for (int fd: fds) close(fd);
+        return;
+    }
+
+    Schedule schedule;
+    schedule.begin = Clock::now() + std::chrono::milliseconds(10);
+    schedule.measured = schedule.begin + std::chrono::duration_cast<Clock::duration>(
+                                                 std::chrono::duration<double>(config.warmup));
+    schedule.end = schedule.measured + std::chrono::duration_cast<Clock::duration>(
+                                               std::chrono::duration<double>(config.duration));
+      if (config.open_loop) {
+        schedule.interval = std::chrono::nanoseconds(static_cast<int64_t>(1e9 * config.connections / config.rate));
+    }
+
+    // Connection c goes to loop c % threads
+    size_t threads = std::clamp<size_t>(config.threads, 1, fds.size());
+    std::vector<std::unique_ptr<ClientLoop>> loops;
+    std::vector<std::thread> runners;
+      for (size_t t = 0; t < threads; ++t) {
+        std::vector<int> share;
+        for (size_t c = t; c < fds.size(); c += threads) share.push_back(fds[c]);
+        loops.push_back(std::make_unique<ClientLoop>(config, schedule, std::move(share)));
+      }
+      for (size_t t = 0; t < threads; ++t) {
+        auto* loop = loops[t].get();
+        runners.emplace_back([loop, t, threads]() { loop->run(t, threads); });
+      }
+    for (auto& runner: runners) runner.join();
+
+    Result total;
+      for (const auto& loop: loops) {
+        total.corrected.merge(loop->result().corrected);
+        total.uncorrected.merge(loop->result().uncorrected);
+        total.completed += loop->result().completed;
+        total.errors += loop->result().errors;
+      }
+    double throughput = total.completed / config.duration;
+    std::cerr << engine << " (" << (config.open_loop ? "open" : "closed") << " loop): " << std::fixed
+              << std::setprecision(0) << throughput << " req/s";
+    if (config.open_loop) std::cerr << " of " << config.rate << " offered";
+    std::cerr << ", " << total.completed << " responses, " << total.errors << " errors" << std::endl;
+      if (total.completed > 0) {
+        print_latency("latency (us)", total.corrected);
+        if (config.open_loop) print_latency("uncorrected", total.uncorrected);
+    }
+    if (!config.csv.empty()) append_csv(config, engine, throughput, total);
+  }
+
+  bool parse_argument(const std::string& argument, LoadConfig& config)
+  {
+    auto equals = argument.find('=');
+    if (equals == std::string::npos) return false;
+    std::string key = argument.substr(0, equals);
+    std::string value = argument.substr(equals + 1);
+      if (key == "engine") {
+        config.engine = value;
+      } else if (key == "loop") {
+        if ((value != "open") && (value != "closed")) return false;
+        config.open_loop = value == "open";
+      } else if (key == "connections") {
+        config.connections = std::max(1, std::atoi(value.c_str()));
+      } else if (key == "rate") {
+        config.rate = std::atof(value.c_str());
+      } else if (key == "duration") {
+        config.duration = std::max(0.1, std::atof(value.c_str()));
+      } else if (key == "warmup") {
+        config.warmup = std::max(0.0, std::atof(value.c_str()));
+      } else if (key == "payload") {
+        config.payload = std::max<size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+      } else if (key == "delay_us") {
+        config.delay_us = std::max(0, std::atoi(value.c_str()));
+      } else if (key == "workers") {
+        config.workers = std::max(1, std::atoi(value.c_str()));
+      } else if (key == "threads") {
+        config.threads = std::max(1, std::atoi(value.c_str()));
+      } else if (key == "port") {
+        config.port = static_cast<uint16_t>(std::atoi(value.c_str()));
+      } else if (key == "target") {
+        config.target = value;
+      } else if (key == "csv") {
+        config.csv = value;
+      } else {
+        return false;
+      }
+    return true;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  LoadConfig config;
+    for (int i = 1; i < argc; ++i) {
+        if (!parse_argument(argv[i], config)) {
+          std::cerr << "loadgen: bad argument '" << argv[i] << "', see the header of loadgen.cpp" << std::endl;
+          return 2;
+      }
+    }
+    if (config.open_loop && (config.rate <= 0)) {
+      std::cerr << "loadgen: the open loop needs rate=REQUESTS_PER_SECOND" << std::endl;
+      return 2;
+  }
+  raise_fd_limit(2 * config.connections + 256);
+
+  std::cerr << "connections=" << config.connections << " payload=" << config.payload
+            << " delay_us=" << config.delay_us << " duration=" << config.duration << "s warmup=" << config.warmup
+            << "s threads=" << config.threads << std::endl;
+    if (!config.target.empty()) {
+      auto address = utils::SocketAddress::parse(config.target);
+        if (!address) {
+          std::cerr << "loadgen: can't parse target '" << config.target << "'" << std::endl;
+          return 2;
+      }
+      run_load(config.target, *address, config);
+      return 0;
+  }
+
+  const std::vector<std::pair<std::string, TcpServer::IoMode>> engines = {{"blocking", TcpServer::IoMode::Blocking},
+                                                                           {"reactor", TcpServer::IoMode::Reactor},
+                                                                           {"uring", TcpServer::IoMode::IoUring},
+                                                                           {"sharded", TcpServer::IoMode::Sharded}};
+  auto address = *utils::SocketAddress::ip("127.0.0.1", config.port);
+  bool found = false;
+    for (const auto& [name, mode]: engines) {
+      if ((config.engine != "all") && (config.engine != name)) continue;
+      found = true;
+      utils::ThreadPool workers(config.workers);
+      auto server = start_server(mode, config, address, &workers);
+        if (!server) {
+          std::cerr << name << ": failed to start server" << std::endl;
+          continue;
+      }
+      std::string engine = server->ioMode() == mode ? name : name + " (fallback)";
+      run_load(engine, address, config);
+      server->stop();
+    }
+    if (!found) {
+      std::cerr << "loadgen: unknown engine '" << config.engine << "'" << std::endl;
+      return 2;
+  }
+  return 0;
+}
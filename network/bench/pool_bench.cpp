@@ -0,0 +1,181 @@
+/**
+ * @file pool_bench.cpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief A TcpClient per call against leases from a TcpClientPool, over loopback against a Reactor TcpServer
+ *
+ * `threads` callers make `calls` small request/response calls each, first with a fresh TcpClient
+ * per call (connect, request, close), then with a connection leased from one shared TcpClientPool.
+ * Reported per way: calls per second, p50/p99 of a call in microseconds, connects made and the
+ * sockets of this port left in TIME_WAIT afterwards (from /proc/net/tcp). Results go to stderr,
+ * server diagnostics to stdout.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. pool_bench.cpp ../tcpclientpool.cpp ../tcpclient.cpp ../tcpserver.cpp \
+ *        ../socketaddress.cpp ../epollreactor.cpp ../sockettuning.cpp ../sockutils.cpp ../iouring.cpp \
+ *        ../framer.cpp ../bufferpool.cpp ../response.cpp ../affinity.cpp ../batcher.cpp \
+ *        ../responsecache.cpp ../threadpool.cpp ../timingwheel.cpp ../stats.cpp ../../support/logger.cpp \
+ *        -o pool_bench -lpthread
+ * Usage: pool_bench [threads=4] [calls=5000] [port=19690]
+ *
+ * Results of one run, 1 vCPU VM, defaults:
+ *
+ *   way            calls/s    p50 us    p99 us  connects  time_wait  failures
+ *   fresh            16358     139.3    6160.4     20000      14429         0
+ *   pooled          108488      36.9      56.3         4          0         0
+ *
+ * The fresh way closes on the client side, every call leaves a socket in TIME_WAIT for a minute
+ * and the p99 is a connect waiting out a busy accept queue.
+ *
+ * @version 0.1
+ * @date 2025-03-22
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "../stats.hpp"
+#include "../tcpclientpool.hpp"
+#include "../tcpserver.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  // TCP_TIME_WAIT sockets with @p port on either end
+  size_t time_wait_sockets(uint16_t port)
+  {
+    size_t count = 0;
+      for (const char* table: {"/proc/net/tcp", "/proc/net/tcp6"}) {
+        std::ifstream in(table);
+        std::string line;
+        std::getline(in, line);
+          while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string slot, local, remote, state;
+            fields >> slot >> local >> remote >> state;
+            if (state != "06") continue;
+            auto port_of = [](const std::string& address) {
+              return static_cast<uint16_t>(std::stoul(address.substr(address.find(':') + 1), nullptr, 16));
+            };
+            if ((port_of(local) == port) || (port_of(remote) == port)) ++count;
+          }
+      }
+    return count;
+  }
+
+  struct Result
+  {
+    double calls_per_s{0.0};
+    double p50_us{0.0};
+    double p99_us{0.0};
+    size_t failures{0};
+  };
+
+  // Runs @p call `calls` times on each of `threads` threads
+  Result run(int threads, int calls, const std::function<bool(const std::string&)>& call)
+  {
+    std::vector<utils::LatencyHistogram> latencies(threads);
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> callers;
+    auto begin = Clock::now();
+      for (int t = 0; t < threads; ++t) {
+        callers.emplace_back([t, calls, &call, &latencies, &failures]() {
+          std::string request = "call from " + std::to_string(t);
+            for (int i = 0; i < calls; ++i) {
+              auto started = Clock::now();
+              if (!call(request)) ++failures;
+              latencies[t].record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+            }
+        });
+      }
+    for (auto& caller: callers) caller.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    utils::LatencyHistogram latency;
+    for (const auto& histogram: latencies) latency.merge(histogram);
+    Result result;
+    result.calls_per_s = threads * calls / elapsed;
+    result.p50_us = latency.percentile(50) / 1000.0;
+    result.p99_us = latency.percentile(99) / 1000.0;
+    result.failures = failures;
+    return result;
+  }
+
+  void print(const char* name, const Result& result, uint64_t connects, size_t time_wait)
+  {
+    std::cerr << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(12) << result.calls_per_s << std::setprecision(1) << std::setw(10) << result.p50_us
+              << std::setw(10) << result.p99_us << std::setw(10) << connects << std::setw(11) << time_wait
+              << std::setw(10) << result.failures << std::endl;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  int threads = 4;
+  int calls = 5000;
+  uint16_t port = 19690;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto eq = arg.find('=');
+        if (eq == std::string::npos) {
+          std::cerr << "Expected key=value, got " << arg << std::endl;
+          return 1;
+      }
+      std::string key = arg.substr(0, eq);
+      int value = std::atoi(arg.c_str() + eq + 1);
+      if (key == "threads") threads = std::max(1, value);
+      else if (key == "calls") calls = std::max(1, value);
+      else if (key == "port") port = static_cast<uint16_t>(value);
+    }
+
+  TcpServer server([](int, const std::string& input) { return input; });
+  auto address = *utils::SocketAddress::ip("127.0.0.1", port);
+    if (!server.start(address, TcpServer::IoMode::Reactor)) {
+      std::cerr << "Failed to start the server" << std::endl;
+      return 1;
+  }
+  std::cerr << std::left << std::setw(10) << "way" << std::right << std::setw(12) << "calls/s" << std::setw(10)
+            << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "connects" << std::setw(11) << "time_wait"
+            << std::setw(10) << "failures" << std::endl;
+
+  size_t time_wait_before = time_wait_sockets(port);
+  auto fresh = run(threads, calls, [&address](const std::string& request) {
+    TcpClient client;
+    client.setSocketTuning(utils::SocketTuning::defaults());
+    if (!client.connect(address)) return false;
+    auto response = client.request(request, 1000);
+    return response && (*response == request);
+  });
+  print("fresh", fresh, static_cast<uint64_t>(threads) * calls, time_wait_sockets(port) - time_wait_before);
+
+  // Counted from here on, the sockets of the first run stay in TIME_WAIT for a minute
+  time_wait_before = time_wait_sockets(port);
+  TcpClientPool pool;
+  auto pooled = run(threads, calls, [&address, &pool](const std::string& request) {
+    auto lease = pool.lease(address);
+    if (!lease) return false;
+    auto response = lease->request(request, 1000);
+      if (!response || (*response != request)) {
+        lease.markBroken();
+        return false;
+    }
+    return true;
+  });
+  pool.clear();
+  size_t time_wait_after = time_wait_sockets(port);
+  print("pooled", pooled, pool.stats().connects,
+        time_wait_after > time_wait_before ? time_wait_after - time_wait_before : 0);
+  server.stop();
+  return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file tuning_bench.cpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief What every utils::SocketTuning profile buys, over loopback against a Reactor TcpServer
+ *
+ * For every profile, set on the server and on the client sockets alike:
+ * - rtt: round trips of a small request on one connection, p50/p99 in microseconds
+ * - connect: a fresh connection per request (TCP Fast Open, deferred accept), microseconds each
+ * - bulk: 1 MiB echoes on one connection with the reply read concurrently, MB/s both ways
+ * - silent: connections that never send, how many of them the server accepted and holds
+ * followed by the options read back from the listener. Results go to stderr, server diagnostics
+ * to stdout.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. tuning_bench.cpp ../tcpserver.cpp ../socketaddress.cpp ../sockettuning.cpp \
+ *        ../sockutils.cpp ../epollreactor.cpp ../iouring.cpp ../framer.cpp ../bufferpool.cpp ../response.cpp \
+ *        ../affinity.cpp ../batcher.cpp ../responsecache.cpp ../threadpool.cpp \
+ *        ../timingwheel.cpp ../stats.cpp ../../support/logger.cpp -o tuning_bench -lpthread
+ * Usage: tuning_bench [round_trips=20000] [connects=2000] [bulk_mib=256] [silent=1000] [port=19490]
+ *
+ * Results of one run, 1 vCPU VM, kernel 6.18, net.ipv4.tcp_fastopen=1 (client side only),
+ * net.core.wmem_max/rmem_max 4 MiB:
+ *
+ *   profile              rtt p50   rtt p99   connect   bulk MB/s     silent held
+ *   default                  8.1      10.8      36.0        1611            1000
+ *   low-latency              8.1      12.3      37.6        1541            1000
+ *   bulk-throughput          8.1      13.1      41.1        1416            1000
+ *   many-idle                8.2      12.8      39.6         395               0
+ *
+ * Busy polling and quick ACKs need a NIC queue to poll and a delayed ACK to save, over loopback
+ * they are noise, as is TCP Fast Open until the server side has tcp_fastopen=3. Loopback has no
+ * bandwidth-delay product for large fixed buffers to cover, autotuning does as well there; 16 KiB
+ * buffers cost three quarters of the bulk throughput. Deferred accept keeps every connection that
+ * never sends off the server.
+ *
+ * @version 0.1
+ * @date 2025-02-08
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "../sockettuning.hpp"
+#include "../sockutils.hpp"
+#include "../stats.hpp"
+#include "../tcpserver.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  struct BenchConfig
+  {
+    int round_trips{20000};
+    int connects{2000};
+    int bulk_mib{256};
+    int silent{1000};
+    uint16_t port{19490};
+  };
+
+  int connect_to(const utils::SocketAddress& address, const utils::SocketTuning& tuning)
+  {
+    int fd = socket(address.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    tuning.apply(fd, utils::SocketTuning::Side::Client);
+      if (connect(fd, address.data(), address.size()) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+  }
+
+  bool send_all(int fd, const char* data, size_t size)
+  {
+      while (size > 0) {
+        auto n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+      }
+    return true;
+  }
+
+  bool receive_exactly(int fd, std::string& buffer, size_t size)
+  {
+    size_t received = 0;
+      while (received < size) {
+        auto n = recv(fd, buffer.data(), std::min(buffer.size(), size - received), 0);
+        if (n <= 0) return false;
+        received += n;
+      }
+    return true;
+  }
+
+  utils::LatencyHistogram measure_rtt(const utils::SocketAddress& address, const utils::SocketTuning& tuning,
+                                      int count)
+  {
+    utils::LatencyHistogram histogram;
+    int fd = connect_to(address, tuning);
+    if (fd < 0) return histogram;
+    const std::string request(64, 'x');
+    std::string buffer(request.size(), '\0');
+      for (int i = 0; i < count; ++i) {
+        auto begin = Clock::now();
+        if (!send_all(fd, request.data(), request.size()) || !receive_exactly(fd, buffer, request.size())) break;
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+      }
+    close(fd);
+    return histogram;
+  }
+
+  double measure_connects(const utils::SocketAddress& address, const utils::SocketTuning& tuning, int count)
+  {
+    const std::string request(64, 'x');
+    std::string buffer(request.size(), '\0');
+    int done = 0;
+    auto begin = Clock::now();
+      for (int i = 0; i < count; ++i) {
+        int fd = connect_to(address, tuning);
+        if (fd < 0) continue;
+        if (send_all(fd, request.data(), request.size()) && receive_exactly(fd, buffer, request.size())) ++done;
+        close(fd);
+      }
+    auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - begin).count();
+    return done == 0 ? 0.0 : elapsed / done;
+  }
+
+  double measure_bulk(const utils::SocketAddress& address, const utils::SocketTuning& tuning, int mebibytes)
+  {
+    int fd = connect_to(address, tuning);
+    if (fd < 0) return 0.0;
+    const std::string chunk(1024 * 1024, 'x');
+    auto begin = Clock::now();
+    // The echo comes back while the rest is still being sent, one thread alone would deadlock
+    bool received = false;
+    std::thread reader([&]() {
+      std::string buffer(256 * 1024, '\0');
+      received = receive_exactly(fd, buffer, chunk.size() * mebibytes);
+    });
+      for (int i = 0; i < mebibytes; ++i) {
+        if (!send_all(fd, chunk.data(), chunk.size())) break;
+      }
+    reader.join();
+    auto elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    close(fd);
+    return received ? mebibytes * 1.048576 / elapsed : 0.0;
+  }
+
+  // Connections that connect and never send, as port scanners and broken clients do
+  uint64_t measure_silent(TcpServer& server, const utils::SocketAddress& address, const utils::SocketTuning& tuning,
+                          int count)
+  {
+    std::vector<int> fds;
+      for (int i = 0; i < count; ++i) {
+        int fd = connect_to(address, tuning);
+        if (fd >= 0) fds.push_back(fd);
+      }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    uint64_t held = server.stats().active_connections;
+    for (int fd: fds) close(fd);
+    return held;
+  }
+
+  std::string describe(const ucommon::SocketOptions& options)
+  {
+    std::ostringstream out;
+    out << "nodelay=" << options.no_delay << " busy_poll=" << options.busy_poll_us << "us"
+        << " defer_accept=" << options.defer_accept_s << "s fastopen=" << options.fast_open
+        << " sndbuf=" << options.send_buffer << " rcvbuf=" << options.receive_buffer
+        << " user_timeout=" << options.user_timeout_ms << "ms keepalive=" << options.keepalive;
+      if (options.keepalive) {
+        out << " (" << options.keep_idle_s << "/" << options.keep_interval_s << "/" << options.keep_count << ")";
+    }
+    return out.str();
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  BenchConfig config;
+  if (argc > 1) config.round_trips = std::atoi(argv[1]);
+  if (argc > 2) config.connects = std::atoi(argv[2]);
+  if (argc > 3) config.bulk_mib = std::max(1, std::atoi(argv[3]));
+  if (argc > 4) config.silent = std::atoi(argv[4]);
+  if (argc > 5) config.port = static_cast<uint16_t>(std::atoi(argv[5]));
+
+  std::cerr << std::left << std::setw(18) << "profile" << std::right << std::setw(10) << "rtt p50" << std::setw(10)
+            << "rtt p99" << std::setw(10) << "connect" << std::setw(12) << "bulk MB/s" << std::setw(16)
+            << "silent held" << std::endl;
+  std::vector<std::string> readback;
+    for (const char* name: {"default", "low-latency", "bulk-throughput", "many-idle"}) {
+      auto tuning = *utils::SocketTuning::byName(name);
+      TcpServer server([](int, const std::string& input) { return input; });
+      server.setSocketTuning(tuning);
+      server.setBacklog(4096);
+      auto address = *utils::SocketAddress::ip("127.0.0.1", config.port++);
+        if (!server.start(address, TcpServer::IoMode::Reactor)) {
+          std::cerr << name << ": failed to start server" << std::endl;
+          continue;
+      }
+      auto rtt = measure_rtt(address, tuning, config.round_trips);
+      double connect_us = measure_connects(address, tuning, config.connects);
+      double bulk = measure_bulk(address, tuning, config.bulk_mib);
+      uint64_t silent = measure_silent(server, address, tuning, config.silent);
+      if (auto options = server.socketOptions()) readback.push_back(std::string(name) + ": " + describe(*options));
+      server.stop();
+
+      std::cerr << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(1)
+                << std::setw(10) << rtt.percentile(50) / 1000.0 << std::setw(10) << rtt.percentile(99) / 1000.0
+                << std::setw(10) << connect_us << std::setw(12) << std::setprecision(0) << bulk << std::setw(16)
+                << silent << std::endl;
+    }
+  std::cerr << "\nlistener options in effect:" << std::endl;
+  for (const auto& line: readback) std::cerr << "  " << line << std::endl;
+  return 0;
+}
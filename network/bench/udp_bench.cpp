@@ -0,0 +1,115 @@
+/**
+ * @file udp_bench.cpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief UdpServer throughput with one datagram per syscall against recvmmsg()/sendmmsg() batches
+ *
+ * Every sender thread keeps a window of datagrams in flight on its own socket and refills it as
+ * the echoes come back, so the server always finds a queue to batch from. Results go to stderr,
+ * server diagnostics to stdout.
+ *
+ * Build: g++ -std=c++17 -O2 -I.. udp_bench.cpp ../udpserver.cpp ../socketaddress.cpp ../epollreactor.cpp \
+ *        ../affinity.cpp ../timingwheel.cpp ../../support/logger.cpp -o udp_bench -lpthread
+ * Usage: udp_bench [senders=4] [datagrams=200000] [payload=64] [port=19290]
+ *
+ * @version 0.1
+ * @date 2025-01-18
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+
+#include "../udpserver.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+  constexpr int kWindow = 64;  // datagrams a sender keeps in flight
+
+  struct BenchConfig
+  {
+    int senders{4};
+    int datagrams{200000};
+    size_t payload{64};
+    uint16_t port{19290};
+  };
+
+  // Sends and receives until @p total echoes are back or the server went quiet for a second
+  long run_sender(const utils::SocketAddress& address, const BenchConfig& config, int total)
+  {
+    int fd = socket(address.family(), SOCK_DGRAM, 0);
+    if ((fd < 0) || (connect(fd, address.data(), address.size()) < 0)) return 0;
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    const std::string payload(config.payload, 'x');
+    std::string buffer(config.payload + 16, '\0');
+    int sent = 0;
+    long received = 0;
+      while (received < total) {
+          while ((sent < total) && (sent - received < kWindow)) {
+            if (send(fd, payload.data(), payload.size(), 0) < 0) break;
+            ++sent;
+          }
+        if (recv(fd, buffer.data(), buffer.size(), 0) <= 0) break;
+        ++received;
+      }
+    close(fd);
+    return received;
+  }
+
+  void run_config(const char* name, size_t batch, bool offload, const BenchConfig& config)
+  {
+    UdpServer server(UdpServer::DatagramHandler([](int, std::string_view input) { return std::string(input); }));
+    server.setBatchSize(batch);
+    server.setOffload(offload);
+    auto address = utils::SocketAddress::anyIPv4(config.port);
+      if (!server.start(address)) {
+        std::cerr << name << ": failed to start server" << std::endl;
+        return;
+    }
+
+    auto target = *utils::SocketAddress::ip("127.0.0.1", config.port);
+    std::atomic<long> echoed{0};
+    std::vector<std::thread> senders;
+    auto begin = std::chrono::steady_clock::now();
+      for (int s = 0; s < config.senders; ++s) {
+        senders.emplace_back([&]() { echoed += run_sender(target, config, config.datagrams / config.senders); });
+      }
+    for (auto& sender: senders) sender.join();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    auto stats = server.stats();
+    server.stop();
+
+    double per_receive = stats.receive_calls == 0 ? 0.0 : double(stats.datagrams_received) / stats.receive_calls;
+    double per_send = stats.send_calls == 0 ? 0.0 : double(stats.datagrams_sent) / stats.send_calls;
+    std::cerr << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(10) << echoed / elapsed << " echoes/s" << std::setprecision(1) << "  datagrams per recv call "
+              << std::setw(5) << per_receive << ", per send call " << std::setw(5) << per_send << "  lost "
+              << (config.datagrams / config.senders * config.senders - echoed) << std::endl;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  BenchConfig config;
+  if (argc > 1) config.senders = std::max(1, std::atoi(argv[1]));
+  if (argc > 2) config.datagrams = std::atoi(argv[2]);
+  if (argc > 3) config.payload = std::strtoul(argv[3], nullptr, 10);
+  if (argc > 4) config.port = static_cast<uint16_t>(std::atoi(argv[4]));
+
+  std::cerr << "senders=" << config.senders << " datagrams=" << config.datagrams << " payload=" << config.payload
+            << std::endl;
+  run_config("batch 1", 1, false, config);
+  run_config("batch 32", 32, false, config);
+  run_config("batch 32+gso", 32, true, config);
+  return 0;
+}
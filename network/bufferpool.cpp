@@ -0,0 +1,268 @@
+/**
+ * @file bufferpool.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "bufferpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace utils
+{
+  namespace detail
+  {
+    struct Block
+    {
+      std::atomic<uint32_t> refs{1};
+      size_t capacity{0};
+      PoolCore* core{nullptr};  // nullptr for one-off blocks
+
+      char* data() noexcept
+      {
+        return reinterpret_cast<char*>(this + 1);
+      }
+    };
+
+    /**
+     * @brief Shared state of a pool. Lives while the pool or any of its blocks does.
+     */
+    struct PoolCore
+    {
+      size_t block_size;
+      size_t max_free;
+      std::mutex mutex;
+      std::vector<Block*> free;
+      bool closed{false};
+      std::atomic<size_t> refs{1};  // the pool itself plus every block out of the free list
+      std::atomic<uint64_t> hits{0};
+      std::atomic<uint64_t> misses{0};
+      std::atomic<uint64_t> bytes_in_use{0};
+    };
+
+    namespace
+    {
+      Block* allocate_block(size_t capacity, PoolCore* core)
+      {
+        void* memory = ::operator new(sizeof(Block) + capacity);
+        auto* block = new (memory) Block();
+        block->capacity = capacity;
+        block->core = core;
+        return block;
+      }
+
+      void free_block(Block* block) noexcept
+      {
+        block->~Block();
+        ::operator delete(block);
+      }
+
+      void unref_core(PoolCore* core) noexcept
+      {
+          if (core->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            for (auto* block: core->free) free_block(block);
+            delete core;
+        }
+      }
+    }  // namespace
+
+    void retain(Block* block) noexcept
+    {
+      block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(Block* block) noexcept
+    {
+      if (block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+      PoolCore* core = block->core;
+        if (core == nullptr) {
+          free_block(block);
+          return;
+      }
+      core->bytes_in_use.fetch_sub(block->capacity, std::memory_order_relaxed);
+      bool recycled = false;
+        if (block->capacity == core->block_size) {
+          std::lock_guard<std::mutex> lock(core->mutex);
+            if (!core->closed && (core->free.size() < core->max_free)) {
+              block->refs.store(1, std::memory_order_relaxed);
+              core->free.push_back(block);
+              recycled = true;
+          }
+      }
+      if (!recycled) free_block(block);
+      unref_core(core);
+    }
+  }  // namespace detail
+
+  BufferSlice::BufferSlice(detail::Block* block, const char* data, size_t size) noexcept:
+      m_block(block), m_data(data), m_size(size)
+  {
+    if (m_block != nullptr) detail::retain(m_block);
+  }
+
+  BufferSlice::BufferSlice(const BufferSlice& other) noexcept:
+      m_block(other.m_block), m_data(other.m_data), m_size(other.m_size)
+  {
+    if (m_block != nullptr) detail::retain(m_block);
+  }
+
+  BufferSlice::BufferSlice(BufferSlice&& other) noexcept:
+      m_block(std::exchange(other.m_block, nullptr)), m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0))
+  {}
+
+  BufferSlice& BufferSlice::operator=(BufferSlice other) noexcept
+  {
+    std::swap(m_block, other.m_block);
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    return *this;
+  }
+
+  BufferSlice::~BufferSlice()
+  {
+    if (m_block != nullptr) detail::release(m_block);
+  }
+
+  BufferSlice BufferSlice::subslice(size_t offset, size_t length) const
+  {
+    offset = std::min(offset, m_size);
+    length = std::min(length, m_size - offset);
+    return BufferSlice(m_block, m_data + offset, length);
+  }
+
+  BufferPool::BufferPool(size_t block_size, size_t max_free_blocks): m_core(new detail::PoolCore)
+  {
+    m_core->block_size = std::max<size_t>(block_size, 64);
+    m_core->max_free = max_free_blocks;
+  }
+
+  BufferPool::~BufferPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_core->mutex);
+      m_core->closed = true;
+    }
+    // Outstanding blocks keep the core alive and free themselves on release
+    detail::unref_core(m_core);
+  }
+
+  size_t BufferPool::blockSize() const noexcept
+  {
+    return m_core->block_size;
+  }
+
+  BufferPool::Stats BufferPool::stats() const
+  {
+    Stats stats;
+    stats.hits = m_core->hits.load(std::memory_order_relaxed);
+    stats.misses = m_core->misses.load(std::memory_order_relaxed);
+    stats.bytes_in_use = m_core->bytes_in_use.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_core->mutex);
+    stats.free_blocks = m_core->free.size();
+    return stats;
+  }
+
+  detail::Block* BufferPool::acquire(size_t min_size)
+  {
+    detail::Block* block = nullptr;
+      if (min_size <= m_core->block_size) {
+        std::lock_guard<std::mutex> lock(m_core->mutex);
+          if (!m_core->free.empty()) {
+            block = m_core->free.back();
+            m_core->free.pop_back();
+        }
+    }
+      if (block != nullptr) {
+        m_core->hits.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        m_core->misses.fetch_add(1, std::memory_order_relaxed);
+        block = detail::allocate_block(std::max(min_size, m_core->block_size), m_core);
+      }
+    m_core->refs.fetch_add(1, std::memory_order_relaxed);
+    m_core->bytes_in_use.fetch_add(block->capacity, std::memory_order_relaxed);
+    return block;
+  }
+
+  BlockBuffer::~BlockBuffer()
+  {
+    drop();
+  }
+
+  void BlockBuffer::drop() noexcept
+  {
+      if (m_block != nullptr) {
+        detail::release(m_block);
+        m_block = nullptr;
+    }
+    m_begin = m_end = 0;
+  }
+
+  void BlockBuffer::ensureWritable(size_t size)
+  {
+    if (writable() >= size) return;
+
+    size_t unread = readable();
+      if ((m_block != nullptr) && (m_block->refs.load(std::memory_order_acquire) == 1) &&
+          (m_block->capacity >= unread + size)) {
+        std::memmove(m_block->data(), m_block->data() + m_begin, unread);
+        m_begin = 0;
+        m_end = unread;
+        return;
+    }
+
+    // A frame outgrowing its block doubles it, instead of being copied once per read
+    size_t needed = unread + size;
+    bool outgrown = (m_block != nullptr) && (unread > 0) && (m_block->capacity < needed);
+    size_t grown = outgrown ? std::max(2 * m_block->capacity, needed) : needed;
+    if (m_growth_limit > 0) grown = std::max(needed, std::min(grown, m_growth_limit));
+    detail::Block* block = (m_pool != nullptr) ? m_pool->acquire(grown)
+                                                : detail::allocate_block(std::max<size_t>(grown, 4096), nullptr);
+    if (unread > 0) std::memcpy(block->data(), m_block->data() + m_begin, unread);
+    drop();
+    m_block = block;
+    m_end = unread;
+  }
+
+  char* BlockBuffer::writePtr() noexcept
+  {
+    return m_block != nullptr ? m_block->data() + m_end : nullptr;
+  }
+
+  size_t BlockBuffer::writable() const noexcept
+  {
+    return m_block != nullptr ? m_block->capacity - m_end : 0;
+  }
+
+  void BlockBuffer::append(std::string_view data)
+  {
+    if (data.empty()) return;
+    ensureWritable(data.size());
+    std::memcpy(writePtr(), data.data(), data.size());
+    commit(data.size());
+  }
+
+  std::string_view BlockBuffer::data() const noexcept
+  {
+    if (m_block == nullptr) return {};
+    return {m_block->data() + m_begin, readable()};
+  }
+
+  void BlockBuffer::consume(size_t size) noexcept
+  {
+    m_begin += size;
+    if (m_begin >= m_end) drop();
+  }
+
+  BufferSlice BlockBuffer::slice(std::string_view part) const
+  {
+    return BufferSlice(m_block, part.data(), part.size());
+  }
+
+}  // namespace utils
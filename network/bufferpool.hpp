@@ -0,0 +1,188 @@
+/**
+ * @file bufferpool.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Pool of fixed-size reference-counted receive blocks
+ * @brief Provides slices that keep their block alive and a block-backed growable receive buffer
+ * @version 0.1
+ * @date 2024-11-30
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_BUFFERPOOL_HPP
+#define UFW_BUFFERPOOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+namespace utils
+{
+  namespace detail
+  {
+    struct Block;
+    struct PoolCore;
+  }  // namespace detail
+
+  /**
+   * @class BufferSlice
+   * @brief Read-only view into a pooled block holding a reference to it.
+   *
+   * Copying a slice only bumps the block's reference counter. The block goes back to its pool
+   * when the last slice and the owning buffer let it go, so a slice may be kept as long as needed.
+   */
+  class BufferSlice
+  {
+  public:
+    BufferSlice() = default;
+    BufferSlice(const BufferSlice& other) noexcept;
+    BufferSlice(BufferSlice&& other) noexcept;
+    BufferSlice& operator=(BufferSlice other) noexcept;
+    ~BufferSlice();
+
+    const char* data() const noexcept
+    {
+      return m_data;
+    }
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+    bool empty() const noexcept
+    {
+      return m_size == 0;
+    }
+
+    std::string_view view() const noexcept
+    {
+      return {m_data, m_size};
+    }
+
+    /**
+     * @brief Narrower slice of the same block, @p offset and @p length are clamped to this slice.
+     */
+    BufferSlice subslice(size_t offset, size_t length) const;
+
+  private:
+    friend class BlockBuffer;
+
+    BufferSlice(detail::Block* block, const char* data, size_t size) noexcept;
+
+    detail::Block* m_block{nullptr};
+    const char* m_data{nullptr};
+    size_t m_size{0};
+  };
+
+  /**
+   * @class BufferPool
+   * @brief Thread-safe free list of equally sized blocks.
+   *
+   * Blocks may be released from any thread and may outlive the pool: a block returned after the
+   * pool is gone is simply freed. Requests bigger than the block size are served by a one-off
+   * allocation and count as misses.
+   */
+  class BufferPool
+  {
+  public:
+    struct Stats
+    {
+      uint64_t hits{0};          // acquisitions served from the free list
+      uint64_t misses{0};        // acquisitions that had to allocate
+      uint64_t bytes_in_use{0};  // capacity of the blocks currently held by buffers and slices
+      uint64_t free_blocks{0};
+    };
+
+    explicit BufferPool(size_t block_size = 16 * 1024, size_t max_free_blocks = 4096);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    size_t blockSize() const noexcept;
+    Stats stats() const;
+
+  private:
+    friend class BlockBuffer;
+
+    detail::Block* acquire(size_t min_size);
+
+    detail::PoolCore* m_core;
+  };
+
+  /**
+   * @class BlockBuffer
+   * @brief Growable receive buffer backed by pooled blocks.
+   *
+   * The socket writes at the tail and framers parse at the head. A frame can be turned into a
+   * BufferSlice without copying. An empty buffer holds no block at all, so an idle connection costs
+   * no buffer memory.
+   */
+  class BlockBuffer
+  {
+  public:
+    explicit BlockBuffer(BufferPool* pool = nullptr): m_pool(pool) {}
+    ~BlockBuffer();
+
+    BlockBuffer(const BlockBuffer&) = delete;
+    BlockBuffer& operator=(const BlockBuffer&) = delete;
+
+    void setPool(BufferPool* pool) noexcept
+    {
+      m_pool = pool;
+    }
+    /**
+     * @brief Largest block growth alone leads to, e.g. the framer's IFramer::maxFrameSize().
+     * 0 (the default) is no limit. A single ensureWritable() asking for more still gets it.
+     */
+    void setGrowthLimit(size_t limit) noexcept
+    {
+      m_growth_limit = limit;
+    }
+
+    /**
+     * @brief Makes at least @p size bytes writable at the tail.
+     * Unread bytes are moved to the front of the block if nobody else references it,
+     * otherwise (or if the block is too small) they are moved to a fresh block at least twice
+     * as large, so a frame arriving in small reads is copied O(log n) times.
+     */
+    void ensureWritable(size_t size);
+    char* writePtr() noexcept;
+    size_t writable() const noexcept;
+    void commit(size_t size) noexcept
+    {
+      m_end += size;
+    }
+    void append(std::string_view data);
+
+    std::string_view data() const noexcept;
+    size_t readable() const noexcept
+    {
+      return m_end - m_begin;
+    }
+    bool empty() const noexcept
+    {
+      return m_begin == m_end;
+    }
+    void consume(size_t size) noexcept;
+
+    /**
+     * @brief Slice sharing the block, @p part must lie within data().
+     */
+    BufferSlice slice(std::string_view part) const;
+
+  private:
+    BufferPool* m_pool;
+    detail::Block* m_block{nullptr};
+    size_t m_begin{0};
+    size_t m_end{0};
+    size_t m_growth_limit{0};
+
+    void drop() noexcept;
+  };
+
+}  // namespace utils
+
+#endif  // UFW_BUFFERPOOL_HPP
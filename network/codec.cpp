@@ -0,0 +1,218 @@
+/**
+ * @file codec.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "codec.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace utils
+{
+  namespace
+  {
+    constexpr uint32_t kCastagnoli = 0x82F63B78;  // reflected polynomial
+
+    std::array<uint32_t, 256> make_table()
+    {
+      std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i) {
+          uint32_t crc = i;
+          for (int bit = 0; bit < 8; ++bit) crc = (crc & 1) ? (crc >> 1) ^ kCastagnoli : crc >> 1;
+          table[i] = crc;
+        }
+      return table;
+    }
+
+    uint32_t crc32c_table(uint32_t crc, const uint8_t* data, size_t size)
+    {
+      static const auto table = make_table();
+      while (size--) crc = table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+      return crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2"))) uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t size)
+    {
+      uint64_t crc64 = crc;
+        while (size >= 8) {
+          uint64_t word;
+          std::memcpy(&word, data, sizeof(word));
+          crc64 = _mm_crc32_u64(crc64, word);
+          data += 8;
+          size -= 8;
+        }
+      crc = static_cast<uint32_t>(crc64);
+      while (size--) crc = _mm_crc32_u8(crc, *data++);
+      return crc;
+    }
+
+    const bool kHaveSse42 = __builtin_cpu_supports("sse4.2");
+#endif
+
+    void put_be32(uint32_t value, std::string& out)
+    {
+      for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+
+    uint32_t get_be32(const char* data)
+    {
+      uint32_t value = 0;
+      for (int i = 0; i < 4; ++i) value = (value << 8) | static_cast<uint8_t>(data[i]);
+      return value;
+    }
+  }  // namespace
+
+  uint32_t crc32c(const void* data, size_t size, uint32_t crc)
+  {
+    auto bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (kHaveSse42) return ~crc32c_sse42(crc, bytes, size);
+#endif
+    return ~crc32c_table(crc, bytes, size);
+  }
+
+  bool Crc32cCodec::decode(std::string_view& message) const
+  {
+    if (message.size() < 4) return false;
+    auto body = message.substr(0, message.size() - 4);
+    if (crc32c(body.data(), body.size()) != get_be32(message.data() + body.size())) return false;
+    message = body;
+    return true;
+  }
+
+  void Crc32cCodec::encode(std::string_view payload, std::string&, std::string& trailer) const
+  {
+    put_be32(crc32c(payload.data(), payload.size()), trailer);
+  }
+
+  PrefixCodec::PrefixCodec(std::string prefix): m_prefix(std::move(prefix)) {}
+
+  bool PrefixCodec::decode(std::string_view& message) const
+  {
+    if (message.substr(0, m_prefix.size()) != m_prefix) return false;
+    message.remove_prefix(m_prefix.size());
+    return true;
+  }
+
+  void PrefixCodec::encode(std::string_view, std::string& header, std::string&) const
+  {
+    header.append(m_prefix);
+  }
+
+  bool PrefixCodec::encodeEnvelope(size_t, std::string& header, std::string&) const
+  {
+    header.append(m_prefix);
+    return true;
+  }
+
+  CodecPipeline::CodecPipeline(std::shared_ptr<const IFramer> framer, std::vector<std::shared_ptr<const ICodec>> stages)
+  {
+      if (auto inner = std::dynamic_pointer_cast<const CodecPipeline>(framer)) {
+        // Its stages see the frame first
+        m_framer = inner->m_framer;
+        m_stages = inner->m_stages;
+      } else {
+        m_framer = framer ? std::move(framer) : std::make_shared<RawFramer>();
+    }
+    for (auto& stage: stages)
+      if (stage) m_stages.push_back(std::move(stage));
+  }
+
+  IFramer::Status CodecPipeline::next(std::string_view data, Frame& frame) const
+  {
+    auto status = m_framer->next(data, frame);
+    if (status != Status::Complete) return status;
+    for (const auto& stage: m_stages)
+      if (!stage->decode(frame.payload)) return Status::Error;
+    return Status::Complete;
+  }
+
+  void CodecPipeline::encode(std::string_view payload, std::string& out) const
+  {
+    struct Scratch
+    {
+      std::string header;
+      std::string trailer;
+      std::string stage_header;
+      std::string stage_trailer;
+      std::string joined;
+    };
+      if (m_stages.empty()) {
+        m_framer->encode(payload, out);
+        return;
+    }
+    // Reused by every message encoded on this thread
+    thread_local Scratch scratch;
+    auto& [header, trailer, stage_header, stage_trailer, joined] = scratch;
+    header.clear();
+    trailer.clear();
+    std::string_view body = payload;
+      for (auto it = m_stages.rbegin(); it != m_stages.rend(); ++it) {
+        stage_header.clear();
+        stage_trailer.clear();
+          if (header.empty() && trailer.empty()) {
+            (*it)->encode(body, stage_header, stage_trailer);
+          } else if (!(*it)->encodeEnvelope(header.size() + body.size() + trailer.size(), stage_header,
+                                            stage_trailer)) {
+            // The stage reads what the inner ones made of the payload, in one piece
+            std::string next;
+            next.reserve(header.size() + body.size() + trailer.size());
+            next.append(header).append(body).append(trailer);
+            joined.swap(next);
+            body = joined;
+            header.clear();
+            trailer.clear();
+            stage_header.clear();
+            stage_trailer.clear();
+            (*it)->encode(body, stage_header, stage_trailer);
+        }
+        if (header.empty()) header.swap(stage_header);
+        else header.insert(0, stage_header);
+        trailer.append(stage_trailer);
+      }
+
+    size_t size = header.size() + body.size() + trailer.size();
+    stage_trailer.clear();
+      if (m_framer->encodeEnvelope(size, out, stage_trailer)) {
+        out.append(header).append(body).append(trailer).append(stage_trailer);
+        return;
+    }
+    std::string message;
+    message.reserve(size);
+    message.append(header).append(body).append(trailer);
+    m_framer->encode(message, out);
+  }
+
+  bool CodecPipeline::encodeEnvelope(size_t size, std::string& header, std::string& trailer) const
+  {
+    std::string inner_header;
+    std::string inner_trailer;
+      for (auto it = m_stages.rbegin(); it != m_stages.rend(); ++it) {
+        std::string stage_header;
+        std::string stage_trailer;
+        if (!(*it)->encodeEnvelope(size, stage_header, stage_trailer)) return false;
+        size += stage_header.size() + stage_trailer.size();
+        inner_header.insert(0, stage_header);
+        inner_trailer.append(stage_trailer);
+      }
+    std::string frame_trailer;
+    if (!m_framer->encodeEnvelope(size, header, frame_trailer)) return false;
+    header.append(inner_header);
+    trailer.append(inner_trailer).append(frame_trailer);
+    return true;
+  }
+
+  size_t CodecPipeline::maxFrameSize() const
+  {
+    return m_framer->maxFrameSize();
+  }
+
+}  // namespace utils
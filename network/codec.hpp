@@ -0,0 +1,128 @@
+/**
+ * @file codec.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Codec stages composed with a framer into one pipeline between the socket and the handler
+ * @brief Stages check and strip their envelope on views into the receive buffer, checksums use CRC32C
+ * @version 0.1
+ * @date 2025-03-15
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_CODEC_HPP
+#define UFW_CODEC_HPP
+
+#include "framer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @brief CRC-32C (Castagnoli) of @p size bytes, continuing @p crc of the bytes before them.
+   * Uses the SSE4.2 instruction where the CPU has it. crc32c("123456789") is 0xE3069283.
+   */
+  uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+  /**
+   * @class ICodec
+   * @brief Stateless stage of a CodecPipeline wrapping every message in an envelope of its own,
+   * one instance may be shared by all connections.
+   */
+  class ICodec
+  {
+  public:
+    virtual ~ICodec() = default;
+
+    /**
+     * @brief Checks the envelope of @p message and narrows the view to what it carries, no bytes are copied.
+     * @return false if the message is malformed (the connection should be dropped).
+     */
+    virtual bool decode(std::string_view& message) const = 0;
+
+    /**
+     * @brief Appends the bytes going before and after @p payload to @p header and @p trailer.
+     */
+    virtual void encode(std::string_view payload, std::string& header, std::string& trailer) const = 0;
+
+    /**
+     * @brief Same as encode() knowing the size of the payload only, see IFramer::encodeEnvelope().
+     * @return false if the envelope depends on the payload bytes (a checksum).
+     */
+    virtual bool encodeEnvelope(size_t /*size*/, std::string& /*header*/, std::string& /*trailer*/) const
+    {
+      return false;
+    }
+  };
+
+  /**
+   * @brief CRC-32C of the message as 4 big-endian bytes after it. A mismatch is a protocol error.
+   */
+  class Crc32cCodec final: public ICodec
+  {
+  public:
+    bool decode(std::string_view& message) const override;
+    void encode(std::string_view payload, std::string& header, std::string& trailer) const override;
+  };
+
+  /**
+   * @brief Fixed bytes before every message, a protocol tag or version. A message without them is
+   * a protocol error.
+   */
+  class PrefixCodec final: public ICodec
+  {
+  public:
+    explicit PrefixCodec(std::string prefix);
+
+    bool decode(std::string_view& message) const override;
+    void encode(std::string_view payload, std::string& header, std::string& trailer) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+
+  private:
+    std::string m_prefix;
+  };
+
+  /**
+   * @class CodecPipeline
+   * @brief A framer followed by codec stages, itself a framer: give it to TcpServer::setFramer(),
+   * UdpServer::setFramer() or anything else taking an IFramer.
+   *
+   * Decoding cuts a frame and hands its payload through the stages from the first (outermost on the
+   * wire) to the last, each narrowing the view, so the handler gets a slice of the receive buffer as
+   * without stages. Encoding wraps the response from the last stage to the first, then frames it.
+   * Envelopes known from the size alone are written around the response without joining its parts.
+   * A checksum stage reads the response where it is, it is copied only to join it with the envelopes
+   * of inner stages. A pipeline given as the framer of another one is merged into it.
+   *
+   * Stages can't produce bytes that are not in the frame (decompression): the handler's request is a
+   * slice of the receive buffer. Binary envelopes need a length framing, a delimiter may show up
+   * inside a checksum.
+   */
+  class CodecPipeline final: public IFramer
+  {
+  public:
+    /**
+     * @param framer nullptr is a RawFramer.
+     * @param stages Outermost on the wire first.
+     */
+    CodecPipeline(std::shared_ptr<const IFramer> framer, std::vector<std::shared_ptr<const ICodec>> stages);
+
+    Status next(std::string_view data, Frame& frame) const override;
+    void encode(std::string_view payload, std::string& out) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+    size_t maxFrameSize() const override;
+
+  private:
+    std::shared_ptr<const IFramer> m_framer;
+    std::vector<std::shared_ptr<const ICodec>> m_stages;
+  };
+
+}  // namespace utils
+
+#endif  // UFW_CODEC_HPP
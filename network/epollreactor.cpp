@@ -0,0 +1,208 @@
+/**
+ * @file epollreactor.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "epollreactor.hpp"
+
+#include "../support/logger.hpp"
+
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace utils
+{
+  namespace
+  {
+    constexpr int kMaxEvents = 256;
+  }
+
+  EpollReactor::EpollReactor()
+  {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      if (m_epoll_fd < 0) {
+        UFW_LOG_ERROR("EpollReactor: epoll_create1 failed. Errno: ", utils::Errno{errno});
+        return;
+    }
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (m_wakeup_fd < 0) {
+        UFW_LOG_ERROR("EpollReactor: eventfd failed. Errno: ", utils::Errno{errno});
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;  // nullptr marks the wakeup fd
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &ev);
+  }
+
+  EpollReactor::~EpollReactor()
+  {
+    stop();
+    if (m_wakeup_fd >= 0) close(m_wakeup_fd);
+    if (m_epoll_fd >= 0) close(m_epoll_fd);
+  }
+
+  bool EpollReactor::start()
+  {
+    if ((m_epoll_fd < 0) || (m_wakeup_fd < 0)) return false;
+    if (m_running.exchange(true)) return true;
+    m_thread = std::thread(&EpollReactor::loop, this);
+    return true;
+  }
+
+  void EpollReactor::stop()
+  {
+      if (m_running.exchange(false)) {
+        wakeup();
+    }
+    if (m_thread.joinable()) m_thread.join();
+
+      for (auto& [fd, entry]: m_entries) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+      }
+    // Callbacks may own the resources behind their fds, release them outside of the map
+    auto entries = std::move(m_entries);
+    m_entries.clear();
+    entries.clear();
+    m_retired.clear();
+    m_timers.clear();
+
+    std::vector<Task> tasks;
+    {
+      std::lock_guard<std::mutex> lock(m_tasks_mutex);
+      tasks.swap(m_tasks);
+    }
+  }
+
+  void EpollReactor::setPlacement(CpuPlacement placement)
+  {
+    m_placement = std::move(placement);
+  }
+
+  bool EpollReactor::isRunning() const
+  {
+    return m_running;
+  }
+
+  bool EpollReactor::isInLoopThread() const
+  {
+    return std::this_thread::get_id() == m_thread.get_id();
+  }
+
+  bool EpollReactor::add(int fd, uint32_t events, EventCallback callback)
+  {
+    auto entry = std::make_unique<Entry>(Entry{fd, std::move(callback)});
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = entry.get();
+      if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        UFW_LOG_WARN("EpollReactor: failed to add fd ", fd, ". Errno: ", utils::Errno{errno});
+        return false;
+    }
+    m_entries[fd] = std::move(entry);
+    return true;
+  }
+
+  bool EpollReactor::modify(int fd, uint32_t events)
+  {
+    auto it = m_entries.find(fd);
+    if (it == m_entries.end()) return false;
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.ptr = it->second.get();
+    return epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+  }
+
+  void EpollReactor::remove(int fd)
+  {
+    auto it = m_entries.find(fd);
+    if (it == m_entries.end()) return;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    // Events for this entry may still be pending in the current batch
+    it->second->fd = -1;
+    m_retired.push_back(std::move(it->second));
+    m_entries.erase(it);
+  }
+
+  bool EpollReactor::post(Task task)
+  {
+    if (!m_running) return false;
+    bool was_empty;
+    {
+      std::lock_guard<std::mutex> lock(m_tasks_mutex);
+      was_empty = m_tasks.empty();
+      m_tasks.push_back(std::move(task));
+    }
+    if (was_empty) wakeup();
+    return true;
+  }
+
+  TimingWheel::TimerId EpollReactor::runAfter(std::chrono::milliseconds delay, Task task)
+  {
+    return m_timers.schedule(delay, std::move(task));
+  }
+
+  bool EpollReactor::restartTimer(TimingWheel::TimerId id, std::chrono::milliseconds delay)
+  {
+    return m_timers.reschedule(id, delay);
+  }
+
+  bool EpollReactor::cancelTimer(TimingWheel::TimerId id)
+  {
+    return m_timers.cancel(id);
+  }
+
+  size_t EpollReactor::size() const noexcept
+  {
+    return m_entries.size();
+  }
+
+  void EpollReactor::wakeup()
+  {
+    uint64_t one = 1;
+    ssize_t written = write(m_wakeup_fd, &one, sizeof(one));
+    (void)written;  // EAGAIN means the counter is already non-zero, the loop wakes up anyway
+  }
+
+  void EpollReactor::run_tasks()
+  {
+    std::vector<Task> tasks;
+    {
+      std::lock_guard<std::mutex> lock(m_tasks_mutex);
+      tasks.swap(m_tasks);
+    }
+    for (auto& task: tasks) task();
+  }
+
+  void EpollReactor::loop()
+  {
+    if (!applyPlacement(m_placement)) UFW_LOG_WARN("EpollReactor: failed to move the loop to ", m_placement.toString());
+    epoll_event events[kMaxEvents];
+      while (m_running) {
+        int timeout = m_timers.nextTimeoutMs(TimingWheel::Clock::now());
+        int count = epoll_wait(m_epoll_fd, events, kMaxEvents, timeout);
+          if (count < 0) {
+            if (errno == EINTR) continue;
+            UFW_LOG_ERROR("EpollReactor: epoll_wait failed. Errno: ", utils::Errno{errno});
+            break;
+        }
+          for (int i = 0; i < count; ++i) {
+            auto* entry = static_cast<Entry*>(events[i].data.ptr);
+              if (entry == nullptr) {
+                uint64_t value;
+                while (read(m_wakeup_fd, &value, sizeof(value)) > 0) {}
+                run_tasks();
+                continue;
+            }
+            if (entry->fd >= 0) entry->callback(events[i].events);
+          }
+        // Before the retired entries go: a timer may close a connection whose fd fired in this batch
+        if (!m_timers.empty()) m_timers.advance(TimingWheel::Clock::now());
+        m_retired.clear();
+      }
+  }
+
+}  // namespace utils
@@ -0,0 +1,119 @@
+/**
+ * @file epollreactor.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Edge-triggered epoll event loop running on its own thread
+ * @brief Dispatches readiness events to per-fd callbacks and runs tasks posted from other threads
+ * @version 0.1
+ * @date 2024-11-02
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_EPOLLREACTOR_HPP
+#define UFW_EPOLLREACTOR_HPP
+
+#include "affinity.hpp"
+#include "timingwheel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @class EpollReactor
+   * @brief Single-threaded readiness loop built on epoll.
+   *
+   * Every registered fd owns a callback which is invoked on the loop thread with the
+   * epoll event mask. `add()`, `modify()` and `remove()` must be called either before
+   * `start()` or from the loop thread itself; other threads hand work over with `post()`.
+   * A callback may remove its own fd: the entry is retired and released only after the
+   * current batch of events has been dispatched. Timers share the loop: epoll_wait() sleeps
+   * until the next one is due, no timer fd is created for them.
+   */
+  class EpollReactor
+  {
+  public:
+    using EventCallback = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+
+    EpollReactor();
+    ~EpollReactor();
+
+    EpollReactor(const EpollReactor&) = delete;
+    EpollReactor& operator=(const EpollReactor&) = delete;
+
+    bool start();
+    void stop();
+
+    /**
+     * @brief Where the loop thread moves itself first thing, before it allocates anything, so
+     * memory it touches comes from the placement's node. Call before start().
+     */
+    void setPlacement(CpuPlacement placement);
+
+    [[nodiscard]]
+    bool isRunning() const;
+    [[nodiscard]]
+    bool isInLoopThread() const;
+
+    bool add(int fd, uint32_t events, EventCallback callback);
+    bool modify(int fd, uint32_t events);
+    void remove(int fd);
+
+    /**
+     * @brief Queues a task for execution on the loop thread and wakes the loop up.
+     * @return false if the reactor is not running, the task is dropped in that case.
+     */
+    bool post(Task task);
+
+    /**
+     * @brief Runs @p task on the loop thread once @p delay has passed (up to one 10 ms tick later).
+     * Like add(), only from the loop thread or before start().
+     */
+    TimingWheel::TimerId runAfter(std::chrono::milliseconds delay, Task task);
+    /**
+     * @brief Pushes an armed timer to @p delay from now, cheap enough to call on every event.
+     * @return false if the timer has fired or was cancelled.
+     */
+    bool restartTimer(TimingWheel::TimerId id, std::chrono::milliseconds delay);
+    bool cancelTimer(TimingWheel::TimerId id);
+
+    size_t size() const noexcept;
+
+  private:
+    struct Entry
+    {
+      int fd;
+      EventCallback callback;
+    };
+
+    int m_epoll_fd{-1};
+    int m_wakeup_fd{-1};
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    CpuPlacement m_placement;
+
+    std::unordered_map<int, std::unique_ptr<Entry>> m_entries;
+    std::vector<std::unique_ptr<Entry>> m_retired;
+    TimingWheel m_timers;
+
+    std::mutex m_tasks_mutex;
+    std::vector<Task> m_tasks;
+
+    void loop();
+    void wakeup();
+    void run_tasks();
+  };
+
+}  // namespace utils
+
+#endif  // UFW_EPOLLREACTOR_HPP
@@ -0,0 +1,138 @@
+/**
+ * @file filecache.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "filecache.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils
+{
+  namespace
+  {
+    int64_t mtime_ns(const struct stat& st)
+    {
+      return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    bool same_file(const struct stat& st, const OpenFile& file)
+    {
+      return (st.st_ino == file.inode) && (st.st_dev == file.device) &&
+             (static_cast<size_t>(st.st_size) == file.size) && (mtime_ns(st) == file.modified_ns);
+    }
+  }  // namespace
+
+  OpenFile::~OpenFile()
+  {
+    if (fd >= 0) close(fd);
+  }
+
+  std::shared_ptr<const OpenFile> OpenFile::open(const std::string& path)
+  {
+    auto file = std::make_shared<OpenFile>();
+    file->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(file->fd, &st) < 0) return nullptr;
+      if (!S_ISREG(st.st_mode)) {
+        errno = EISDIR;
+        return nullptr;
+    }
+    file->size = static_cast<size_t>(st.st_size);
+    file->inode = st.st_ino;
+    file->device = st.st_dev;
+    file->modified_ns = mtime_ns(st);
+    return file;
+  }
+
+  FileCache::FileCache(): FileCache(Options{}) {}
+
+  FileCache::FileCache(Options options): m_options(options)
+  {
+    if (m_options.max_files == 0) m_options.max_files = 1;
+  }
+
+  std::shared_ptr<const OpenFile> FileCache::open(const std::string& path)
+  {
+    std::shared_ptr<const OpenFile> cached;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_entries.find(path);
+        if (it != m_entries.end()) {
+          m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+          auto now = Clock::now();
+            if (now - it->second.checked < m_options.revalidate) {
+              ++m_stats.hits;
+              return it->second.file;
+          }
+          // Other threads go on with the cached file meanwhile instead of checking it too
+          it->second.checked = now;
+          cached = it->second.file;
+      }
+    }
+    // Syscalls without the lock: one slow disk doesn't stall the lookups of every other file
+    struct stat st;
+      if (cached && (stat(path.c_str(), &st) == 0) && same_file(st, *cached)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.hits;
+        return cached;
+    }
+    auto file = OpenFile::open(path);
+    int error = errno;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.misses;
+    auto it = m_entries.find(path);
+      if (!file) {
+          if (it != m_entries.end()) {
+            m_lru.erase(it->second.lru);
+            m_entries.erase(it);
+        }
+        errno = error;
+        return nullptr;
+    }
+      if (it != m_entries.end()) {
+        it->second.file = file;
+        it->second.checked = Clock::now();
+        return file;
+    }
+      while (m_entries.size() >= m_options.max_files) {
+        ++m_stats.evictions;
+        m_entries.erase(m_lru.back());
+        m_lru.pop_back();
+      }
+    m_lru.push_front(path);
+    m_entries.emplace(path, Entry{file, Clock::now(), m_lru.begin()});
+    return file;
+  }
+
+  void FileCache::invalidate(const std::string& path)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(path);
+    if (it == m_entries.end()) return;
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+  }
+
+  void FileCache::clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+  }
+
+  FileCache::Stats FileCache::stats() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.files = m_entries.size();
+    return stats;
+  }
+
+}  // namespace utils
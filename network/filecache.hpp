@@ -0,0 +1,113 @@
+/**
+ * @file filecache.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Open descriptors of files served often, for file responses sent with sendfile()/splice()
+ * @brief Saves the open()/fstat()/close() of every request, notices files replaced on disk
+ * @version 0.1
+ * @date 2025-03-08
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_FILECACHE_HPP
+#define UFW_FILECACHE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace utils
+{
+
+  /**
+   * @brief A file opened read-only, closed when the last reference is gone. Pass the reference
+   * as the owner of Response::appendFile() to keep the descriptor open until it is sent.
+   */
+  struct OpenFile
+  {
+    int fd{-1};
+    size_t size{0};
+    ino_t inode{0};
+    dev_t device{0};
+    int64_t modified_ns{0};
+
+    OpenFile() = default;
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+    ~OpenFile();
+
+    /**
+     * @brief Opens and fstat()s @p path.
+     * @return nullptr with errno set if it can't be opened or is not a regular file.
+     */
+    static std::shared_ptr<const OpenFile> open(const std::string& path);
+  };
+
+  /**
+   * @class FileCache
+   * @brief Keeps up to max_files files open by path, least recently used ones are let go first.
+   *
+   * A file found in the cache is stat()ed by path again once revalidate has passed since the last
+   * check, a different inode, size or modification time opens it anew. Responses still holding the
+   * old descriptor send the old contents. A file that isn't there or can't be opened is not cached.
+   * Thread-safe.
+   */
+  class FileCache
+  {
+  public:
+    struct Options
+    {
+      size_t max_files{1024};
+      std::chrono::milliseconds revalidate{1000};  // 0 checks on every lookup
+    };
+
+    struct Stats
+    {
+      uint64_t hits{0};
+      uint64_t misses{0};  // opened, not found or replaced on disk
+      uint64_t evictions{0};
+      uint64_t files{0};
+    };
+
+    FileCache();
+    explicit FileCache(Options options);
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    /**
+     * @return nullptr with errno set if @p path can't be opened.
+     */
+    std::shared_ptr<const OpenFile> open(const std::string& path);
+
+    void invalidate(const std::string& path);
+    void clear();
+
+    [[nodiscard]]
+    Stats stats() const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+      std::shared_ptr<const OpenFile> file;
+      Clock::time_point checked;
+      std::list<std::string>::iterator lru;
+    };
+
+    Options m_options;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru;  // most recently used first
+    Stats m_stats;
+  };
+
+}  // namespace utils
+
+#endif  // UFW_FILECACHE_HPP
@@ -0,0 +1,196 @@
+/**
+ * @file framer.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "framer.hpp"
+
+#include "../support/logger.hpp"
+
+#include <cassert>
+
+namespace utils
+{
+  IFramer::Status RawFramer::next(std::string_view data, Frame& frame) const
+  {
+    if (data.empty()) return Status::Incomplete;
+    frame.payload = data;
+    frame.consumed = data.size();
+    return Status::Complete;
+  }
+
+  void RawFramer::encode(std::string_view payload, std::string& out) const
+  {
+    out.append(payload);
+  }
+
+  bool RawFramer::encodeEnvelope(size_t, std::string&, std::string&) const
+  {
+    return true;
+  }
+
+  LengthPrefixFramer::LengthPrefixFramer(size_t header_size, size_t max_frame):
+      m_header_size(header_size), m_max_frame(max_frame)
+  {
+    bool valid = (header_size == 1) || (header_size == 2) || (header_size == 4) || (header_size == 8);
+    assert(valid && "LengthPrefixFramer header size must be 1, 2, 4 or 8");
+      if (!valid) {
+        // Any width picked here would talk past the peer, every frame fails instead
+        UFW_LOG_ERROR("LengthPrefixFramer: header size ", header_size, " is not 1, 2, 4 or 8");
+        m_header_size = 0;
+    }
+  }
+
+  bool LengthPrefixFramer::fits(size_t size) const
+  {
+    if (m_header_size == 0) return false;
+    if (size > m_max_frame) return false;
+    return (m_header_size == 8) || (size < (uint64_t{1} << (8 * m_header_size)));
+  }
+
+  IFramer::Status LengthPrefixFramer::next(std::string_view data, Frame& frame) const
+  {
+    if (m_header_size == 0) return Status::Error;
+    if (data.size() < m_header_size) return Status::Incomplete;
+    uint64_t length = 0;
+    for (size_t i = 0; i < m_header_size; ++i) length = (length << 8) | static_cast<uint8_t>(data[i]);
+    if (length > m_max_frame) return Status::Error;
+    if (data.size() - m_header_size < length) return Status::Incomplete;
+    frame.payload = data.substr(m_header_size, length);
+    frame.consumed = m_header_size + length;
+    return Status::Complete;
+  }
+
+  void LengthPrefixFramer::encode(std::string_view payload, std::string& out) const
+  {
+    std::string trailer;
+      if (!encodeEnvelope(payload.size(), out, trailer)) {
+        // A truncated length would desynchronise the peer's stream, the payload isn't sent at all
+        UFW_LOG_ERROR("LengthPrefixFramer: payload of ", payload.size(), " bytes doesn't fit the frame, dropped");
+        return;
+    }
+    out.append(payload);
+  }
+
+  bool LengthPrefixFramer::encodeEnvelope(size_t size, std::string& header, std::string&) const
+  {
+    if (!fits(size)) return false;
+    uint64_t length = size;
+      for (size_t i = m_header_size; i > 0; --i) {
+        header.push_back(static_cast<char>((length >> ((i - 1) * 8)) & 0xFF));
+      }
+    return true;
+  }
+
+  size_t LengthPrefixFramer::maxFrameSize() const
+  {
+    return m_header_size + m_max_frame;
+  }
+
+  VarintFramer::VarintFramer(size_t max_frame): m_max_frame(max_frame) {}
+
+  IFramer::Status VarintFramer::next(std::string_view data, Frame& frame) const
+  {
+    uint64_t length = 0;
+    size_t header = 0;
+      for (;;) {
+        if (header == data.size()) return Status::Incomplete;
+        // Ten bytes carry 64 bits, a longer length is garbage
+        if (header == 10) return Status::Error;
+        auto byte = static_cast<uint8_t>(data[header]);
+        length |= static_cast<uint64_t>(byte & 0x7F) << (7 * header);
+        ++header;
+        if ((byte & 0x80) == 0) break;
+        if (length > m_max_frame) return Status::Error;
+      }
+    if (length > m_max_frame) return Status::Error;
+    if (data.size() - header < length) return Status::Incomplete;
+    frame.payload = data.substr(header, length);
+    frame.consumed = header + length;
+    return Status::Complete;
+  }
+
+  void VarintFramer::encode(std::string_view payload, std::string& out) const
+  {
+    std::string trailer;
+    encodeEnvelope(payload.size(), out, trailer);
+    out.append(payload);
+  }
+
+  bool VarintFramer::encodeEnvelope(size_t size, std::string& header, std::string&) const
+  {
+    uint64_t length = size;
+      while (length >= 0x80) {
+        header.push_back(static_cast<char>((length & 0x7F) | 0x80));
+        length >>= 7;
+      }
+    header.push_back(static_cast<char>(length));
+    return true;
+  }
+
+  size_t VarintFramer::maxFrameSize() const
+  {
+    return 10 + m_max_frame;
+  }
+
+  DelimiterFramer::DelimiterFramer(std::string delimiter, size_t max_frame):
+      m_delimiter(delimiter.empty() ? std::string("\n") : std::move(delimiter)), m_max_frame(max_frame)
+  {}
+
+  IFramer::Status DelimiterFramer::next(std::string_view data, Frame& frame) const
+  {
+    auto pos = data.find(m_delimiter);
+      if (pos == std::string_view::npos) {
+        // Without a delimiter in sight the frame can't get shorter than what we already hold
+        return data.size() > m_max_frame + m_delimiter.size() ? Status::Error : Status::Incomplete;
+    }
+    if (pos > m_max_frame) return Status::Error;
+    frame.payload = data.substr(0, pos);
+    frame.consumed = pos + m_delimiter.size();
+    return Status::Complete;
+  }
+
+  void DelimiterFramer::encode(std::string_view payload, std::string& out) const
+  {
+    out.append(payload);
+    out.append(m_delimiter);
+  }
+
+  bool DelimiterFramer::encodeEnvelope(size_t, std::string&, std::string& trailer) const
+  {
+    trailer.append(m_delimiter);
+    return true;
+  }
+
+  size_t DelimiterFramer::maxFrameSize() const
+  {
+    return m_max_frame + m_delimiter.size();
+  }
+
+  FixedSizeFramer::FixedSizeFramer(size_t size): m_size(size > 0 ? size : 1) {}
+
+  IFramer::Status FixedSizeFramer::next(std::string_view data, Frame& frame) const
+  {
+    if (data.size() < m_size) return Status::Incomplete;
+    frame.payload = data.substr(0, m_size);
+    frame.consumed = m_size;
+    return Status::Complete;
+  }
+
+  void FixedSizeFramer::encode(std::string_view payload, std::string& out) const
+  {
+    out.append(payload);
+  }
+
+  bool FixedSizeFramer::encodeEnvelope(size_t, std::string&, std::string&) const
+  {
+    return true;
+  }
+
+  size_t FixedSizeFramer::maxFrameSize() const
+  {
+    return m_size;
+  }
+
+}  // namespace utils
@@ -0,0 +1,175 @@
+/**
+ * @file framer.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Message framing for stream sockets
+ * @brief Splits a byte stream into complete frames in place and encodes responses with the same framing
+ * @version 0.1
+ * @date 2024-11-16
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_FRAMER_HPP
+#define UFW_FRAMER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace utils
+{
+
+  /**
+   * @class IFramer
+   * @brief Stateless frame parser/encoder, one instance may be shared by all connections.
+   */
+  class IFramer
+  {
+  public:
+    enum class Status
+    {
+      Complete,
+      Incomplete,
+      Error
+    };
+
+    struct Frame
+    {
+      std::string_view payload;  // points into the parsed data, valid while the data is
+      size_t consumed{0};        // bytes of the stream taken by this frame including its header/delimiter
+    };
+
+    virtual ~IFramer() = default;
+
+    /**
+     * @brief Looks for a complete frame at the beginning of @p data.
+     * @return Complete with @p frame filled, Incomplete if more bytes are needed,
+     *         Error if the stream violates the framing (the connection should be dropped).
+     */
+    virtual Status next(std::string_view data, Frame& frame) const = 0;
+
+    /**
+     * @brief Appends @p payload framed for the wire to @p out.
+     */
+    virtual void encode(std::string_view payload, std::string& out) const = 0;
+
+    /**
+     * @brief Appends the bytes going before and after a payload of @p size bytes, so a response made
+     * of several buffers can be framed without joining them.
+     * @return false if the framing can't be split like that, the caller then joins the payload and uses encode().
+     */
+    virtual bool encodeEnvelope(size_t /*size*/, std::string& /*header*/, std::string& /*trailer*/) const
+    {
+      return false;
+    }
+
+    /**
+     * @brief Longest frame next() accepts, header or delimiter included. 0 if there is no limit.
+     */
+    virtual size_t maxFrameSize() const
+    {
+      return 0;
+    }
+  };
+
+  /**
+   * @brief No framing: whatever one read returned is one frame. Matches the historical TcpServer behaviour.
+   */
+  class RawFramer: public IFramer
+  {
+  public:
+    Status next(std::string_view data, Frame& frame) const override;
+    void encode(std::string_view payload, std::string& out) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+  };
+
+  /**
+   * @brief Frames preceded by a big-endian unsigned length of 1, 2, 4 or 8 bytes.
+   */
+  class LengthPrefixFramer: public IFramer
+  {
+  public:
+    /**
+     * @param header_size Width of the length field: 1, 2, 4 or 8. Any other value is a programming
+     * error: it asserts, and in release builds is logged and leaves a framer failing every frame.
+     * @param max_frame Frames announcing a longer payload are a protocol error.
+     */
+    explicit LengthPrefixFramer(size_t header_size = 4, size_t max_frame = 16 * 1024 * 1024);
+
+    Status next(std::string_view data, Frame& frame) const override;
+    /**
+     * @brief A payload longer than max_frame or than the length field can carry is logged and not
+     * written, encodeEnvelope() returns false for it.
+     */
+    void encode(std::string_view payload, std::string& out) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+    size_t maxFrameSize() const override;
+
+  private:
+    size_t m_header_size;
+    size_t m_max_frame;
+
+    bool fits(size_t size) const;
+  };
+
+  /**
+   * @brief Frames preceded by their length as an unsigned LEB128 varint (protobuf style): 7 bits per
+   * byte, least significant first, the high bit set on every byte but the last. Small frames pay a
+   * single byte of header.
+   */
+  class VarintFramer: public IFramer
+  {
+  public:
+    /**
+     * @param max_frame Frames announcing a longer payload are a protocol error.
+     */
+    explicit VarintFramer(size_t max_frame = 16 * 1024 * 1024);
+
+    Status next(std::string_view data, Frame& frame) const override;
+    void encode(std::string_view payload, std::string& out) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+    size_t maxFrameSize() const override;
+
+  private:
+    size_t m_max_frame;
+  };
+
+  /**
+   * @brief Frames terminated by a delimiter (e.g. "\n" or "\r\n"), the delimiter is not part of the payload.
+   */
+  class DelimiterFramer: public IFramer
+  {
+  public:
+    explicit DelimiterFramer(std::string delimiter = "\n", size_t max_frame = 64 * 1024);
+
+    Status next(std::string_view data, Frame& frame) const override;
+    void encode(std::string_view payload, std::string& out) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+    size_t maxFrameSize() const override;
+
+  private:
+    std::string m_delimiter;
+    size_t m_max_frame;
+  };
+
+  /**
+   * @brief Every frame is exactly @p size bytes. Responses are written as they are.
+   */
+  class FixedSizeFramer: public IFramer
+  {
+  public:
+    explicit FixedSizeFramer(size_t size);
+
+    Status next(std::string_view data, Frame& frame) const override;
+    void encode(std::string_view payload, std::string& out) const override;
+    bool encodeEnvelope(size_t size, std::string& header, std::string& trailer) const override;
+    size_t maxFrameSize() const override;
+
+  private:
+    size_t m_size;
+  };
+
+}  // namespace utils
+
+#endif  // UFW_FRAMER_HPP
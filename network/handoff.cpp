@@ -0,0 +1,248 @@
+/**
+ * @file handoff.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "handoff.hpp"
+
+#include "../support/logger.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace utils
+{
+  namespace
+  {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr char kMagic[4] = {'U', 'F', 'W', 'H'};
+    constexpr char kReady = 'R';
+    constexpr auto kConnectRetry = std::chrono::milliseconds(20);
+
+    // Sent along with the descriptors
+    struct Header
+    {
+      char magic[4];
+      uint32_t count;
+    };
+
+    // Waits until @p fd is ready for @p events, false once @p deadline has passed
+    bool wait_until(int fd, short events, Clock::time_point deadline)
+    {
+        while (true) {
+          auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+          if (left < 0) return false;
+          pollfd entry{fd, events, 0};
+          int ready = poll(&entry, 1, static_cast<int>(left));
+          if (ready > 0) return true;
+          if ((ready < 0) && (errno != EINTR)) return false;
+        }
+    }
+
+    bool same_user(int fd)
+    {
+      ucred peer{};
+      socklen_t length = sizeof(peer);
+      if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) < 0) return false;
+      return (peer.uid == geteuid()) || (geteuid() == 0);
+    }
+
+    void close_all(const std::vector<int>& fds)
+    {
+      for (int fd: fds) close(fd);
+    }
+  }  // namespace
+
+  bool ListenerHandoff::offer(const SocketAddress& control, const std::vector<int>& listeners,
+                              std::chrono::milliseconds timeout)
+  {
+      if (!control.isUnix() || listeners.empty() || (listeners.size() > kMaxListeners)) {
+        UFW_LOG_ERROR("Handoff needs a unix control address and 1 to ", kMaxListeners, " listeners");
+        return false;
+    }
+    auto deadline = Clock::now() + timeout;
+    int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (server < 0) {
+        UFW_LOG_ERROR("Failed to create handoff socket. Errno: ", Errno{errno});
+        return false;
+    }
+    // A control file left by an earlier handoff is ours to replace
+    std::string path = control.path();
+    struct stat info{};
+    if (!path.empty() && (lstat(path.c_str(), &info) == 0) && S_ISSOCK(info.st_mode)) unlink(path.c_str());
+      if ((bind(server, control.data(), control.size()) < 0) || (listen(server, 1) < 0)) {
+        UFW_LOG_ERROR("Failed to listen for a successor on ", control.toString(), ". Errno: ", Errno{errno});
+        close(server);
+        return false;
+    }
+    UFW_LOG_INFO("Offering ", listeners.size(), " listeners on ", control.toString());
+
+    bool handed_over = false;
+      while (!handed_over && wait_until(server, POLLIN, deadline)) {
+        int peer = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+        if (peer < 0) continue;
+          if (!same_user(peer)) {
+            UFW_LOG_WARN("Handoff peer of another user refused");
+            close(peer);
+            continue;
+        }
+
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.count = static_cast<uint32_t>(listeners.size());
+        iovec iov{&header, sizeof(header)};
+        std::vector<char> control_data(CMSG_SPACE(sizeof(int) * listeners.size()), 0);
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control_data.data();
+        message.msg_controllen = control_data.size();
+        auto* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * listeners.size());
+        std::memcpy(CMSG_DATA(cmsg), listeners.data(), sizeof(int) * listeners.size());
+
+        char reply = 0;
+          if (sendmsg(peer, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(header))) {
+            UFW_LOG_WARN("Failed to pass the listeners. Errno: ", Errno{errno});
+          } else if (wait_until(peer, POLLIN, deadline) && (recv(peer, &reply, 1, 0) == 1) && (reply == kReady)) {
+            handed_over = true;
+          } else {
+            // The successor failed before it was ready, the next one may still come in time
+            UFW_LOG_WARN("Successor went away before it was ready");
+          }
+        close(peer);
+      }
+    close(server);
+    if (!path.empty()) unlink(path.c_str());
+      if (handed_over) {
+        UFW_LOG_INFO("Listeners handed over");
+      } else {
+        UFW_LOG_WARN("No successor took the listeners, still serving them");
+      }
+    return handed_over;
+  }
+
+  std::optional<ListenerHandoff> ListenerHandoff::receive(const SocketAddress& control, std::chrono::milliseconds timeout)
+  {
+    if (!control.isUnix()) return std::nullopt;
+    auto deadline = Clock::now() + timeout;
+    int channel = -1;
+    // The predecessor may not be listening yet when this process comes up
+      while (channel < 0) {
+        channel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (channel < 0) return std::nullopt;
+        if (connect(channel, control.data(), control.size()) == 0) break;
+        int error = errno;
+        close(channel);
+        channel = -1;
+          if (((error != ENOENT) && (error != ECONNREFUSED)) || (Clock::now() + kConnectRetry > deadline)) {
+            UFW_LOG_ERROR("Failed to connect to the predecessor on ", control.toString(), ". Errno: ", Errno{error});
+            return std::nullopt;
+        }
+        std::this_thread::sleep_for(kConnectRetry);
+      }
+
+    Header header{};
+    iovec iov{&header, sizeof(header)};
+    std::vector<char> control_data(CMSG_SPACE(sizeof(int) * kMaxListeners), 0);
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control_data.data();
+    message.msg_controllen = control_data.size();
+    ssize_t received = -1;
+    if (wait_until(channel, POLLIN, deadline)) received = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+
+    std::vector<int> listeners;
+      for (auto* cmsg = CMSG_FIRSTHDR(&message); (received > 0) && (cmsg != nullptr); cmsg = CMSG_NXTHDR(&message, cmsg)) {
+          if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t first = listeners.size();
+            listeners.resize(first + count);
+            std::memcpy(listeners.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+        }
+      }
+    bool valid = (received == static_cast<ssize_t>(sizeof(header))) && !(message.msg_flags & MSG_CTRUNC) &&
+                 (std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0) && (header.count == listeners.size());
+      if (!valid) {
+        UFW_LOG_ERROR("No listeners received from ", control.toString());
+        close_all(listeners);
+        close(channel);
+        return std::nullopt;
+    }
+    UFW_LOG_INFO("Received ", listeners.size(), " listeners from ", control.toString());
+    return ListenerHandoff(channel, std::move(listeners));
+  }
+
+  std::optional<SocketAddress> ListenerHandoff::fromEnvironment()
+  {
+    const char* value = std::getenv(kEnvironment);
+    if ((value == nullptr) || (*value == '\0')) return std::nullopt;
+    return SocketAddress::parse(value);
+  }
+
+  ListenerHandoff::ListenerHandoff(int channel, std::vector<int> listeners):
+      m_channel(channel), m_listeners(std::move(listeners))
+  {}
+
+  ListenerHandoff::ListenerHandoff(ListenerHandoff&& other) noexcept:
+      m_channel(other.m_channel), m_listeners(std::move(other.m_listeners))
+  {
+    other.m_channel = -1;
+    other.m_listeners.clear();
+  }
+
+  ListenerHandoff& ListenerHandoff::operator=(ListenerHandoff&& other) noexcept
+  {
+      if (this != &other) {
+        reset();
+        m_channel = other.m_channel;
+        m_listeners = std::move(other.m_listeners);
+        other.m_channel = -1;
+        other.m_listeners.clear();
+    }
+    return *this;
+  }
+
+  ListenerHandoff::~ListenerHandoff()
+  {
+    reset();
+  }
+
+  std::vector<int> ListenerHandoff::takeListeners()
+  {
+    auto listeners = std::move(m_listeners);
+    m_listeners.clear();
+    return listeners;
+  }
+
+  bool ListenerHandoff::ready()
+  {
+    if (m_channel < 0) return false;
+    bool sent = send(m_channel, &kReady, 1, MSG_NOSIGNAL) == 1;
+    close(m_channel);
+    m_channel = -1;
+    return sent;
+  }
+
+  void ListenerHandoff::reset()
+  {
+    close_all(m_listeners);
+    m_listeners.clear();
+      if (m_channel >= 0) {
+        close(m_channel);
+        m_channel = -1;
+    }
+  }
+
+}  // namespace utils
@@ -0,0 +1,103 @@
+/**
+ * @file handoff.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Passes listening sockets from a running process to its successor over a unix socket
+ * @brief The basis of restarts without refused connections: the kernel keeps queueing connections
+ *        on the sockets while they change hands
+ * @version 0.1
+ * @date 2025-01-25
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_HANDOFF_HPP
+#define UFW_HANDOFF_HPP
+
+#include "socketaddress.hpp"
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @class ListenerHandoff
+   * @brief Successor side of a listener handoff, offer() is the predecessor side.
+   *
+   * The old process offers its listeners on a control socket, the new one connects, gets copies of
+   * them (SCM_RIGHTS), starts accepting and reports ready(). Only then offer() returns true and the
+   * old process drains:
+   *
+   * @code
+   * // old process, e.g. on SIGHUP
+   * ufw::Executable next(binary);
+   * next.addEnvironment(std::string(utils::ListenerHandoff::kEnvironment) + "=unix:@app.handoff");
+   * next.start();
+   * if (utils::ListenerHandoff::offer(*control, server.listenerFds(), 30s)) server.drain(60s);
+   *
+   * // new process
+   * if (auto control = utils::ListenerHandoff::fromEnvironment()) {
+   *   auto handoff = utils::ListenerHandoff::receive(*control, 10s);
+   *   if (handoff && server.start(handoff->takeListeners(), mode)) handoff->ready();
+   * }
+   * @endcode
+   *
+   * Until ready() both processes accept, a successor that fails or dies before it leaves the old
+   * process serving as if nothing happened. The control socket takes peers of the same user only.
+   */
+  class ListenerHandoff
+  {
+  public:
+    /**
+     * @brief Environment variable telling a successor where to get its listeners (parse() syntax).
+     */
+    static constexpr const char* kEnvironment = "UFW_HANDOFF";
+    static constexpr size_t kMaxListeners = 64;
+
+    /**
+     * @brief Waits on @p control for a successor, passes it @p listeners and waits for its ready().
+     * The listeners stay open here. @p timeout covers the whole exchange.
+     * @return false if nobody came in time, or the successor went away before it was ready.
+     */
+    static bool offer(const SocketAddress& control, const std::vector<int>& listeners,
+                      std::chrono::milliseconds timeout);
+    /**
+     * @brief Connects to the predecessor on @p control, retrying until it offers or @p timeout passes.
+     */
+    static std::optional<ListenerHandoff> receive(const SocketAddress& control, std::chrono::milliseconds timeout);
+    /**
+     * @brief Control address from kEnvironment, std::nullopt if it isn't set or doesn't parse.
+     */
+    static std::optional<SocketAddress> fromEnvironment();
+
+    ListenerHandoff(ListenerHandoff&& other) noexcept;
+    ListenerHandoff& operator=(ListenerHandoff&& other) noexcept;
+    ListenerHandoff(const ListenerHandoff&) = delete;
+    ListenerHandoff& operator=(const ListenerHandoff&) = delete;
+    /**
+     * @brief Closes the listeners not taken. Without ready() the predecessor keeps serving.
+     */
+    ~ListenerHandoff();
+
+    /**
+     * @brief The received listeners, the caller owns them from now on.
+     */
+    std::vector<int> takeListeners();
+    /**
+     * @brief Tells the predecessor this process accepts on the listeners, it starts draining then.
+     */
+    bool ready();
+
+  private:
+    int m_channel{-1};
+    std::vector<int> m_listeners;
+
+    ListenerHandoff(int channel, std::vector<int> listeners);
+    void reset();
+  };
+
+}  // namespace utils
+
+#endif  // UFW_HANDOFF_HPP
@@ -2,6 +2,9 @@
 #ifndef UFW_IHANDLER_HPP
 #define UFW_IHANDLER_HPP
 
+#include "response.hpp"
+
+#include <functional>
 #include <string>
 
 class IHandler
@@ -11,4 +14,20 @@ public:
   virtual std::string handle(int socket, const std::string& input) = 0;
 };
 
-#endif  // UFW_IHANDLER_HPP
\ No newline at end of file
+/**
+ * @brief Handler that answers when its backend does instead of blocking a server thread meanwhile.
+ */
+class IAsyncHandler
+{
+public:
+  using Completion = std::function<void(utils::Response)>;
+
+  virtual ~IAsyncHandler() = default;
+  /**
+   * @brief Starts handling @p input. @p done may be called later, once, from any thread.
+   * The request slice may be kept until then without copying.
+   */
+  virtual void handleAsync(int socket, const utils::BufferSlice& input, Completion done) = 0;
+};
+
+#endif  // UFW_IHANDLER_HPP
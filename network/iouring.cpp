@@ -0,0 +1,434 @@
+/**
+ * @file iouring.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "iouring.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace utils
+{
+#ifdef UFW_HAS_IO_URING
+  namespace
+  {
+    int sys_io_uring_setup(unsigned entries, io_uring_params* params)
+    {
+      return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+      return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+    {
+      return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    template<typename T>
+    T* at_offset(void* base, uint32_t offset)
+    {
+      return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+  }  // namespace
+
+  IoUring::~IoUring()
+  {
+    destroy();
+  }
+
+  bool IoUring::isSupported()
+  {
+    static const bool supported = []() {
+      io_uring_params params{};
+      int fd = sys_io_uring_setup(2, &params);
+      if (fd < 0) return false;
+      close(fd);
+      return true;
+    }();
+    return supported;
+  }
+
+  bool IoUring::init(unsigned entries)
+  {
+    io_uring_params params{};
+    m_ring_fd = sys_io_uring_setup(entries, &params);
+    if (m_ring_fd < 0) return false;
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (m_cq_ring_size > m_sq_ring_size) m_sq_ring_size = m_cq_ring_size;
+        m_cq_ring_size = m_sq_ring_size;
+    }
+
+    m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                     IORING_OFF_SQ_RING);
+      if (m_sq_ring == MAP_FAILED) {
+        m_sq_ring = nullptr;
+        destroy();
+        return false;
+    }
+      if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cq_ring = m_sq_ring;
+      } else {
+        m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                         IORING_OFF_CQ_RING);
+          if (m_cq_ring == MAP_FAILED) {
+            m_cq_ring = nullptr;
+            destroy();
+            return false;
+        }
+      }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+      if (m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        destroy();
+        return false;
+    }
+
+    m_sq_head = at_offset<unsigned>(m_sq_ring, params.sq_off.head);
+    m_sq_tail = at_offset<unsigned>(m_sq_ring, params.sq_off.tail);
+    m_sq_array = at_offset<unsigned>(m_sq_ring, params.sq_off.array);
+    m_sq_mask = *at_offset<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sqe_tail = m_sqe_flushed = *m_sq_tail;
+
+    m_cq_head = at_offset<unsigned>(m_cq_ring, params.cq_off.head);
+    m_cq_tail = at_offset<unsigned>(m_cq_ring, params.cq_off.tail);
+    m_cq_mask = *at_offset<unsigned>(m_cq_ring, params.cq_off.ring_mask);
+    m_cqes = at_offset<void>(m_cq_ring, params.cq_off.cqes);
+    return true;
+  }
+
+  void IoUring::destroy()
+  {
+      if (m_buf_ring != nullptr) {
+        io_uring_buf_reg reg{};
+        reg.bgid = m_buf_group;
+        if (m_ring_fd >= 0) sys_io_uring_register(m_ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap(m_buf_ring, m_buf_ring_size);
+        m_buf_ring = nullptr;
+    }
+      if (m_buf_base != nullptr) {
+        munmap(m_buf_base, m_buf_size * m_buf_count);
+        m_buf_base = nullptr;
+    }
+      if (m_sqes != nullptr) {
+        munmap(m_sqes, m_sqes_size);
+        m_sqes = nullptr;
+    }
+    if ((m_cq_ring != nullptr) && (m_cq_ring != m_sq_ring)) munmap(m_cq_ring, m_cq_ring_size);
+    m_cq_ring = nullptr;
+      if (m_sq_ring != nullptr) {
+        munmap(m_sq_ring, m_sq_ring_size);
+        m_sq_ring = nullptr;
+    }
+      if (m_ring_fd >= 0) {
+        close(m_ring_fd);
+        m_ring_fd = -1;
+    }
+  }
+
+  bool IoUring::setupBufferRing(uint16_t group, unsigned count, size_t size)
+  {
+    if ((count == 0) || ((count & (count - 1)) != 0) || (count > 32768)) return false;
+
+    m_buf_ring_size = count * sizeof(io_uring_buf);
+    m_buf_ring = mmap(nullptr, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (m_buf_ring == MAP_FAILED) {
+        m_buf_ring = nullptr;
+        return false;
+    }
+    m_buf_base = static_cast<char*>(
+            mmap(nullptr, count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (m_buf_base == MAP_FAILED) {
+        m_buf_base = nullptr;
+        munmap(m_buf_ring, m_buf_ring_size);
+        m_buf_ring = nullptr;
+        return false;
+    }
+    m_buf_size = size;
+    m_buf_count = count;
+    m_buf_group = group;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_buf_ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+      if (sys_io_uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(m_buf_base, count * size);
+        munmap(m_buf_ring, m_buf_ring_size);
+        m_buf_base = nullptr;
+        m_buf_ring = nullptr;
+        return false;
+    }
+
+    m_buf_tail = 0;
+    for (unsigned bid = 0; bid < count; ++bid) recycleBuffer(static_cast<uint16_t>(bid));
+    return true;
+  }
+
+  char* IoUring::buffer(uint16_t bid) const
+  {
+    return m_buf_base + static_cast<size_t>(bid) * m_buf_size;
+  }
+
+  void IoUring::recycleBuffer(uint16_t bid)
+  {
+    auto* ring = static_cast<io_uring_buf_ring*>(m_buf_ring);
+    // Not ring->bufs: __DECLARE_FLEX_ARRAY puts it at offset 8 in C++ because of its empty struct member
+    auto& buf = static_cast<io_uring_buf*>(m_buf_ring)[m_buf_tail & (m_buf_count - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf.len = static_cast<uint32_t>(m_buf_size);
+    buf.bid = bid;
+    ++m_buf_tail;
+    __atomic_store_n(&ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+  }
+
+  void* IoUring::next_sqe()
+  {
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+      if (m_sqe_tail - head >= m_sq_entries) {
+        // Queue is full: hand what we have to the kernel and try once more
+        submitAndWait(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries) return nullptr;
+    }
+    unsigned index = m_sqe_tail & m_sq_mask;
+    auto* sqe = static_cast<io_uring_sqe*>(m_sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    ++m_sqe_tail;
+    return sqe;
+  }
+
+  bool IoUring::prepAccept(int fd, uint64_t user_data, bool multishot)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (multishot) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepRecv(int fd, uint16_t group, uint64_t user_data)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepSend(int fd, const void* data, size_t size, uint64_t user_data, bool link)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    if (link) sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepSendmsg(int fd, const msghdr* msg, uint64_t user_data, bool link)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    if (link) sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepSplice(int fd_in, int64_t offset, int fd_out, size_t size, uint64_t user_data, bool link)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = fd_out;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->splice_fd_in = fd_in;
+    sqe->splice_off_in = static_cast<uint64_t>(offset);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->splice_flags = SPLICE_F_MOVE;
+    if (link) sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepRead(int fd, void* data, size_t size, uint64_t user_data)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->off = static_cast<uint64_t>(-1);  // current file position, required for eventfd/pipes
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepTimeout(int timeout_ms, uint64_t user_data)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    m_timeout.tv_sec = timeout_ms / 1000;
+    m_timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_timeout);
+    sqe->len = 1;
+    sqe->off = 0;  // no completion count, a pure timer
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  bool IoUring::prepCancel(uint64_t target, uint64_t user_data)
+  {
+    auto* sqe = static_cast<io_uring_sqe*>(next_sqe());
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    return true;
+  }
+
+  int IoUring::submitAndWait(unsigned wait_nr)
+  {
+    unsigned to_submit = m_sqe_tail - m_sqe_flushed;
+      if (to_submit > 0) {
+        __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+        m_sqe_flushed = m_sqe_tail;
+    }
+    if ((to_submit == 0) && (wait_nr == 0)) return 0;
+    int ret = sys_io_uring_enter(m_ring_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    return ret < 0 ? -errno : ret;
+  }
+
+  bool IoUring::peek(Completion& completion)
+  {
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) return false;
+    const auto& cqe = static_cast<io_uring_cqe*>(m_cqes)[head & m_cq_mask];
+    completion.user_data = cqe.user_data;
+    completion.res = cqe.res;
+    completion.flags = cqe.flags;
+    return true;
+  }
+
+  void IoUring::advance()
+  {
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+  }
+
+#else  // UFW_HAS_IO_URING
+
+  IoUring::~IoUring() = default;
+
+  bool IoUring::isSupported()
+  {
+    return false;
+  }
+
+  bool IoUring::init(unsigned)
+  {
+    errno = ENOSYS;
+    return false;
+  }
+
+  void IoUring::destroy() {}
+
+  bool IoUring::setupBufferRing(uint16_t, unsigned, size_t)
+  {
+    return false;
+  }
+
+  char* IoUring::buffer(uint16_t) const
+  {
+    return nullptr;
+  }
+
+  void IoUring::recycleBuffer(uint16_t) {}
+
+  bool IoUring::prepAccept(int, uint64_t, bool)
+  {
+    return false;
+  }
+
+  bool IoUring::prepRecv(int, uint16_t, uint64_t)
+  {
+    return false;
+  }
+
+  bool IoUring::prepSend(int, const void*, size_t, uint64_t, bool)
+  {
+    return false;
+  }
+
+  bool IoUring::prepSendmsg(int, const msghdr*, uint64_t, bool)
+  {
+    return false;
+  }
+
+  bool IoUring::prepSplice(int, int64_t, int, size_t, uint64_t, bool)
+  {
+    return false;
+  }
+
+  bool IoUring::prepRead(int, void*, size_t, uint64_t)
+  {
+    return false;
+  }
+
+  bool IoUring::prepTimeout(int, uint64_t)
+  {
+    return false;
+  }
+
+  bool IoUring::prepCancel(uint64_t, uint64_t)
+  {
+    return false;
+  }
+
+  int IoUring::submitAndWait(unsigned)
+  {
+    return -ENOSYS;
+  }
+
+  bool IoUring::peek(Completion&)
+  {
+    return false;
+  }
+
+  void IoUring::advance() {}
+
+#endif  // UFW_HAS_IO_URING
+}  // namespace utils
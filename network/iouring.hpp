@@ -0,0 +1,172 @@
+/**
+ * @file iouring.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Minimal io_uring wrapper built directly on the kernel ABI (no liburing dependency)
+ * @brief Provides SQE preparation for accept/recv/send/sendmsg/splice/read/timeout, CQE draining and provided buffer rings
+ * @version 0.1
+ * @date 2024-11-09
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_IOURING_HPP
+#define UFW_IOURING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// Multishot accept and provided buffer rings appeared together (kernel 5.19)
+#if defined(IORING_ACCEPT_MULTISHOT)
+#define UFW_HAS_IO_URING
+#endif
+#endif
+
+namespace utils
+{
+
+  /**
+   * @class IoUring
+   * @brief Single-issuer io_uring instance.
+   *
+   * Not thread-safe: one thread prepares SQEs, submits and reaps completions.
+   * Every method fails gracefully (returns false / nullptr) when the library was built
+   * without io_uring headers or the kernel refuses to create a ring.
+   */
+  class IoUring
+  {
+  public:
+    /**
+     * @brief Completion as seen by the caller of forEachCompletion().
+     */
+    struct Completion
+    {
+      uint64_t user_data;
+      int32_t res;
+      uint32_t flags;
+    };
+
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * @brief Checks once per process whether the running kernel lets us create a ring.
+     */
+    static bool isSupported();
+
+    bool init(unsigned entries);
+    void destroy();
+
+    [[nodiscard]]
+    bool isValid() const
+    {
+      return m_ring_fd >= 0;
+    }
+
+    /**
+     * @brief Registers a provided buffer ring of @p count buffers of @p size bytes each.
+     * @param count Number of buffers, must be a power of two.
+     */
+    bool setupBufferRing(uint16_t group, unsigned count, size_t size);
+    char* buffer(uint16_t bid) const;
+    size_t bufferSize() const
+    {
+      return m_buf_size;
+    }
+    void recycleBuffer(uint16_t bid);
+
+    bool prepAccept(int fd, uint64_t user_data, bool multishot);
+    bool prepRecv(int fd, uint16_t group, uint64_t user_data);
+    bool prepSend(int fd, const void* data, size_t size, uint64_t user_data, bool link);
+    /**
+     * @brief Gathered send, @p msg and the buffers it points to must stay valid until the completion.
+     */
+    bool prepSendmsg(int fd, const msghdr* msg, uint64_t user_data, bool link);
+    /**
+     * @brief Moves @p size bytes from @p fd_in to @p fd_out without copying them to user space, one
+     * of the two must be a pipe. @p offset is the position in @p fd_in, -1 for a pipe. A short splice
+     * fails the link: the linked request completes with -ECANCELED.
+     */
+    bool prepSplice(int fd_in, int64_t offset, int fd_out, size_t size, uint64_t user_data, bool link);
+    bool prepRead(int fd, void* data, size_t size, uint64_t user_data);
+    /**
+     * @brief Completes with -ETIME after @p timeout_ms, lets submitAndWait() sleep until a deadline.
+     * The kernel copies the time when the SQE is submitted, so one timeout per submission.
+     */
+    bool prepTimeout(int timeout_ms, uint64_t user_data);
+    /**
+     * @brief Cancels the request submitted with user_data @p target. Completes with 0 if it was
+     * found, -ENOENT if it is gone already or -EALREADY if it is running and will complete soon.
+     */
+    bool prepCancel(uint64_t target, uint64_t user_data);
+
+    /**
+     * @brief Submits all prepared SQEs and waits for at least @p wait_nr completions in one syscall.
+     * @return number of submitted SQEs or -errno.
+     */
+    int submitAndWait(unsigned wait_nr);
+
+    template<typename F>
+    unsigned forEachCompletion(F&& func)
+    {
+      unsigned seen = 0;
+      Completion completion;
+        while (peek(completion)) {
+          func(completion);
+          advance();
+          ++seen;
+        }
+      return seen;
+    }
+
+  private:
+    int m_ring_fd{-1};
+
+    void* m_sq_ring{nullptr};
+    void* m_cq_ring{nullptr};
+    size_t m_sq_ring_size{0};
+    size_t m_cq_ring_size{0};
+    void* m_sqes{nullptr};
+    size_t m_sqes_size{0};
+
+    unsigned* m_sq_head{nullptr};
+    unsigned* m_sq_tail{nullptr};
+    unsigned* m_sq_array{nullptr};
+    unsigned m_sq_mask{0};
+    unsigned m_sq_entries{0};
+    unsigned m_sqe_tail{0};
+    unsigned m_sqe_flushed{0};
+
+    unsigned* m_cq_head{nullptr};
+    unsigned* m_cq_tail{nullptr};
+    unsigned m_cq_mask{0};
+    void* m_cqes{nullptr};
+
+    void* m_buf_ring{nullptr};
+    size_t m_buf_ring_size{0};
+    char* m_buf_base{nullptr};
+    size_t m_buf_size{0};
+    unsigned m_buf_count{0};
+    uint16_t m_buf_group{0};
+    uint16_t m_buf_tail{0};
+
+    struct KernelTimespec  // __kernel_timespec
+    {
+      int64_t tv_sec;
+      long long tv_nsec;
+    };
+    KernelTimespec m_timeout{};
+
+    void* next_sqe();
+    bool peek(Completion& completion);
+    void advance();
+  };
+
+}  // namespace utils
+
+#endif  // UFW_IOURING_HPP
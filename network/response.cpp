@@ -0,0 +1,391 @@
+/**
+ * @file response.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "response.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if __has_include(<linux/errqueue.h>)
+#include <linux/errqueue.h>
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define UFW_HAS_ZEROCOPY
+#endif
+#endif
+
+namespace
+{
+  // Owned pieces up to this size are merged with their neighbours instead of getting their own iovec
+  constexpr size_t kCoalesceLimit = 4 * 1024;
+}  // namespace
+
+namespace utils
+{
+  void Response::append(std::string_view data)
+  {
+    if (data.empty()) return;
+      if (m_segments.empty() || (m_segments.back().kind != Segment::Kind::Bytes)) {
+        m_segments.emplace_back();
+    }
+    m_segments.back().bytes.append(data);
+    m_size += data.size();
+  }
+
+  void Response::append(std::string&& data)
+  {
+    if (data.size() < kCoalesceLimit) return append(std::string_view(data));
+    m_size += data.size();
+    Segment segment;
+    segment.bytes = std::move(data);
+    m_segments.push_back(std::move(segment));
+  }
+
+  void Response::append(BufferSlice slice)
+  {
+    if (slice.empty()) return;
+    m_size += slice.size();
+    Segment segment;
+    segment.kind = Segment::Kind::View;
+    segment.data = slice.data();
+    segment.length = slice.size();
+    segment.slice = std::move(slice);
+    m_segments.push_back(std::move(segment));
+  }
+
+  void Response::append(std::shared_ptr<const void> owner, std::string_view data)
+  {
+    if (data.empty()) return;
+    m_size += data.size();
+    Segment segment;
+    segment.kind = Segment::Kind::View;
+    segment.data = data.data();
+    segment.length = data.size();
+    segment.owner = std::move(owner);
+    m_segments.push_back(std::move(segment));
+  }
+
+  void Response::appendFile(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner)
+  {
+    if (length == 0) return;
+    m_size += length;
+    Segment segment;
+    segment.kind = Segment::Kind::File;
+    segment.fd = fd;
+    segment.offset = offset;
+    segment.length = length;
+    segment.owner = std::move(owner);
+    m_segments.push_back(std::move(segment));
+  }
+
+  void Response::clear()
+  {
+    m_segments.clear();
+    m_size = 0;
+  }
+
+  bool Response::flattenTo(std::string& out) const
+  {
+    out.reserve(out.size() + m_size);
+      for (const auto& segment: m_segments) {
+          if (segment.kind != Segment::Kind::File) {
+            out.append(segment.memory(), segment.size());
+            continue;
+        }
+        size_t start = out.size();
+        out.resize(start + segment.length);
+        size_t done = 0;
+          while (done < segment.length) {
+            auto bytes_read = pread(segment.fd, &out[start + done], segment.length - done, segment.offset + done);
+            if ((bytes_read < 0) && (errno == EINTR)) continue;
+            if (bytes_read <= 0) return false;
+            done += bytes_read;
+          }
+      }
+    return true;
+  }
+
+  std::string& OutputQueue::buffer()
+  {
+    if (m_segments.empty() || (m_segments.back().kind != Response::Segment::Kind::Bytes)) push({});
+    return m_segments.back().bytes;
+  }
+
+  void OutputQueue::append(std::string_view data)
+  {
+    buffer().append(data);
+  }
+
+  void OutputQueue::append(Response&& response)
+  {
+      for (auto& segment: response.m_segments) {
+          if ((segment.kind == Response::Segment::Kind::Bytes) && (segment.bytes.size() < kCoalesceLimit)) {
+            buffer().append(segment.bytes);
+          } else {
+            push(std::move(segment));
+          }
+      }
+    response.clear();
+  }
+
+  size_t OutputQueue::pending() const noexcept
+  {
+    size_t open = 0;
+      if (!m_segments.empty() && (m_segments.back().kind == Response::Segment::Kind::Bytes)) {
+        open = m_segments.back().bytes.size();
+    }
+    return m_closed_size + open - m_front_offset;
+  }
+
+  void OutputQueue::push(Response::Segment&& segment)
+  {
+      if (!m_segments.empty() && (m_segments.back().kind == Response::Segment::Kind::Bytes)) {
+          if (m_segments.back().bytes.empty()) {
+            m_segments.pop_back();
+          } else {
+            m_closed_size += m_segments.back().bytes.size();
+          }
+    }
+    if (segment.kind != Response::Segment::Kind::Bytes) m_closed_size += segment.length;
+    m_segments.push_back(std::move(segment));
+  }
+
+  void OutputQueue::drop_front()
+  {
+    auto& front = m_segments.front();
+      if ((m_segments.size() == 1) && (front.kind == Response::Segment::Kind::Bytes)) {
+        // The open tail keeps its capacity for the next responses
+        front.bytes.clear();
+      } else {
+        m_closed_size -= front.size();
+        m_segments.pop_front();
+      }
+    m_front_offset = 0;
+  }
+
+  void OutputQueue::advance(size_t size)
+  {
+      while ((size > 0) && !m_segments.empty()) {
+        size_t left = m_segments.front().size() - m_front_offset;
+          if (size < left) {
+            m_front_offset += size;
+            return;
+        }
+        size -= left;
+        drop_front();
+      }
+  }
+
+  void OutputQueue::clear()
+  {
+    m_segments.clear();
+    m_front_offset = 0;
+    m_closed_size = 0;
+    m_zc_held.clear();
+  }
+
+  OutputQueue::Status OutputQueue::writeTo(int fd)
+  {
+      while (pending() > 0) {
+        const auto& front = m_segments.front();
+          if (front.size() == m_front_offset) {
+            drop_front();
+            continue;
+        }
+
+        Status status;
+          if (front.kind == Response::Segment::Kind::File) {
+            status = write_file(fd);
+          } else if (zero_copy_candidate(front, m_front_offset)) {
+            status = write_zero_copy(fd);
+          } else {
+            status = write_gathered(fd);
+          }
+        if (status != Status::Done) return status;
+      }
+    return Status::Done;
+  }
+
+  bool OutputQueue::zero_copy_candidate(const Response::Segment& segment, size_t offset) const noexcept
+  {
+    return (m_zc_threshold > 0) && (segment.kind != Response::Segment::Kind::File) &&
+           (segment.size() - offset >= m_zc_threshold);
+  }
+
+  OutputQueue::Status OutputQueue::write_gathered(int fd)
+  {
+    iovec iov[kMaxIov];
+    size_t count = 0;
+    size_t offset = m_front_offset;
+      for (const auto& segment: m_segments) {
+        if (count == kMaxIov) break;
+        if (segment.kind == Response::Segment::Kind::File) break;
+        // Big pieces are left for write_zero_copy(), except the front one which isn't a candidate
+        if ((count > 0) && zero_copy_candidate(segment, 0)) break;
+          if (segment.size() > offset) {
+            iov[count].iov_base = const_cast<char*>(segment.memory()) + offset;
+            iov[count].iov_len = segment.size() - offset;
+            ++count;
+        }
+        offset = 0;
+      }
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    auto bytes_written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      if (bytes_written >= 0) {
+        advance(bytes_written);
+        return Status::Done;
+    }
+    if (errno == EINTR) return Status::Done;
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? Status::WouldBlock : Status::Error;
+  }
+
+  OutputQueue::Status OutputQueue::write_file(int fd)
+  {
+    const auto& front = m_segments.front();
+    off_t offset = front.offset + static_cast<off_t>(m_front_offset);
+    auto bytes_written = sendfile(fd, front.fd, &offset, front.length - m_front_offset);
+      if (bytes_written > 0) {
+        advance(bytes_written);
+        return Status::Done;
+    }
+      if (bytes_written == 0) {
+        // The file is shorter than the region announced in the response
+        errno = EIO;
+        return Status::Error;
+    }
+    if (errno == EINTR) return Status::Done;
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? Status::WouldBlock : Status::Error;
+  }
+
+#if defined(UFW_HAS_ZEROCOPY)
+  bool OutputQueue::enableZeroCopy(int fd)
+  {
+    int enable = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+  }
+
+  OutputQueue::Status OutputQueue::write_zero_copy(int fd)
+  {
+    auto& front = m_segments.front();
+      if (front.kind == Response::Segment::Kind::Bytes) {
+        // The kernel reads the pages after sendmsg() returns: move the bytes somewhere stable we can hold on to
+        bool open = (m_segments.size() == 1);
+        auto holder = std::make_shared<std::string>(std::move(front.bytes));
+        front.kind = Response::Segment::Kind::View;
+        front.data = holder->data();
+        front.length = holder->size();
+        front.owner = std::move(holder);
+        if (open) m_closed_size += front.length;
+    }
+
+    iovec iov{const_cast<char*>(front.data) + m_front_offset, front.length - m_front_offset};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    auto bytes_written = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_ZEROCOPY);
+      if ((bytes_written < 0) && (errno == ENOBUFS)) {
+        // Out of optmem for notifications, this piece goes out the ordinary way
+        bytes_written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      } else if (bytes_written >= 0) {
+        // Every successful MSG_ZEROCOPY call gets the next notification id, partial or not
+        m_zc_held.push_back(Held{m_zc_next_id++, front.owner, front.slice});
+      }
+      if (bytes_written >= 0) {
+        advance(bytes_written);
+        return Status::Done;
+    }
+    if (errno == EINTR) return Status::Done;
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? Status::WouldBlock : Status::Error;
+  }
+
+  bool OutputQueue::reapZeroCopy(int fd)
+  {
+    bool healthy = true;
+      for (;;) {
+        char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        // The error queue never blocks, EAGAIN means it is drained
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) break;
+
+          for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool recverr = ((cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR)) ||
+                           ((cmsg->cmsg_level == SOL_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR));
+            if (!recverr) continue;
+            const auto* error = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+              if ((error->ee_origin != SO_EE_ORIGIN_ZEROCOPY) || (error->ee_errno != 0)) {
+                healthy = false;
+                continue;
+            }
+            // Notifications cover an inclusive id range, possibly out of order with other ranges
+            uint32_t lo = error->ee_info;
+            uint32_t hi = error->ee_data;
+            m_zc_held.erase(std::remove_if(m_zc_held.begin(), m_zc_held.end(),
+                                           [lo, hi](const Held& held) { return held.id - lo <= hi - lo; }),
+                            m_zc_held.end());
+            if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) m_zc_threshold = 0;
+          }
+      }
+    return healthy;
+  }
+#else
+  bool OutputQueue::enableZeroCopy(int)
+  {
+    return false;
+  }
+
+  OutputQueue::Status OutputQueue::write_zero_copy(int fd)
+  {
+    return write_gathered(fd);
+  }
+
+  bool OutputQueue::reapZeroCopy(int)
+  {
+    return true;
+  }
+#endif  // UFW_HAS_ZEROCOPY
+
+  size_t OutputQueue::gather(iovec* iov, size_t max)
+  {
+    size_t count = 0;
+    size_t offset = m_front_offset;
+      for (auto& segment: m_segments) {
+        if ((count == max) || (segment.kind == Response::Segment::Kind::File)) break;
+          if (segment.size() > offset) {
+            iov[count].iov_base = const_cast<char*>(segment.memory()) + offset;
+            iov[count].iov_len = segment.size() - offset;
+            ++count;
+        }
+        offset = 0;
+      }
+    return count;
+  }
+
+  bool OutputQueue::frontFile(int& fd, off_t& offset, size_t& length) const
+  {
+    size_t skip = m_front_offset;
+      for (const auto& segment: m_segments) {
+          if (segment.size() > skip) {
+            if (segment.kind != Response::Segment::Kind::File) return false;
+            fd = segment.fd;
+            offset = segment.offset + static_cast<off_t>(skip);
+            length = segment.length - skip;
+            return true;
+        }
+        // An empty open tail may sit in front
+        skip = 0;
+      }
+    return false;
+  }
+
+}  // namespace utils
@@ -0,0 +1,225 @@
+/**
+ * @file response.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Scatter-gather responses and per-connection output queues
+ * @brief A response is a list of owned bytes, borrowed views and file regions written with sendmsg()/sendfile()
+ * @version 0.1
+ * @date 2024-12-07
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_RESPONSE_HPP
+#define UFW_RESPONSE_HPP
+
+#include "bufferpool.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @class Response
+   * @brief Response payload made of several pieces that are written without being joined.
+   *
+   * Small pieces (headers) are copied in, big ones are referenced: a BufferSlice, any buffer kept
+   * alive by a shared owner or a region of an open file sent with sendfile().
+   */
+  class Response
+  {
+  public:
+    /**
+     * @brief Copies @p data, merging it with the previous piece if that one is owned too.
+     */
+    void append(std::string_view data);
+    void append(std::string&& data);
+    /**
+     * @brief References the sliced block, e.g. to echo a part of the request back.
+     */
+    void append(BufferSlice slice);
+    /**
+     * @brief References @p data, which must stay valid while @p owner is alive.
+     */
+    void append(std::shared_ptr<const void> owner, std::string_view data);
+    /**
+     * @brief Sends @p length bytes of @p fd starting at @p offset with sendfile().
+     * The fd must stay open until the response is written: pass whatever keeps it open as @p owner.
+     */
+    void appendFile(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner = {});
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+    bool empty() const noexcept
+    {
+      return m_size == 0;
+    }
+    void clear();
+
+    /**
+     * @brief Appends all pieces to @p out, file regions are read with pread().
+     * @return false if a file region couldn't be read completely.
+     */
+    bool flattenTo(std::string& out) const;
+
+  private:
+    friend class OutputQueue;
+
+    struct Segment
+    {
+      enum class Kind
+      {
+        Bytes,
+        View,
+        File
+      };
+
+      Kind kind{Kind::Bytes};
+      std::string bytes;                  // Bytes
+      const char* data{nullptr};          // View
+      BufferSlice slice;                  // View taken from a receive block
+      std::shared_ptr<const void> owner;  // View and File
+      int fd{-1};                         // File
+      off_t offset{0};                    // File
+      size_t length{0};                   // View and File
+
+      size_t size() const noexcept
+      {
+        return kind == Kind::Bytes ? bytes.size() : length;
+      }
+      const char* memory() const noexcept
+      {
+        return kind == Kind::Bytes ? bytes.data() : data;
+      }
+    };
+
+    std::vector<Segment> m_segments;
+    size_t m_size{0};
+  };
+
+  /**
+   * @class OutputQueue
+   * @brief Bytes waiting to be written to a socket, in order, with partial writes tracked.
+   *
+   * Memory pieces are gathered into one sendmsg() of up to kMaxIov buffers, file regions go out with
+   * sendfile(). With zero-copy enabled, pieces of at least the threshold are sent with MSG_ZEROCOPY
+   * and kept alive until the kernel reports them done on the socket error queue.
+   * Not thread-safe, owned by the thread serving the connection.
+   */
+  class OutputQueue
+  {
+  public:
+    enum class Status
+    {
+      Done,        // everything was written
+      WouldBlock,  // socket buffer is full, wait for EPOLLOUT
+      Error        // errno tells why, the connection should be dropped
+    };
+
+    static constexpr size_t kMaxIov = 64;
+
+    /**
+     * @brief Owned tail buffer, small responses are encoded straight into it and share one write.
+     */
+    std::string& buffer();
+    void append(std::string_view data);
+    void append(Response&& response);
+
+    size_t pending() const noexcept;
+    bool empty() const noexcept
+    {
+      return pending() == 0;
+    }
+
+    /**
+     * @brief Sets SO_ZEROCOPY on @p fd.
+     * @return false if the kernel (before 4.14) or the build doesn't support MSG_ZEROCOPY.
+     */
+    static bool enableZeroCopy(int fd);
+    /**
+     * @brief Sends pieces of @p threshold bytes or more with MSG_ZEROCOPY, 0 disables it.
+     * Only for sockets enableZeroCopy() succeeded on. Disables itself once the kernel reports it had
+     * to copy anyway (e.g. over loopback), then zero-copy only costs extra notifications.
+     */
+    void setZeroCopyThreshold(size_t threshold) noexcept
+    {
+      m_zc_threshold = threshold;
+    }
+    bool zeroCopyEnabled() const noexcept
+    {
+      return m_zc_threshold > 0;
+    }
+    /**
+     * @brief Number of zero-copy sends the kernel hasn't reported done yet.
+     */
+    size_t zeroCopyInFlight() const noexcept
+    {
+      return m_zc_held.size();
+    }
+
+    /**
+     * @brief Writes as much as the socket takes.
+     */
+    Status writeTo(int fd);
+    /**
+     * @brief Drains zero-copy completions from the error queue of @p fd and releases their buffers.
+     * @return false if the error queue held a real socket error.
+     */
+    bool reapZeroCopy(int fd);
+
+    /**
+     * @brief Fills @p iov with the leading memory pieces for an asynchronous send, up to the first
+     * file region. Nothing may be appended until advance() is called.
+     * @return number of buffers filled, 0 if the queue is empty or starts with a file region.
+     */
+    size_t gather(iovec* iov, size_t max);
+    /**
+     * @brief The unsent part of the file region at the front, for an asynchronous splice.
+     * @return false if the front piece is not a file region.
+     */
+    bool frontFile(int& fd, off_t& offset, size_t& length) const;
+    /**
+     * @brief Drops @p size bytes written from the front.
+     */
+    void advance(size_t size);
+
+    void clear();
+
+  private:
+    struct Held
+    {
+      uint32_t id;
+      std::shared_ptr<const void> owner;
+      BufferSlice slice;
+    };
+
+    // The last segment stays open for appends while it holds owned bytes, m_closed_size counts the others
+    std::deque<Response::Segment> m_segments;
+    size_t m_front_offset{0};
+    size_t m_closed_size{0};
+
+    size_t m_zc_threshold{0};
+    uint32_t m_zc_next_id{0};
+    std::deque<Held> m_zc_held;
+
+    void push(Response::Segment&& segment);
+    void drop_front();
+    Status write_file(int fd);
+    Status write_zero_copy(int fd);
+    Status write_gathered(int fd);
+    bool zero_copy_candidate(const Response::Segment& segment, size_t offset) const noexcept;
+  };
+
+}  // namespace utils
+
+#endif  // UFW_RESPONSE_HPP
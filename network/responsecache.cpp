@@ -0,0 +1,161 @@
+/**
+ * @file responsecache.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "responsecache.hpp"
+
+#include <algorithm>
+
+namespace utils
+{
+  namespace
+  {
+    // Map node, LRU node and the two string headers of an entry, roughly
+    constexpr size_t kEntryOverhead = 128;
+  }
+
+  ResponseCache::ResponseCache(): ResponseCache(Options{}) {}
+
+  ResponseCache::ResponseCache(Options options): m_options(options)
+  {
+    m_options.shards = std::max<size_t>(1, m_options.shards);
+    m_shard_budget = m_options.max_bytes / m_options.shards;
+    for (size_t i = 0; i < m_options.shards; ++i) m_shards.push_back(std::make_unique<Shard>());
+  }
+
+  ResponseCache::Shard& ResponseCache::shard_of(uint64_t hash) const
+  {
+    // The low bits pick the bucket inside the shard's map, the shard comes from the high ones
+    return *m_shards[(hash >> 32) % m_shards.size()];
+  }
+
+  bool ResponseCache::find(uint64_t hash, std::string_view request, std::string& response,
+                           std::shared_ptr<Flight>& flight)
+  {
+    auto& shard = shard_of(hash);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(hash);
+      if ((it != shard.entries.end()) && (it->second.request == request)) {
+          if ((m_options.ttl.count() == 0) || (Clock::now() < it->second.expires)) {
+            ++shard.stats.hits;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+            Value cached = it->second.response;
+            lock.unlock();
+            response.assign(*cached);
+            return true;
+        }
+        ++shard.stats.expirations;
+        erase(shard, it);
+    }
+
+    auto running = shard.flights.find(hash);
+      if (running != shard.flights.end()) {
+          if (running->second->request == request) {
+            auto joined = running->second;
+            ++shard.stats.coalesced;
+            joined->done_cv.wait(lock, [&joined]() { return joined->done; });
+            Value computed = joined->response;
+            lock.unlock();
+            if (computed) response.assign(*computed);
+            else response.clear();
+            return true;
+        }
+        // Another request with the same hash is being computed, this one goes alone
+      } else {
+        flight = std::make_shared<Flight>();
+        flight->request.assign(request);
+        shard.flights.emplace(hash, flight);
+      }
+    ++shard.stats.misses;
+    return false;
+  }
+
+  void ResponseCache::finish(uint64_t hash, std::string_view request, const std::string& response,
+                             const std::shared_ptr<Flight>& flight)
+  {
+    Value computed = response.empty() ? nullptr : std::make_shared<const std::string>(response);
+    auto& shard = shard_of(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    bool store = computed != nullptr;
+      if (flight) {
+        flight->response = computed;
+        flight->done = true;
+        shard.flights.erase(hash);
+        store = store && !flight->stale;
+        flight->done_cv.notify_all();
+    }
+    if (store) insert(shard, hash, request, std::move(computed));
+  }
+
+  bool ResponseCache::invalidate(std::string_view request)
+  {
+    uint64_t hash = std::hash<std::string_view>{}(request);
+    auto& shard = shard_of(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto running = shard.flights.find(hash);
+    if ((running != shard.flights.end()) && (running->second->request == request)) running->second->stale = true;
+    auto it = shard.entries.find(hash);
+    if ((it == shard.entries.end()) || (it->second.request != request)) return false;
+    ++shard.stats.invalidations;
+    erase(shard, it);
+    return true;
+  }
+
+  void ResponseCache::clear()
+  {
+      for (auto& shard: m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->stats.invalidations += shard->entries.size();
+        shard->entries.clear();
+        shard->lru.clear();
+        shard->bytes = 0;
+        for (auto& [hash, flight]: shard->flights) flight->stale = true;
+      }
+  }
+
+  ResponseCache::Stats ResponseCache::stats() const
+  {
+    Stats total;
+      for (const auto& shard: m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.hits += shard->stats.hits;
+        total.misses += shard->stats.misses;
+        total.coalesced += shard->stats.coalesced;
+        total.evictions += shard->stats.evictions;
+        total.expirations += shard->stats.expirations;
+        total.invalidations += shard->stats.invalidations;
+        total.entries += shard->entries.size();
+        total.bytes += shard->bytes;
+      }
+    return total;
+  }
+
+  void ResponseCache::erase(Shard& shard, std::unordered_map<uint64_t, Entry>::iterator it)
+  {
+    shard.bytes -= it->second.bytes;
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+  }
+
+  void ResponseCache::insert(Shard& shard, uint64_t hash, std::string_view request, Value response)
+  {
+    size_t bytes = request.size() + response->size() + kEntryOverhead;
+    if (bytes > m_shard_budget) return;
+    auto existing = shard.entries.find(hash);
+    if (existing != shard.entries.end()) erase(shard, existing);
+    auto now = Clock::now();
+      while ((shard.bytes + bytes > m_shard_budget) && !shard.lru.empty()) {
+        auto victim = shard.entries.find(shard.lru.back());
+        bool expired = (m_options.ttl.count() > 0) && (victim->second.expires <= now);
+        ++(expired ? shard.stats.expirations : shard.stats.evictions);
+        erase(shard, victim);
+    }
+    shard.lru.push_front(hash);
+    shard.entries.emplace(hash, Entry{std::string(request), std::move(response), now + m_options.ttl, bytes,
+                                      shard.lru.begin()});
+    shard.bytes += bytes;
+  }
+
+}  // namespace utils
@@ -0,0 +1,149 @@
+/**
+ * @file responsecache.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Cache of handler responses keyed by the request bytes
+ * @brief Sharded LRU with a time to live, a memory budget and one computation per concurrent miss
+ * @version 0.1
+ * @date 2025-03-01
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_RESPONSECACHE_HPP
+#define UFW_RESPONSECACHE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @class ResponseCache
+   * @brief Maps request bytes to the response computed for them, for handlers whose answer depends
+   * on the request alone.
+   *
+   * A request hashes to one of the shards, each with a lock, an LRU list and an equal part of the
+   * memory budget, so threads serving different requests rarely meet. Entries expire after the
+   * time to live, the least recently used ones go when a shard is over its budget. While a miss is
+   * being computed, lookups of the same request wait for that result instead of computing it again.
+   * Empty responses are not kept.
+   */
+  class ResponseCache
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+      size_t shards{16};
+      size_t max_bytes{64 * 1024 * 1024};  // requests, responses and bookkeeping of all entries
+      std::chrono::milliseconds ttl{1000};  // 0 keeps entries until they are evicted or invalidated
+    };
+
+    struct Stats
+    {
+      uint64_t hits{0};
+      uint64_t misses{0};  // computations, every miss not served by a concurrent one
+      uint64_t coalesced{0};  // misses that waited for a concurrent computation of the same request
+      uint64_t evictions{0};  // dropped for the memory budget
+      uint64_t expirations{0};
+      uint64_t invalidations{0};
+      uint64_t entries{0};
+      uint64_t bytes{0};
+    };
+
+    ResponseCache();
+    explicit ResponseCache(Options options);
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    /**
+     * @brief Puts the response cached for @p request into @p response, or computes it with
+     * @p compute and caches it. @p compute(std::string&) writes into @p response, without a lock held.
+     */
+    template<typename F>
+    void get(std::string_view request, std::string& response, F&& compute)
+    {
+      uint64_t hash = std::hash<std::string_view>{}(request);
+      std::shared_ptr<Flight> flight;
+      if (find(hash, request, response, flight)) return;
+      response.clear();
+      compute(response);
+      finish(hash, request, response, flight);
+    }
+
+    /**
+     * @brief Drops the entry of @p request. A computation of it that is under way is still
+     * delivered to its waiters but not cached.
+     * @return true if an entry was dropped.
+     */
+    bool invalidate(std::string_view request);
+    /**
+     * @brief Drops every entry, computations under way are not cached.
+     */
+    void clear();
+
+    [[nodiscard]]
+    Stats stats() const;
+
+  private:
+    using Value = std::shared_ptr<const std::string>;
+
+    struct Entry
+    {
+      std::string request;
+      Value response;
+      Clock::time_point expires;
+      size_t bytes{0};
+      std::list<uint64_t>::iterator lru;
+    };
+
+    struct Flight
+    {
+      std::string request;
+      std::condition_variable done_cv;
+      bool done{false};
+      bool stale{false};  // invalidated while computing, deliver but don't cache
+      Value response;
+    };
+
+    struct Shard
+    {
+      std::mutex mutex;
+      std::unordered_map<uint64_t, Entry> entries;
+      std::list<uint64_t> lru;  // most recently used first
+      std::unordered_map<uint64_t, std::shared_ptr<Flight>> flights;
+      size_t bytes{0};
+      Stats stats;
+    };
+
+    Options m_options;
+    size_t m_shard_budget;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    Shard& shard_of(uint64_t hash) const;
+    /**
+     * @brief Serves a hit or waits for a concurrent computation. On a miss @p flight is the
+     * computation to finish(), null if a colliding request is computed already.
+     */
+    bool find(uint64_t hash, std::string_view request, std::string& response, std::shared_ptr<Flight>& flight);
+    void finish(uint64_t hash, std::string_view request, const std::string& response,
+                const std::shared_ptr<Flight>& flight);
+    void erase(Shard& shard, std::unordered_map<uint64_t, Entry>::iterator it);
+    void insert(Shard& shard, uint64_t hash, std::string_view request, Value response);
+  };
+
+}  // namespace utils
+
+#endif  // UFW_RESPONSECACHE_HPP
@@ -0,0 +1,154 @@
+/**
+ * @file socketaddress.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "socketaddress.hpp"
+
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+namespace utils
+{
+  namespace
+  {
+    std::optional<uint16_t> parse_port(const std::string& text)
+    {
+      if (text.empty() || (text.size() > 5)) return std::nullopt;
+      char* end = nullptr;
+      unsigned long port = std::strtoul(text.c_str(), &end, 10);
+      if ((*end != '\0') || (port > 65535)) return std::nullopt;
+      return static_cast<uint16_t>(port);
+    }
+  }  // namespace
+
+  SocketAddress SocketAddress::anyIPv4(uint16_t port)
+  {
+    SocketAddress address;
+    auto* in = reinterpret_cast<sockaddr_in*>(&address.m_storage);
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(INADDR_ANY);
+    in->sin_port = htons(port);
+    address.m_size = sizeof(sockaddr_in);
+    return address;
+  }
+
+  SocketAddress SocketAddress::anyIPv6(uint16_t port, bool dual_stack)
+  {
+    SocketAddress address;
+    auto* in6 = reinterpret_cast<sockaddr_in6*>(&address.m_storage);
+    in6->sin6_family = AF_INET6;
+    in6->sin6_addr = in6addr_any;
+    in6->sin6_port = htons(port);
+    address.m_size = sizeof(sockaddr_in6);
+    address.m_dual_stack = dual_stack;
+    return address;
+  }
+
+  std::optional<SocketAddress> SocketAddress::ip(const std::string& host, uint16_t port)
+  {
+    SocketAddress address;
+    auto* in = reinterpret_cast<sockaddr_in*>(&address.m_storage);
+      if (inet_pton(AF_INET, host.c_str(), &in->sin_addr) == 1) {
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        address.m_size = sizeof(sockaddr_in);
+        return address;
+    }
+
+    std::string bare = host;
+    if ((bare.size() >= 2) && (bare.front() == '[') && (bare.back() == ']')) bare = bare.substr(1, bare.size() - 2);
+    auto* in6 = reinterpret_cast<sockaddr_in6*>(&address.m_storage);
+    if (inet_pton(AF_INET6, bare.c_str(), &in6->sin6_addr) != 1) return std::nullopt;
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons(port);
+    address.m_size = sizeof(sockaddr_in6);
+    address.m_dual_stack = IN6_IS_ADDR_UNSPECIFIED(&in6->sin6_addr);
+    return address;
+  }
+
+  std::optional<SocketAddress> SocketAddress::unixPath(const std::string& path)
+  {
+    SocketAddress address;
+    auto* un = reinterpret_cast<sockaddr_un*>(&address.m_storage);
+    // A path needs its terminating zero, an abstract name is counted by the address length instead
+    bool abstract = !path.empty() && (path.front() == '@');
+    if (path.empty() || (path.size() + (abstract ? 0 : 1) > sizeof(un->sun_path))) return std::nullopt;
+    un->sun_family = AF_UNIX;
+    std::memcpy(un->sun_path, path.data(), path.size());
+    if (abstract) un->sun_path[0] = '\0';
+    address.m_size = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1));
+    return address;
+  }
+
+  std::optional<SocketAddress> SocketAddress::parse(const std::string& text)
+  {
+    static const std::string kUnixScheme = "unix:";
+    if (text.compare(0, kUnixScheme.size(), kUnixScheme) == 0) return unixPath(text.substr(kUnixScheme.size()));
+
+    auto colon = text.rfind(':');
+    if (colon == std::string::npos) return std::nullopt;
+    auto port = parse_port(text.substr(colon + 1));
+    if (!port) return std::nullopt;
+    auto host = text.substr(0, colon);
+    if (host.empty() || (host == "*")) return anyIPv4(*port);
+    // An IPv6 host needs brackets here, otherwise its last group would be taken for the port
+    if ((host.find(':') != std::string::npos) && (host.front() != '[')) return std::nullopt;
+    return ip(host, *port);
+  }
+
+  std::optional<SocketAddress> SocketAddress::fromSocket(int fd)
+  {
+    SocketAddress address;
+    address.m_size = sizeof(address.m_storage);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&address.m_storage), &address.m_size) < 0) return std::nullopt;
+    int v6_only = 1;
+    socklen_t length = sizeof(v6_only);
+      if ((address.family() == AF_INET6) &&
+          (getsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, &length) == 0)) {
+        address.m_dual_stack = v6_only == 0;
+    }
+    return address;
+  }
+
+  uint16_t SocketAddress::port() const noexcept
+  {
+    if (family() == AF_INET) return ntohs(reinterpret_cast<const sockaddr_in*>(&m_storage)->sin_port);
+    if (family() == AF_INET6) return ntohs(reinterpret_cast<const sockaddr_in6*>(&m_storage)->sin6_port);
+    return 0;
+  }
+
+  std::string SocketAddress::path() const
+  {
+    if (!isUnix()) return {};
+    const auto* un = reinterpret_cast<const sockaddr_un*>(&m_storage);
+    if (un->sun_path[0] == '\0') return {};
+    return std::string(un->sun_path);
+  }
+
+  std::string SocketAddress::toString() const
+  {
+    char host[INET6_ADDRSTRLEN] = {};
+      switch (family()) {
+        case AF_INET:
+          inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&m_storage)->sin_addr, host, sizeof(host));
+          return std::string(host) + ":" + std::to_string(port());
+        case AF_INET6:
+          inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&m_storage)->sin6_addr, host, sizeof(host));
+          return "[" + std::string(host) + "]:" + std::to_string(port());
+        case AF_UNIX: {
+          const auto* un = reinterpret_cast<const sockaddr_un*>(&m_storage);
+          if (un->sun_path[0] != '\0') return "unix:" + path();
+          size_t length = m_size - offsetof(sockaddr_un, sun_path);
+          return "unix:@" + std::string(un->sun_path + 1, length > 0 ? length - 1 : 0);
+        }
+        default: return "unspecified";
+      }
+  }
+
+}  // namespace utils
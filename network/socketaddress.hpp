@@ -0,0 +1,100 @@
+/**
+ * @file socketaddress.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Stream socket address: IPv4, IPv6 or unix domain
+ * @brief Lets servers and clients bind and connect without caring about the sockaddr flavour
+ * @version 0.1
+ * @date 2025-01-11
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_SOCKETADDRESS_HPP
+#define UFW_SOCKETADDRESS_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <sys/socket.h>
+
+namespace utils
+{
+
+  /**
+   * @class SocketAddress
+   * @brief Value type holding any address a stream socket can bind or connect to.
+   *
+   * Unix domain sockets skip the TCP stack altogether and suit processes on the same host.
+   * A unix path starting with '@' names a socket in the abstract namespace (no file).
+   * An IPv6 listener on "::" is dual-stack: IPv4 clients arrive as ::ffff:a.b.c.d.
+   */
+  class SocketAddress
+  {
+  public:
+    SocketAddress() = default;
+
+    static SocketAddress anyIPv4(uint16_t port);
+    static SocketAddress anyIPv6(uint16_t port, bool dual_stack = true);
+    /**
+     * @brief Numeric IPv4 or IPv6 address, the latter with or without brackets. No name lookup.
+     */
+    static std::optional<SocketAddress> ip(const std::string& host, uint16_t port);
+    /**
+     * @return std::nullopt if the path doesn't fit into sockaddr_un.
+     */
+    static std::optional<SocketAddress> unixPath(const std::string& path);
+    /**
+     * @brief Parses "unix:/run/app.sock", "unix:@name", "127.0.0.1:80", "[::1]:80", "[::]:80" or
+     * "*:80" / ":80" (any IPv4 address).
+     */
+    static std::optional<SocketAddress> parse(const std::string& text);
+    /**
+     * @brief Local address of a bound socket, e.g. one inherited from another process.
+     */
+    static std::optional<SocketAddress> fromSocket(int fd);
+
+    /**
+     * @brief AF_INET, AF_INET6, AF_UNIX, or AF_UNSPEC for a default constructed address.
+     */
+    int family() const noexcept
+    {
+      return m_storage.ss_family;
+    }
+    const sockaddr* data() const noexcept
+    {
+      return reinterpret_cast<const sockaddr*>(&m_storage);
+    }
+    socklen_t size() const noexcept
+    {
+      return m_size;
+    }
+    bool isUnix() const noexcept
+    {
+      return family() == AF_UNIX;
+    }
+    bool dualStack() const noexcept
+    {
+      return m_dual_stack;
+    }
+    /**
+     * @brief 0 for unix sockets.
+     */
+    uint16_t port() const noexcept;
+    /**
+     * @brief File of a unix socket, empty for abstract and IP addresses.
+     */
+    std::string path() const;
+    /**
+     * @brief The address in parse() syntax.
+     */
+    std::string toString() const;
+
+  private:
+    sockaddr_storage m_storage{};
+    socklen_t m_size{0};
+    bool m_dual_stack{false};
+  };
+
+}  // namespace utils
+
+#endif  // UFW_SOCKETADDRESS_HPP
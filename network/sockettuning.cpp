@@ -0,0 +1,122 @@
+/**
+ * @file sockettuning.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "sockettuning.hpp"
+
+#include "../support/logger.hpp"
+
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace utils
+{
+  namespace
+  {
+    bool set_option(int fd, int level, int name, int value, const char* option)
+    {
+      if (setsockopt(fd, level, name, &value, sizeof(value)) == 0) return true;
+      UFW_LOG_WARN("Failed to set ", option, " to ", value, ". Errno: ", Errno{errno});
+      return false;
+    }
+  }  // namespace
+
+  SocketTuning SocketTuning::defaults()
+  {
+    SocketTuning tuning;
+    tuning.no_delay = true;
+    return tuning;
+  }
+
+  SocketTuning SocketTuning::lowLatency()
+  {
+    SocketTuning tuning;
+    tuning.no_delay = true;
+    tuning.quick_ack = true;
+    tuning.busy_poll = std::chrono::microseconds(50);
+    tuning.fast_open_queue = 256;
+    return tuning;
+  }
+
+  SocketTuning SocketTuning::bulkThroughput()
+  {
+    SocketTuning tuning;
+    tuning.no_delay = true;
+    tuning.send_buffer = 4 * 1024 * 1024;
+    tuning.receive_buffer = 4 * 1024 * 1024;
+    return tuning;
+  }
+
+  SocketTuning SocketTuning::manyIdle()
+  {
+    SocketTuning tuning;
+    tuning.no_delay = true;
+    tuning.send_buffer = 16 * 1024;
+    tuning.receive_buffer = 16 * 1024;
+    tuning.defer_accept = std::chrono::seconds(10);
+    tuning.user_timeout = std::chrono::milliseconds(120000);
+    tuning.keepalive = Keepalive{};
+    return tuning;
+  }
+
+  std::optional<SocketTuning> SocketTuning::byName(std::string_view name)
+  {
+    if (name == "default") return defaults();
+    if (name == "low-latency") return lowLatency();
+    if (name == "bulk-throughput") return bulkThroughput();
+    if (name == "many-idle") return manyIdle();
+    return std::nullopt;
+  }
+
+  bool SocketTuning::apply(int fd, Side side) const
+  {
+    // Accepted sockets inherit everything else from the listener, don't spend a syscall on them
+    if ((side == Side::Accepted) && !quick_ack) return true;
+    int domain = AF_UNSPEC;
+    socklen_t length = sizeof(domain);
+    getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &length);
+    bool tcp = (domain == AF_INET) || (domain == AF_INET6);
+      if (side == Side::Accepted) {
+        return !tcp || set_option(fd, IPPROTO_TCP, TCP_QUICKACK, *quick_ack ? 1 : 0, "TCP_QUICKACK");
+    }
+
+    bool applied = true;
+    // Buffers go first: the window scale is fixed by the SYN
+    if (send_buffer) applied &= set_option(fd, SOL_SOCKET, SO_SNDBUF, *send_buffer, "SO_SNDBUF");
+    if (receive_buffer) applied &= set_option(fd, SOL_SOCKET, SO_RCVBUF, *receive_buffer, "SO_RCVBUF");
+    if (!tcp) return applied;
+
+    if (no_delay) applied &= set_option(fd, IPPROTO_TCP, TCP_NODELAY, *no_delay ? 1 : 0, "TCP_NODELAY");
+      if (busy_poll) {
+        applied &= set_option(fd, SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(busy_poll->count()), "SO_BUSY_POLL");
+    }
+      if (user_timeout) {
+        applied &= set_option(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, static_cast<int>(user_timeout->count()),
+                              "TCP_USER_TIMEOUT");
+    }
+      if (keepalive) {
+        applied &= set_option(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+        applied &= set_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(keepalive->idle.count()), "TCP_KEEPIDLE");
+        applied &= set_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(keepalive->interval.count()),
+                              "TCP_KEEPINTVL");
+        applied &= set_option(fd, IPPROTO_TCP, TCP_KEEPCNT, keepalive->count, "TCP_KEEPCNT");
+    }
+      if (side == Side::Listener) {
+          if (defer_accept) {
+            applied &= set_option(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, static_cast<int>(defer_accept->count()),
+                                  "TCP_DEFER_ACCEPT");
+        }
+        if (fast_open_queue) applied &= set_option(fd, IPPROTO_TCP, TCP_FASTOPEN, *fast_open_queue, "TCP_FASTOPEN");
+      } else if (fast_open_queue) {
+        // connect() returns at once, the first send() carries the data in the SYN
+        applied &= set_option(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, *fast_open_queue > 0 ? 1 : 0,
+                              "TCP_FASTOPEN_CONNECT");
+      }
+    return applied;
+  }
+
+}  // namespace utils
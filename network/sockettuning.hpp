@@ -0,0 +1,100 @@
+/**
+ * @file sockettuning.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Named sets of socket options applied the same way by TcpServer and TcpClient
+ * @brief Covers Nagle/delayed ACK, busy polling, deferred accept, TCP Fast Open, buffer sizes,
+ *        user timeout and keepalive
+ * @version 0.1
+ * @date 2025-02-08
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_SOCKETTUNING_HPP
+#define UFW_SOCKETTUNING_HPP
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+namespace utils
+{
+
+  /**
+   * @struct SocketTuning
+   * @brief Socket options to set, an empty field leaves the kernel default alone.
+   *
+   * The server sets everything on its listeners before the first accept: accepted sockets inherit
+   * the options from there, no extra syscalls per connection except for TCP_QUICKACK, which the kernel
+   * leaves again on its own. The client sets everything before connect(). Options that mean nothing
+   * on a socket (TCP ones on unix sockets, TCP_DEFER_ACCEPT on a client) are skipped, options the
+   * kernel refuses are logged and skipped. ucommon::GetSocketOptions() reads back what is in effect:
+   * the kernel doubles and caps buffer sizes (net.core.wmem_max, rmem_max), rounds deferred accept
+   * to SYN-ACK retransmits. SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN.
+   */
+  struct SocketTuning
+  {
+    struct Keepalive
+    {
+      std::chrono::seconds idle{60};  // before the first probe
+      std::chrono::seconds interval{10};  // between probes
+      int count{6};  // unanswered probes until the connection is dropped
+    };
+
+    /**
+     * @brief Where apply() is called, decides which options make sense.
+     */
+    enum class Side
+    {
+      Listener,
+      Accepted,
+      Client
+    };
+
+    std::optional<bool> no_delay;  // TCP_NODELAY
+    std::optional<bool> quick_ack;  // TCP_QUICKACK on every accepted connection
+    std::optional<std::chrono::microseconds> busy_poll;  // SO_BUSY_POLL
+    std::optional<std::chrono::seconds> defer_accept;  // TCP_DEFER_ACCEPT, listeners only
+    std::optional<int> fast_open_queue;  // TCP_FASTOPEN on listeners, TCP_FASTOPEN_CONNECT on clients
+    std::optional<int> send_buffer;  // SO_SNDBUF, fixing it turns the kernel's autotuning off
+    std::optional<int> receive_buffer;  // SO_RCVBUF, likewise
+    std::optional<std::chrono::milliseconds> user_timeout;  // TCP_USER_TIMEOUT
+    std::optional<Keepalive> keepalive;  // SO_KEEPALIVE with TCP_KEEPIDLE, TCP_KEEPINTVL, TCP_KEEPCNT
+
+    /**
+     * @brief What TcpServer did before profiles: TCP_NODELAY only.
+     */
+    static SocketTuning defaults();
+    /**
+     * @brief Small request/response exchanges: no Nagle, immediate ACKs, 50 us busy polling and
+     * TCP Fast Open saving a round trip on repeated connects.
+     */
+    static SocketTuning lowLatency();
+    /**
+     * @brief Large transfers over long fat links: 4 MiB socket buffers, the window is there from the
+     * first byte instead of after autotuning ramped up. Capped by net.core.wmem_max / rmem_max, raise
+     * those along. Pointless over loopback and on short paths.
+     */
+    static SocketTuning bulkThroughput();
+    /**
+     * @brief Lots of mostly idle connections: 16 KiB buffers bound the memory of each one, deferred
+     * accept keeps connections that never send off the server, keepalive and a user timeout drop
+     * dead peers within two minutes.
+     */
+    static SocketTuning manyIdle();
+    /**
+     * @brief Profile by name: "default", "low-latency", "bulk-throughput" or "many-idle".
+     */
+    static std::optional<SocketTuning> byName(std::string_view name);
+
+    /**
+     * @brief Sets the options that make sense on @p side. Accepted sockets only get TCP_QUICKACK,
+     * the rest comes from the listener.
+     * @return false if the kernel refused any of them, every refusal is logged.
+     */
+    bool apply(int fd, Side side) const;
+  };
+
+}  // namespace utils
+
+#endif  // UFW_SOCKETTUNING_HPP
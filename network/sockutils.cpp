@@ -40,6 +40,7 @@ namespace ucommon
       switch (addr.ss_family) {
         case AF_INET: family = SocketFamily::IPv4; break;
         case AF_INET6: family = SocketFamily::IPv6; break;
+        case AF_UNIX: family = SocketFamily::Unix; break;
         default: family = SocketFamily::Unknown;
       }
 
@@ -110,4 +111,37 @@ namespace ucommon
     return std::make_pair(std::string(host), port);
   }
 
+  std::optional<SocketOptions> GetSocketOptions(int fd)
+  {
+    int domain;
+    socklen_t len = sizeof(domain);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len) == -1) return std::nullopt;
+
+    // Options a kernel doesn't know keep their zero
+    auto get = [fd](int level, int name) {
+      int value = 0;
+      socklen_t value_len = sizeof(value);
+      if (getsockopt(fd, level, name, &value, &value_len) == -1) value = 0;
+      return value;
+    };
+
+    SocketOptions options;
+    options.send_buffer = get(SOL_SOCKET, SO_SNDBUF);
+    options.receive_buffer = get(SOL_SOCKET, SO_RCVBUF);
+    options.keepalive = get(SOL_SOCKET, SO_KEEPALIVE) != 0;
+    if ((domain != AF_INET) && (domain != AF_INET6)) return options;
+
+    options.no_delay = get(IPPROTO_TCP, TCP_NODELAY) != 0;
+    options.quick_ack = get(IPPROTO_TCP, TCP_QUICKACK) != 0;
+    options.busy_poll_us = get(SOL_SOCKET, SO_BUSY_POLL);
+    options.defer_accept_s = get(IPPROTO_TCP, TCP_DEFER_ACCEPT);
+    options.fast_open = get(IPPROTO_TCP, TCP_FASTOPEN);
+    options.fast_open_connect = get(IPPROTO_TCP, TCP_FASTOPEN_CONNECT) != 0;
+    options.user_timeout_ms = static_cast<unsigned>(get(IPPROTO_TCP, TCP_USER_TIMEOUT));
+    options.keep_idle_s = get(IPPROTO_TCP, TCP_KEEPIDLE);
+    options.keep_interval_s = get(IPPROTO_TCP, TCP_KEEPINTVL);
+    options.keep_count = get(IPPROTO_TCP, TCP_KEEPCNT);
+    return options;
+  }
+
 }  // namespace ucommon
@@ -28,12 +28,14 @@ namespace ucommon
    *
    * @value IPv4 Represents an IPv4 socket address family.
    * @value IPv6 Represents an IPv6 socket address family.
+   * @value Unix Represents a unix domain (local) socket address family.
    * @value Unknown Represents an unknown or unsupported socket address family.
    */
   enum class SocketFamily
   {
     IPv4,
     IPv6,
+    Unix,
     Unknown
   };
 
@@ -53,6 +55,31 @@ namespace ucommon
     Unknown
   };
 
+  /**
+   * @struct SocketOptions
+   * @brief Tuning-related options of a socket as the kernel reports them.
+   *
+   * Values are what is in effect, not what was asked for: SO_SNDBUF and SO_RCVBUF come back
+   * doubled (the kernel's bookkeeping overhead) and capped, TCP_DEFER_ACCEPT rounded to SYN-ACK
+   * retransmits. TCP fields stay zero for other sockets.
+   */
+  struct SocketOptions
+  {
+    bool no_delay{false};  // TCP_NODELAY
+    bool quick_ack{false};  // TCP_QUICKACK, the kernel clears it on its own
+    int busy_poll_us{0};  // SO_BUSY_POLL
+    int defer_accept_s{0};  // TCP_DEFER_ACCEPT
+    int fast_open{0};  // TCP_FASTOPEN queue length of a listener
+    bool fast_open_connect{false};  // TCP_FASTOPEN_CONNECT
+    int send_buffer{0};  // SO_SNDBUF
+    int receive_buffer{0};  // SO_RCVBUF
+    unsigned user_timeout_ms{0};  // TCP_USER_TIMEOUT
+    bool keepalive{false};  // SO_KEEPALIVE
+    int keep_idle_s{0};  // TCP_KEEPIDLE
+    int keep_interval_s{0};  // TCP_KEEPINTVL
+    int keep_count{0};  // TCP_KEEPCNT
+  };
+
   /**
    * @brief Checks if the given file descriptor is currently open.
    *
@@ -83,7 +110,7 @@ namespace ucommon
    *         information cannot be determined (e.g., the file descriptor is
    *         invalid or does not represent a socket).
    *
-   * The function determines the socket family (IPv4, IPv6, or Unknown) and type
+   * The function determines the socket family (IPv4, IPv6, Unix, or Unknown) and type
    * (Stream, Datagram, Raw, or Unknown) by querying the socket options and
    * socket address information via `getsockopt` and `getsockname`.
    */
@@ -153,6 +180,13 @@ namespace ucommon
    * @return The local IP address as a string if successful, or an empty optional if unable to determine the address.
    */
   std::optional<std::string> GetLocalIp();
+  /**
+   * Reads the tuning-related options in effect on a socket (see SocketOptions).
+   *
+   * @param fd The file descriptor of the socket.
+   * @return The options, or std::nullopt if @p fd is not a socket.
+   */
+  std::optional<SocketOptions> GetSocketOptions(int fd);
 
 }  // namespace ucommon
 
@@ -0,0 +1,107 @@
+/**
+ * @file stats.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace utils
+{
+
+  LatencyHistogram::LatencyHistogram(const LatencyHistogram& other)
+  {
+    merge(other);
+  }
+
+  LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other)
+  {
+      if (this != &other) {
+        reset();
+        merge(other);
+    }
+    return *this;
+  }
+
+  void LatencyHistogram::record(uint64_t nanoseconds) noexcept
+  {
+    bump(m_buckets[bucket_of(nanoseconds)]);
+    bump(m_count);
+    bump(m_sum, nanoseconds);
+    if (nanoseconds < m_min.load(std::memory_order_relaxed)) m_min.store(nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > m_max.load(std::memory_order_relaxed)) m_max.store(nanoseconds, std::memory_order_relaxed);
+  }
+
+  void LatencyHistogram::merge(const LatencyHistogram& other) noexcept
+  {
+      for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        uint64_t hits = other.m_buckets[bucket].load(std::memory_order_relaxed);
+        if (hits != 0) bump(m_buckets[bucket], hits);
+      }
+    bump(m_count, other.m_count.load(std::memory_order_relaxed));
+    bump(m_sum, other.m_sum.load(std::memory_order_relaxed));
+    auto low = std::min(m_min.load(std::memory_order_relaxed), other.m_min.load(std::memory_order_relaxed));
+    auto high = std::max(m_max.load(std::memory_order_relaxed), other.m_max.load(std::memory_order_relaxed));
+    m_min.store(low, std::memory_order_relaxed);
+    m_max.store(high, std::memory_order_relaxed);
+  }
+
+  void LatencyHistogram::reset() noexcept
+  {
+    for (auto& bucket: m_buckets) bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(UINT64_MAX, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t LatencyHistogram::min() const noexcept
+  {
+    return count() == 0 ? 0 : m_min.load(std::memory_order_relaxed);
+  }
+
+  double LatencyHistogram::mean() const noexcept
+  {
+    uint64_t total = count();
+    return total == 0 ? 0.0 : static_cast<double>(m_sum.load(std::memory_order_relaxed)) / total;
+  }
+
+  uint64_t LatencyHistogram::percentile(double percentile) const noexcept
+  {
+    // The buckets are read one by one while the writer goes on, so rank against their own sum
+    uint64_t total = 0;
+    for (const auto& bucket: m_buckets) total += bucket.load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+    percentile = std::clamp(percentile, 0.0, 100.0);
+    auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+      for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += m_buckets[bucket].load(std::memory_order_relaxed);
+        // The last bucket also takes everything out of range, its bound means nothing
+        if (seen >= rank) return bucket + 1 < kBuckets ? std::min(upper_bound(bucket), max()) : max();
+      }
+    return max();
+  }
+
+  size_t LatencyHistogram::bucket_of(uint64_t value) noexcept
+  {
+    if (value < kSubBuckets) return static_cast<size_t>(value);
+    unsigned magnitude = 63 - __builtin_clzll(value);
+    if (magnitude >= kMaxBits) return kBuckets - 1;
+    unsigned shift = magnitude - kSubBits;
+    return static_cast<size_t>((shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets));
+  }
+
+  uint64_t LatencyHistogram::upper_bound(size_t bucket) noexcept
+  {
+    if (bucket < kSubBuckets) return bucket;
+    unsigned shift = static_cast<unsigned>(bucket / kSubBuckets) - 1;
+    uint64_t lower = (kSubBuckets + bucket % kSubBuckets) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+  }
+
+}  // namespace utils
@@ -0,0 +1,150 @@
+/**
+ * @file stats.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Low-overhead latency histograms and per-thread statistics
+ * @brief Writers update their own thread's copy without contention, readers merge all copies on demand
+ * @version 0.1
+ * @date 2024-12-28
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_STATS_HPP
+#define UFW_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @brief Adds to a counter that only one thread writes, without a locked instruction.
+   */
+  inline void bump(std::atomic<uint64_t>& counter, uint64_t value = 1) noexcept
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  /**
+   * @class LatencyHistogram
+   * @brief HDR-style histogram of durations in nanoseconds.
+   *
+   * Values below 32 get a bucket each, every next power of two is split into 32 buckets, so a
+   * percentile is off by at most 1/32 (3%) whatever the magnitude. Covers up to 2^40 ns (18 min),
+   * longer values land in the last bucket. record() is meant for one writer thread, readers on
+   * other threads may copy or merge it at any time and see a slightly stale state.
+   */
+  class LatencyHistogram
+  {
+  public:
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram& other);
+    LatencyHistogram& operator=(const LatencyHistogram& other);
+
+    void record(uint64_t nanoseconds) noexcept;
+    void merge(const LatencyHistogram& other) noexcept;
+    void reset() noexcept;
+
+    uint64_t count() const noexcept
+    {
+      return m_count.load(std::memory_order_relaxed);
+    }
+    uint64_t min() const noexcept;
+    uint64_t max() const noexcept
+    {
+      return m_max.load(std::memory_order_relaxed);
+    }
+    double mean() const noexcept;
+    /**
+     * @brief Smallest value that @p percentile percent of the recorded values don't exceed
+     * (bucket's upper bound, capped by max()). 0 if nothing was recorded.
+     */
+    uint64_t percentile(double percentile) const noexcept;
+
+  private:
+    static constexpr unsigned kSubBits = 5;
+    static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBits;
+    static constexpr unsigned kMaxBits = 40;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+    std::array<std::atomic<uint64_t>, kBuckets> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_min{UINT64_MAX};
+    std::atomic<uint64_t> m_max{0};
+
+    static size_t bucket_of(uint64_t value) noexcept;
+    static uint64_t upper_bound(size_t bucket) noexcept;
+  };
+
+  /**
+   * @class PerThread
+   * @brief One T for every thread that asked for it, kept until reset() so the data of finished
+   * threads still counts.
+   *
+   * local() finds the calling thread's copy in a short thread_local list, only the first call of a
+   * thread takes the lock. T must be safe to read while its thread updates it (atomics, see bump()).
+   */
+  template<typename T>
+  class PerThread
+  {
+  public:
+    PerThread(): m_id(next_id()) {}
+
+    PerThread(const PerThread&) = delete;
+    PerThread& operator=(const PerThread&) = delete;
+
+    T& local()
+    {
+      thread_local std::vector<std::pair<uint64_t, T*>> cache;
+      uint64_t id = m_id.load(std::memory_order_acquire);
+        for (auto& [owner, item]: cache) {
+          if (owner == id) return *item;
+        }
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_items.push_back(std::make_unique<T>());
+      // Entries of dead instances and old generations never match again, drop them on the way
+      if (cache.size() >= 16) cache.erase(cache.begin());
+      cache.emplace_back(id, m_items.back().get());
+      return *m_items.back();
+    }
+
+    template<typename F>
+    void forEach(F&& func) const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (const auto& item: m_items) func(*item);
+    }
+
+    /**
+     * @brief Drops every copy. No thread may hold a reference from local() across this call.
+     */
+    void reset()
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_items.clear();
+      m_id.store(next_id(), std::memory_order_release);
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<T>> m_items;
+    std::atomic<uint64_t> m_id;
+
+    static uint64_t next_id()
+    {
+      static std::atomic<uint64_t> counter{0};
+      return ++counter;
+    }
+  };
+
+}  // namespace utils
+
+#endif  // UFW_STATS_HPP
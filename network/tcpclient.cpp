@@ -5,37 +5,119 @@
  */
 #include "tcpclient.hpp"
 
-#include <arpa/inet.h>
+#include "../support/logger.hpp"
+#include "timingwheel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstring>
-#include <iostream>
 #include <string>
 #include <sys/socket.h>
 #include <unistd.h>
 
+namespace
+{
+  constexpr size_t kReceiveChunk = 64 * 1024;
+  constexpr size_t kKeptBuffer = 1024 * 1024;  // a larger buffer is released once empty
+
+  // Shuts the socket down once the timeout ran out since the start or the last restart(), which wakes a
+  // blocked recv() up
+  class ReadDeadline
+  {
+  public:
+    ReadDeadline(int sockfd, int timeout_ms): m_timeout(timeout_ms)
+    {
+      m_timer = utils::TimerThread::shared().runAfter(m_timeout, [this, sockfd]() {
+        m_expired = true;
+        shutdown(sockfd, SHUT_RDWR);
+      });
+    }
+    ~ReadDeadline()
+    {
+      cancel();
+    }
+
+    void restart()
+    {
+      utils::TimerThread::shared().restart(m_timer, m_timeout);
+    }
+    // Waits for a callback already running, it must not touch the socket once it is closed
+    void cancel()
+    {
+      if (m_timer != 0) utils::TimerThread::shared().cancel(m_timer);
+      m_timer = 0;
+    }
+    bool expired() const
+    {
+      return m_expired;
+    }
+
+  private:
+    std::chrono::milliseconds m_timeout;
+    utils::TimerThread::TimerId m_timer{0};
+    std::atomic<bool> m_expired{false};
+  };
+}  // namespace
+
 bool TcpClient::connect(const std::string& ip, uint16_t port)
 {
-  m_sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_sockfd == -1) {
-      std::cerr << "Error creating socket\n";
+  auto address = utils::SocketAddress::ip(ip, port);
+    if (!address) {
+      UFW_LOG_ERROR("Invalid address");
       return false;
   }
+  return connect(*address);
+}
 
-  sockaddr_in server_addr{};
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(port);
-    if (inet_pton(AF_INET, ip.c_str(), &server_addr.sin_addr) <= 0) {
-      std::cerr << "Invalid address\n";
+bool TcpClient::connect(const utils::SocketAddress& address)
+{
+  disconnect();
+  m_in_begin = m_in_end = 0;
+  m_sockfd = socket(address.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+  m_unix = address.isUnix();
+    if (m_sockfd == -1) {
+      UFW_LOG_ERROR("Error creating socket");
       return false;
   }
+  // Refused options are logged, the connection goes on without them
+  m_tuning.apply(m_sockfd, utils::SocketTuning::Side::Client);
 
-    if (::connect(m_sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-      std::cerr << "Connection failed\n";
+    if (::connect(m_sockfd, address.data(), address.size()) < 0) {
+      UFW_LOG_ERROR("Connection to ", address.toString(), " failed. Errno: ", utils::Errno{errno});
+      disconnect();
       return false;
   }
 
   return true;
 }
 
+bool TcpClient::isConnected() const
+{
+  if (m_sockfd == -1) return false;
+  if (!m_unix) return ucommon::IsTcpConnected(m_sockfd);
+  // No TCP state to ask for, a closed peer shows as end of stream
+  char byte;
+  ssize_t peeked = recv(m_sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return (peeked > 0) || ((peeked < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)));
+}
+
+void TcpClient::setSocketTuning(utils::SocketTuning tuning)
+{
+  m_tuning = std::move(tuning);
+}
+
+std::optional<ucommon::SocketOptions> TcpClient::socketOptions() const
+{
+  if (m_sockfd == -1) return std::nullopt;
+  return ucommon::GetSocketOptions(m_sockfd);
+}
+
+void TcpClient::setFramer(std::shared_ptr<const utils::IFramer> framer)
+{
+  m_framer = std::move(framer);
+}
+
 void TcpClient::disconnect()
 {
     if (m_sockfd != -1) {
@@ -57,50 +139,156 @@ bool TcpClient::send(const std::vector<uint8_t>& data)
 bool TcpClient::sendData(const uint8_t* data, size_t size)
 {
     if (m_sockfd == -1) {
-      std::cerr << "Socket is not connected\n";
+      UFW_LOG_WARN("Socket is not connected");
       return false;
   }
 
-  ssize_t sent = ::send(m_sockfd, data, size, 0);
-    if (sent == -1) {
-      std::cerr << "Failed to send data\n";
-      return false;
-  }
+    while (size > 0) {
+      ssize_t sent = ::send(m_sockfd, data, size, 0);
+      if ((sent == -1) && (errno == EINTR)) continue;
+        if (sent == -1) {
+          UFW_LOG_WARN("Failed to send data");
+          return false;
+      }
+      data += sent;
+      size -= static_cast<size_t>(sent);
+    }
   return true;
 }
 
+bool TcpClient::send_request(const std::string& data)
+{
+  if (!m_framer) return send(data);
+  m_out.clear();
+  m_framer->encode(data, m_out);
+  return sendData(reinterpret_cast<const uint8_t*>(m_out.data()), m_out.size());
+}
+
 std::optional<std::string> TcpClient::request(const std::string& data, int timeout_ms)
 {
-  std::cout << "TcpClient::request : " << data << std::endl;
-    if (!send(data)) {
+  UFW_LOG_DEBUG("TcpClient::request : ", data);
+    if (!send_request(data)) {
       return std::nullopt;
   }
 
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(m_sockfd, &readfds);
+  std::optional<std::string> response;
+  bool complete = receive(timeout_ms, false, [&response](std::string_view chunk) {
+    response.emplace(chunk);
+    return false;
+  });
+  if (!complete || !response) return std::nullopt;
+    if (!m_framer) {
+      // No boundaries, bytes that already arrived as well belong to the response
+        while (read_some(MSG_DONTWAIT) > 0) {
+          response->append(m_in.data() + m_in_begin, m_in_end - m_in_begin);
+          m_in_begin = m_in_end;
+        }
+  }
+  UFW_LOG_DEBUG("TcpClient::response : ", *response);
+  return response;
+}
 
-  timeval tv{};
-  tv.tv_sec = timeout_ms / 1000;
-  tv.tv_usec = (timeout_ms % 1000) * 1000;
+bool TcpClient::requestStream(const std::string& data, int timeout_ms, const ChunkHandler& on_chunk)
+{
+  UFW_LOG_DEBUG("TcpClient::requestStream : ", data);
+  if (!send_request(data)) return false;
+  return receive(timeout_ms, true, on_chunk);
+}
 
-  int retval = select(m_sockfd + 1, &readfds, nullptr, nullptr, &tv);
-    if (retval == -1) {
-      std::cerr << "Select error\n";
-      return std::nullopt;
-    } else if (retval == 0) {
-      std::cerr << "Timeout waiting for response\n";
-      return std::nullopt;
+bool TcpClient::receive(int timeout_ms, bool per_chunk, const ChunkHandler& on_chunk)
+{
+  enum class End
+  {
+    Done,
+    Closed,
+    Failed,
+    Malformed
+  };
+
+  ReadDeadline deadline(m_sockfd, timeout_ms);
+  End end = End::Failed;
+    for (;;) {
+      // Chunks buffered by earlier reads first
+      bool done = false;
+      bool malformed = false;
+        while (!done && (m_in_begin < m_in_end)) {
+          std::string_view buffered(m_in.data() + m_in_begin, m_in_end - m_in_begin);
+            if (!m_framer) {
+              m_in_begin = m_in_end;
+              done = !on_chunk(buffered);
+              continue;
+          }
+          utils::IFramer::Frame frame;
+          auto status = m_framer->next(buffered, frame);
+          if (status == utils::IFramer::Status::Incomplete) break;
+            if (status == utils::IFramer::Status::Error) {
+              malformed = true;
+              break;
+          }
+          m_in_begin += frame.consumed;
+          done = !on_chunk(frame.payload);
+        }
+        if (done || malformed) {
+          end = done ? End::Done : End::Malformed;
+          break;
+      }
+
+      ssize_t received = read_some(0);
+        if (received > 0) {
+          // A stream may take any time as long as it keeps moving, a response has to be done in time
+          if (per_chunk) deadline.restart();
+          continue;
+      }
+      end = (received == 0) ? End::Closed : End::Failed;
+      break;
+    }
+  deadline.cancel();
+
+    if (end == End::Done) {
+      // Got it just before the timer shut the socket down
+      if (deadline.expired()) disconnect();
+      return true;
   }
-  std::string response;
-  char buffer[1024] = {0};
-  ssize_t received = recv(m_sockfd, buffer, sizeof(buffer) - 1, 0);
-    if (received == -1) {
-      std::cerr << "Failed to receive data\n";
-      return std::nullopt;
+    if (deadline.expired()) {
+      UFW_LOG_WARN("Timeout waiting for response");
+      disconnect();
+      return false;
+  }
+    if (end == End::Malformed) {
+      UFW_LOG_WARN("Response violates the framing, closing connection");
+      disconnect();
+      return false;
+  }
+    if (end == End::Failed) {
+      UFW_LOG_WARN("Failed to receive data");
+      return false;
   }
+  // The server closed the connection, fine between chunks
+  bool clean = (m_in_begin == m_in_end);
+  disconnect();
+  return clean;
+}
 
-  response.assign(buffer, received);
-  std::cout << "TcpClient::response : " << data << std::endl;
-  return response;
-}
\ No newline at end of file
+ssize_t TcpClient::read_some(int flags)
+{
+    if (m_in_begin == m_in_end) {
+      m_in_begin = m_in_end = 0;
+        if (m_in.size() > kKeptBuffer) {
+          m_in.resize(kReceiveChunk);
+          m_in.shrink_to_fit();
+      }
+  }
+    if ((m_in.size() - m_in_end < kReceiveChunk / 4) && (m_in_begin > 0)) {
+      // Room for the rest of a frame at the end of the buffer
+      std::memmove(m_in.data(), m_in.data() + m_in_begin, m_in_end - m_in_begin);
+      m_in_end -= m_in_begin;
+      m_in_begin = 0;
+  }
+  if (m_in.size() - m_in_end < kReceiveChunk / 4) m_in.resize(std::max(kReceiveChunk, 2 * m_in.size()));
+  char* tail = m_in.data() + m_in_end;
+  size_t room = m_in.size() - m_in_end;
+  ssize_t received = recv(m_sockfd, tail, room, flags);
+  while ((received == -1) && (errno == EINTR)) received = recv(m_sockfd, tail, room, flags);
+  if (received > 0) m_in_end += static_cast<size_t>(received);
+  return received;
+}
@@ -2,7 +2,8 @@
  * @file tcpclient.hpp
  * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
  * @brief Simple TCP client implementation for network communications
- * @brief Provides basic TCP socket operations like connect, send and receive data
+ * @brief Provides basic TCP socket operations like connect, send and receive data, over IPv4, IPv6 or
+ *        unix domain stream sockets
  * @version 0.1
  * @date 2017-11-23
  *
@@ -13,14 +14,29 @@
 #ifndef UFW_SIMPLE_TCPCLIENT_HPP
 #define UFW_SIMPLE_TCPCLIENT_HPP
 
+#include "framer.hpp"
+#include "socketaddress.hpp"
+#include "sockettuning.hpp"
+#include "sockutils.hpp"
+
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <sys/types.h>
 #include <vector>
 
 class TcpClient
 {
 public:
+  /**
+   * @brief Gets every chunk of a streamed response, returns false once it has the whole response.
+   * The chunk is valid during the call only.
+   */
+  using ChunkHandler = std::function<bool(std::string_view chunk)>;
+
   TcpClient(): m_sockfd(-1) {}
 
   ~TcpClient()
@@ -28,15 +44,66 @@ public:
     disconnect();
   }
 
+  /**
+   * @brief Connects to a numeric IPv4 or IPv6 address.
+   */
   bool connect(const std::string& ip, uint16_t port);
+  bool connect(const utils::SocketAddress& address);
   void disconnect();
+  /**
+   * @brief Whether the connection is still up: established for TCP (ucommon::IsTcpConnected(), a
+   * peer that closed its end is not), not closed by the peer for unix sockets. One syscall.
+   */
+  [[nodiscard]]
+  bool isConnected() const;
+  /**
+   * @brief Socket options set by the next connect(), none by default.
+   * With utils::SocketTuning::fast_open_queue the request data rides in the SYN of a repeated
+   * connect to the same server.
+   */
+  void setSocketTuning(utils::SocketTuning tuning);
+  /**
+   * @brief Options in effect on the connection, std::nullopt while not connected.
+   */
+  [[nodiscard]]
+  std::optional<ucommon::SocketOptions> socketOptions() const;
+  /**
+   * @brief Framing of request() and requestStream(), the one the server uses (e.g. the same
+   * utils::LengthPrefixFramer or utils::DelimiterFramer). nullptr (the default) sends requests as they
+   * are and takes whatever arrived by the end of the first read as the response.
+   */
+  void setFramer(std::shared_ptr<const utils::IFramer> framer);
   bool send(const std::string& data);
   bool send(const std::vector<uint8_t>& data);
+  /**
+   * @brief Sends @p data and waits up to @p timeout_ms for the response, one frame when a framer is set.
+   * The deadline lives on the shared utils::TimerThread, so any fd number works (unlike select()).
+   * A timed out connection is closed: its late response would be taken for the next one, as is one
+   * violating the framing.
+   */
   std::optional<std::string> request(const std::string& data, int timeout_ms);
+  /**
+   * @brief Sends @p data and hands the response to @p on_chunk as it arrives: frame by frame when a
+   * framer is set, read by read otherwise. Memory stays at one frame or one read whatever the length
+   * of the response. @p timeout_ms bounds the wait for every chunk, not the whole response.
+   * @return true once @p on_chunk returned false or the server closed the connection between chunks.
+   */
+  bool requestStream(const std::string& data, int timeout_ms, const ChunkHandler& on_chunk);
 
 private:
   int m_sockfd;
+  bool m_unix{false};
+  utils::SocketTuning m_tuning;
+  std::shared_ptr<const utils::IFramer> m_framer;
+  std::string m_out;  // framed request, reused
+  std::vector<char> m_in;  // receive buffer, reused, grows to the largest frame
+  size_t m_in_begin{0};
+  size_t m_in_end{0};
+
   bool sendData(const uint8_t* data, size_t size);
+  bool send_request(const std::string& data);
+  bool receive(int timeout_ms, bool per_chunk, const ChunkHandler& on_chunk);
+  ssize_t read_some(int flags);
 };
 
 #endif  // UFW_SIMPLE_TCPCLIENT_HPP
\ No newline at end of file
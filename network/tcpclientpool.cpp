@@ -0,0 +1,296 @@
+/**
+ * @file tcpclientpool.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "tcpclientpool.hpp"
+
+#include "../support/logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  size_t hash_address(const utils::SocketAddress& address)
+  {
+    // FNV-1a over the sockaddr bytes
+    uint64_t hash = 14695981039346656037ull;
+    auto bytes = reinterpret_cast<const unsigned char*>(address.data());
+      for (socklen_t i = 0; i < address.size(); ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+      }
+    return static_cast<size_t>(hash);
+  }
+
+  bool same_address(const utils::SocketAddress& left, const utils::SocketAddress& right)
+  {
+    return (left.size() == right.size()) && (std::memcmp(left.data(), right.data(), left.size()) == 0);
+  }
+}  // namespace
+
+TcpClientPool::TcpClientPool(): TcpClientPool(Options{}) {}
+
+TcpClientPool::TcpClientPool(Options options): m_options(std::move(options))
+{
+  m_options.max_idle = std::max<size_t>(1, m_options.max_idle);
+  m_options.min_idle = std::min(m_options.min_idle, m_options.max_idle);
+  m_options.max_endpoints = std::max<size_t>(1, m_options.max_endpoints);
+  // At most half full, probe sequences stay short
+  size_t table_size = 1;
+  while (table_size < 2 * m_options.max_endpoints) table_size <<= 1;
+  m_table_mask = table_size - 1;
+  m_table.reset(new std::atomic<Endpoint*>[table_size]);
+  for (size_t i = 0; i < table_size; ++i) m_table[i].store(nullptr, std::memory_order_relaxed);
+  m_maintenance = std::thread([this]() { maintenance_loop(); });
+}
+
+TcpClientPool::~TcpClientPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_maintenance_mutex);
+    m_stopping = true;
+  }
+  m_maintenance_cv.notify_all();
+  m_maintenance.join();
+    for (size_t i = 0; i <= m_table_mask; ++i) {
+      Endpoint* endpoint = m_table[i].load(std::memory_order_acquire);
+      if (!endpoint) continue;
+      for (size_t slot = 0; slot < m_options.max_idle; ++slot) delete endpoint->slots[slot].exchange(nullptr);
+      delete endpoint;
+    }
+}
+
+utils::SocketTuning TcpClientPool::keepaliveTuning()
+{
+  auto tuning = utils::SocketTuning::defaults();
+  tuning.keepalive = utils::SocketTuning::Keepalive{std::chrono::seconds(30), std::chrono::seconds(10), 3};
+  return tuning;
+}
+
+TcpClientPool::Lease TcpClientPool::lease(const utils::SocketAddress& address)
+{
+  m_leases.fetch_add(1, std::memory_order_relaxed);
+  Endpoint* endpoint = find_endpoint(address);
+  if (!endpoint) return Lease{};
+    while (Connection* connection = take_idle(*endpoint)) {
+        if (connection->client.isConnected()) {
+          m_reused.fetch_add(1, std::memory_order_relaxed);
+          return Lease(this, endpoint, connection);
+      }
+      m_broken.fetch_add(1, std::memory_order_relaxed);
+      delete connection;
+    }
+  Connection* connection = connect(address);
+  if (!connection) return Lease{};
+  return Lease(this, endpoint, connection);
+}
+
+void TcpClientPool::clear()
+{
+    for (size_t i = 0; i <= m_table_mask; ++i) {
+      Endpoint* endpoint = m_table[i].load(std::memory_order_acquire);
+      if (!endpoint) continue;
+        while (Connection* connection = take_idle(*endpoint)) {
+          m_closed_idle.fetch_add(1, std::memory_order_relaxed);
+          delete connection;
+        }
+    }
+}
+
+TcpClientPool::Stats TcpClientPool::stats() const
+{
+  Stats stats;
+  stats.leases = m_leases.load(std::memory_order_relaxed);
+  stats.reused = m_reused.load(std::memory_order_relaxed);
+  stats.connects = m_connects.load(std::memory_order_relaxed);
+  stats.connect_failures = m_connect_failures.load(std::memory_order_relaxed);
+  stats.broken = m_broken.load(std::memory_order_relaxed);
+  stats.closed_idle = m_closed_idle.load(std::memory_order_relaxed);
+  stats.endpoints = m_endpoints.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= m_table_mask; ++i) {
+      Endpoint* endpoint = m_table[i].load(std::memory_order_acquire);
+      if (endpoint) stats.idle += endpoint->idle.load(std::memory_order_relaxed);
+    }
+  return stats;
+}
+
+TcpClientPool::Endpoint* TcpClientPool::find_endpoint(const utils::SocketAddress& address)
+{
+  size_t index = hash_address(address) & m_table_mask;
+  Endpoint* created = nullptr;
+    for (size_t probe = 0; probe <= m_table_mask; ++probe, index = (index + 1) & m_table_mask) {
+      Endpoint* endpoint = m_table[index].load(std::memory_order_acquire);
+        if (endpoint) {
+            if (same_address(endpoint->address, address)) {
+              // Another thread inserted it after this one reserved a slot, at this index or an earlier one
+                if (created) {
+                  m_endpoints.fetch_sub(1, std::memory_order_relaxed);
+                  delete created;
+              }
+              return endpoint;
+          }
+          continue;
+      }
+        if (!created) {
+            if (m_endpoints.fetch_add(1, std::memory_order_relaxed) >= m_options.max_endpoints) {
+              m_endpoints.fetch_sub(1, std::memory_order_relaxed);
+              UFW_LOG_WARN("Connection pool is full, no room for ", address.toString());
+              return nullptr;
+          }
+          created = new Endpoint{address, std::make_unique<std::atomic<Connection*>[]>(m_options.max_idle), {0}};
+      }
+      // Losing the race means another thread put an endpoint here, which may be this one
+      if (m_table[index].compare_exchange_strong(endpoint, created, std::memory_order_acq_rel)) return created;
+      if (same_address(endpoint->address, address)) break;
+    }
+  // A concurrent insert of the same address won the slot, the reservation was for nothing
+    if (created) {
+      m_endpoints.fetch_sub(1, std::memory_order_relaxed);
+      delete created;
+  }
+  Endpoint* endpoint = m_table[index].load(std::memory_order_acquire);
+  return (endpoint && same_address(endpoint->address, address)) ? endpoint : nullptr;
+}
+
+TcpClientPool::Connection* TcpClientPool::take_idle(Endpoint& endpoint)
+{
+  if (endpoint.idle.load(std::memory_order_relaxed) == 0) return nullptr;
+    for (size_t slot = 0; slot < m_options.max_idle; ++slot) {
+      if (!endpoint.slots[slot].load(std::memory_order_relaxed)) continue;
+      Connection* connection = endpoint.slots[slot].exchange(nullptr, std::memory_order_acquire);
+        if (connection) {
+          endpoint.idle.fetch_sub(1, std::memory_order_relaxed);
+          return connection;
+      }
+    }
+  return nullptr;
+}
+
+bool TcpClientPool::put_idle(Endpoint& endpoint, Connection* connection)
+{
+    for (size_t slot = 0; slot < m_options.max_idle; ++slot) {
+      Connection* empty = nullptr;
+        if (endpoint.slots[slot].compare_exchange_strong(empty, connection, std::memory_order_release,
+                                                         std::memory_order_relaxed)) {
+          endpoint.idle.fetch_add(1, std::memory_order_relaxed);
+          return true;
+      }
+    }
+  return false;
+}
+
+TcpClientPool::Connection* TcpClientPool::connect(const utils::SocketAddress& address)
+{
+  auto connection = std::make_unique<Connection>();
+  connection->client.setSocketTuning(m_options.tuning);
+    if (!connection->client.connect(address)) {
+      m_connect_failures.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+  }
+  m_connects.fetch_add(1, std::memory_order_relaxed);
+  return connection.release();
+}
+
+void TcpClientPool::release(Endpoint* endpoint, Connection* connection, bool broken)
+{
+    if (broken || !connection->client.isConnected()) {
+      m_broken.fetch_add(1, std::memory_order_relaxed);
+      delete connection;
+      return;
+  }
+  connection->idle_since = Clock::now();
+    if (!put_idle(*endpoint, connection)) {
+      m_closed_idle.fetch_add(1, std::memory_order_relaxed);
+      delete connection;
+  }
+}
+
+void TcpClientPool::maintain(Endpoint& endpoint)
+{
+  // One connection out of its slot at a time and put back right after its check, leases meanwhile
+  // find the others instead of connecting
+  auto now = Clock::now();
+    for (size_t slot = 0; slot < m_options.max_idle; ++slot) {
+      if (!endpoint.slots[slot].load(std::memory_order_relaxed)) continue;
+      Connection* connection = endpoint.slots[slot].exchange(nullptr, std::memory_order_acquire);
+      if (!connection) continue;
+      endpoint.idle.fetch_sub(1, std::memory_order_relaxed);
+        if (!connection->client.isConnected()) {
+          m_broken.fetch_add(1, std::memory_order_relaxed);
+          delete connection;
+          continue;
+      }
+      // Expired ones go while the others still make min_idle
+        if ((m_options.idle_timeout.count() > 0) && (now - connection->idle_since > m_options.idle_timeout) &&
+            (endpoint.idle.load(std::memory_order_relaxed) >= m_options.min_idle)) {
+          m_closed_idle.fetch_add(1, std::memory_order_relaxed);
+          delete connection;
+          continue;
+      }
+      Connection* empty = nullptr;
+        if (endpoint.slots[slot].compare_exchange_strong(empty, connection, std::memory_order_release,
+                                                         std::memory_order_relaxed)) {
+          endpoint.idle.fetch_add(1, std::memory_order_relaxed);
+      } else if (!put_idle(endpoint, connection)) {
+          m_closed_idle.fetch_add(1, std::memory_order_relaxed);
+          delete connection;
+      }
+    }
+    while (endpoint.idle.load(std::memory_order_relaxed) < m_options.min_idle) {
+      Connection* connection = connect(endpoint.address);
+      if (!connection) break;
+      connection->idle_since = Clock::now();
+        if (!put_idle(endpoint, connection)) {
+          delete connection;
+          break;
+      }
+    }
+}
+
+void TcpClientPool::maintenance_loop()
+{
+  std::unique_lock<std::mutex> lock(m_maintenance_mutex);
+    while (!m_maintenance_cv.wait_for(lock, m_options.maintenance_interval, [this]() { return m_stopping; })) {
+      lock.unlock();
+        for (size_t i = 0; i <= m_table_mask; ++i) {
+          Endpoint* endpoint = m_table[i].load(std::memory_order_acquire);
+          if (endpoint) maintain(*endpoint);
+        }
+      lock.lock();
+    }
+}
+
+TcpClientPool::Lease::Lease(Lease&& other) noexcept:
+    m_pool(other.m_pool), m_endpoint(other.m_endpoint), m_connection(other.m_connection), m_broken(other.m_broken)
+{
+  other.m_connection = nullptr;
+}
+
+TcpClientPool::Lease& TcpClientPool::Lease::operator=(Lease&& other) noexcept
+{
+    if (this != &other) {
+      release();
+      m_pool = other.m_pool;
+      m_endpoint = other.m_endpoint;
+      m_connection = other.m_connection;
+      m_broken = other.m_broken;
+      other.m_connection = nullptr;
+  }
+  return *this;
+}
+
+TcpClientPool::Lease::~Lease()
+{
+  release();
+}
+
+void TcpClientPool::Lease::release()
+{
+  if (!m_connection) return;
+  m_pool->release(m_endpoint, m_connection, m_broken);
+  m_connection = nullptr;
+  m_broken = false;
+}
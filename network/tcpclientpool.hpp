@@ -0,0 +1,185 @@
+/**
+ * @file tcpclientpool.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Pool of connected TcpClients per server address
+ * @brief Lock-free leasing of idle connections checked before reuse, kept warm and evicted by a maintenance thread
+ * @version 0.1
+ * @date 2025-03-22
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_TCPCLIENTPOOL_HPP
+#define UFW_TCPCLIENTPOOL_HPP
+
+#include "socketaddress.hpp"
+#include "sockettuning.hpp"
+#include "tcpclient.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @class TcpClientPool
+ * @brief Hands out connected TcpClients by server address and takes them back for the next caller,
+ * so bursts of calls don't pay a connect each and leave no TIME_WAIT sockets behind.
+ *
+ * Nothing is connected before the first lease of an address. Every address (endpoint) keeps up to
+ * max_idle connections in slots taken and filled with atomic exchanges, a lease finding one takes
+ * no lock; only connecting a new one goes to the kernel for more than a liveness check. A connection
+ * taken from the pool is checked with TcpClient::isConnected() first, those the server closed
+ * meanwhile are dropped and the next one is tried.
+ *
+ * A maintenance thread closes connections that were idle for longer than idle_timeout (beyond the
+ * first min_idle of an endpoint) and those that broke while idle, then connects up to min_idle idle
+ * connections for every endpoint used so far. TCP keepalive (on by default) lets the kernel notice
+ * servers that went away without closing. Thread-safe.
+ */
+class TcpClientPool
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options
+  {
+    size_t min_idle{0};  // per endpoint, kept connected once the endpoint was used
+    size_t max_idle{16};  // per endpoint, connections returned beyond that are closed
+    std::chrono::milliseconds idle_timeout{60000};  // 0 keeps idle connections until they break
+    std::chrono::milliseconds maintenance_interval{1000};
+    size_t max_endpoints{256};  // endpoints are kept for the lifetime of the pool
+    utils::SocketTuning tuning{keepaliveTuning()};  // set on every connection before connect()
+  };
+
+  struct Stats
+  {
+    uint64_t leases{0};
+    uint64_t reused{0};  // leases served by an idle connection
+    uint64_t connects{0};
+    uint64_t connect_failures{0};
+    uint64_t broken{0};  // found dead when leased or by maintenance, or returned broken
+    uint64_t closed_idle{0};  // idle for too long or beyond max_idle
+    uint64_t idle{0};  // connections waiting in the pool now
+    uint64_t endpoints{0};
+  };
+
+  class Lease;
+
+  TcpClientPool();
+  explicit TcpClientPool(Options options);
+  ~TcpClientPool();
+
+  TcpClientPool(const TcpClientPool&) = delete;
+  TcpClientPool& operator=(const TcpClientPool&) = delete;
+
+  /**
+   * @brief TCP_NODELAY and keepalive probing after 30 s idle, dead peers are found within a minute.
+   */
+  static utils::SocketTuning keepaliveTuning();
+
+  /**
+   * @brief A connection to @p address, idle or new. Empty (false) if connecting failed or the
+   * endpoint table is full. Leases of an endpoint aren't limited, only the idle ones are.
+   */
+  Lease lease(const utils::SocketAddress& address);
+
+  /**
+   * @brief Closes every idle connection. Leased ones come back as usual.
+   */
+  void clear();
+
+  [[nodiscard]]
+  Stats stats() const;
+
+private:
+  struct Connection
+  {
+    TcpClient client;
+    Clock::time_point idle_since;
+  };
+
+  struct Endpoint
+  {
+    utils::SocketAddress address;
+    std::unique_ptr<std::atomic<Connection*>[]> slots;
+    std::atomic<size_t> idle{0};
+  };
+
+  Options m_options;
+  size_t m_table_mask;
+  std::unique_ptr<std::atomic<Endpoint*>[]> m_table;  // open addressing, insert-only
+  std::atomic<size_t> m_endpoints{0};
+
+  std::atomic<uint64_t> m_leases{0};
+  std::atomic<uint64_t> m_reused{0};
+  std::atomic<uint64_t> m_connects{0};
+  std::atomic<uint64_t> m_connect_failures{0};
+  std::atomic<uint64_t> m_broken{0};
+  std::atomic<uint64_t> m_closed_idle{0};
+
+  std::mutex m_maintenance_mutex;
+  std::condition_variable m_maintenance_cv;
+  bool m_stopping{false};
+  std::thread m_maintenance;
+
+  Endpoint* find_endpoint(const utils::SocketAddress& address);
+  Connection* take_idle(Endpoint& endpoint);
+  bool put_idle(Endpoint& endpoint, Connection* connection);
+  Connection* connect(const utils::SocketAddress& address);
+  void release(Endpoint* endpoint, Connection* connection, bool broken);
+  void maintain(Endpoint& endpoint);
+  void maintenance_loop();
+};
+
+/**
+ * @brief A connection leased from a TcpClientPool, returned to it when the lease goes away.
+ * Mark it broken after an error (a failed or timed out request) to have it closed instead.
+ */
+class TcpClientPool::Lease
+{
+public:
+  Lease() = default;
+  Lease(Lease&& other) noexcept;
+  Lease& operator=(Lease&& other) noexcept;
+  ~Lease();
+
+  explicit operator bool() const noexcept
+  {
+    return m_connection != nullptr;
+  }
+  TcpClient* operator->() const noexcept
+  {
+    return &m_connection->client;
+  }
+  TcpClient& operator*() const noexcept
+  {
+    return m_connection->client;
+  }
+
+  void markBroken() noexcept
+  {
+    m_broken = true;
+  }
+  /**
+   * @brief Returns the connection now, the lease is empty afterwards.
+   */
+  void release();
+
+private:
+  friend class TcpClientPool;
+
+  Lease(TcpClientPool* pool, Endpoint* endpoint, Connection* connection) noexcept:
+      m_pool(pool), m_endpoint(endpoint), m_connection(connection)
+  {}
+
+  TcpClientPool* m_pool{nullptr};
+  Endpoint* m_endpoint{nullptr};
+  Connection* m_connection{nullptr};
+  bool m_broken{false};
+};
+
+#endif  // UFW_TCPCLIENTPOOL_HPP
@@ -6,61 +6,549 @@
 
 #include "tcpserver.hpp"
 
+#include "iouring.hpp"
+#include "../support/logger.hpp"
 #include "threadpool.hpp"
 
-#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <future>
+#include <iomanip>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <optional>
+#include <poll.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unordered_map>
 
-bool TcpServer::start(int port)
+namespace
 {
-    if (m_running) {
-      return true;  // it's already running
+  constexpr size_t kReadChunk = 16 * 1024;     // receive block size
+  constexpr size_t kMinReadRoom = 4 * 1024;  // less room than this left in a block moves the tail to a new one
+  constexpr size_t kMaxPendingOutput = 1024 * 1024;  // stop reading a client that doesn't read its responses
+  constexpr int kMaxAcceptsPerWakeup = 64;
+  constexpr size_t kClientPoolThreads = 30;  // Blocking mode, one connection per thread at a time
+  constexpr uint32_t kClientEvents = EPOLLIN | EPOLLRDHUP | EPOLLET;
+
+  constexpr unsigned kUringEntries = 4096;
+  constexpr uint16_t kUringBufferGroup = 0;
+  constexpr unsigned kUringBufferCount = 1024;
+  constexpr size_t kUringBufferSize = 16 * 1024;
+  constexpr int kSplicePipeSize = 1024 * 1024;  // asked for, pipes stay at 64 KiB above fs.pipe-max-size
+
+  enum UringOp : uint64_t
+  {
+    UringAccept = 1,
+    UringRecv = 2,
+    UringSend = 3,
+    UringWakeup = 4,
+    UringTimer = 5,
+    UringCancel = 6,
+    UringSpliceIn = 7,  // file region into the connection's pipe
+    UringSpliceOut = 8  // pipe into the socket, linked behind UringSpliceIn
+  };
+
+  // user_data layout: [op:8][generation:24][fd:32], the generation filters completions of a reused fd
+  uint64_t uring_tag(UringOp op, int fd = 0, uint32_t gen = 0)
+  {
+    return (static_cast<uint64_t>(op) << 56) | (static_cast<uint64_t>(gen & 0xFFFFFF) << 32) |
+           static_cast<uint32_t>(fd);
   }
-  m_port = port;
-  m_running = true;
 
-  // Create server socket
-  m_server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_server_fd < 0) {
-      std::cerr << "Failed to create socket. Errno: " << strerror(errno) << std::endl;
+  // Which timeout a connection is waiting on
+  enum class Deadline : uint8_t
+  {
+    None,  // the server's turn: requests are in flight
+    Idle,
+    Read,
+    Write
+  };
+
+  std::chrono::milliseconds timeout_of(const TcpServer::Timeouts& timeouts, Deadline deadline)
+  {
+      switch (deadline) {
+        case Deadline::Idle: return timeouts.idle;
+        case Deadline::Read: return timeouts.read;
+        case Deadline::Write: return timeouts.write;
+        default: return std::chrono::milliseconds(0);
+      }
+  }
+
+  const char* deadline_name(Deadline deadline)
+  {
+      switch (deadline) {
+        case Deadline::Idle: return "Idle";
+        case Deadline::Read: return "Read";
+        case Deadline::Write: return "Write";
+        default: return "No";
+      }
+  }
+
+  uint64_t nanos_since(std::chrono::steady_clock::time_point start)
+  {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    return static_cast<uint64_t>(std::max<int64_t>(0, elapsed.count()));
+  }
+
+  const char* result_name(size_t code)
+  {
+    static const char* const names[] = {"Success",         "SocketCreateError", "BindError",    "ListenError",
+                                        "AcceptError",     "SetSockOptError",   "ReceiveError", "SendError",
+                                        "AlreadyRunning", "NotRunning",        "InvalidPort"};
+    static_assert(sizeof(names) / sizeof(names[0]) == TcpServer::kResultCodes, "a TcpServerResult has no name");
+    return names[code];
+  }
+
+  void write_latency(std::ostream& out, const char* name, const utils::LatencyHistogram& histogram)
+  {
+    static const std::pair<const char*, double> quantiles[] = {
+            {"0.5", 50.0}, {"0.9", 90.0}, {"0.99", 99.0}, {"0.999", 99.9}};
+      for (const auto& [label, percentile]: quantiles) {
+        out << name << "_us{quantile=\"" << label << "\"} " << histogram.percentile(percentile) / 1000.0 << "\n";
+      }
+    out << name << "_us_max " << histogram.max() / 1000.0 << "\n";
+    out << name << "_us_mean " << histogram.mean() / 1000.0 << "\n";
+    out << name << "_count " << histogram.count() << "\n";
+  }
+
+  int socket_error(int fd)
+  {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) return errno;
+    return error;
+  }
+
+  // A socket file left by a process that died without stop(). A live listener keeps its file: bind fails
+  void remove_stale_socket(const utils::SocketAddress& address)
+  {
+    std::string path = address.path();
+    struct stat info{};
+    if (path.empty() || (lstat(path.c_str(), &info) < 0) || !S_ISSOCK(info.st_mode)) return;
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return;
+    bool stale = (connect(probe, address.data(), address.size()) < 0) && (errno == ECONNREFUSED);
+    close(probe);
+    if (stale) unlink(path.c_str());
+  }
+
+  // Closes an fd owned by a reactor callback once the callback is gone
+  struct ScopedFd
+  {
+    int fd{-1};
+
+    ~ScopedFd()
+    {
+      if (fd >= 0) close(fd);
+    }
+  };
+
+  // Shared by all copies of one Completion: delivers once, an empty response if nobody called it
+  struct CompletionState
+  {
+    std::function<void(utils::Response)> deliver;
+    std::atomic<bool> done{false};
+
+    ~CompletionState()
+    {
+      if (!done.load(std::memory_order_acquire)) deliver({});
+    }
+  };
+
+  TcpServer::Completion make_completion(std::function<void(utils::Response)> deliver)
+  {
+    auto state = std::make_shared<CompletionState>();
+    state->deliver = std::move(deliver);
+    return [state](utils::Response response) {
+      if (!state->done.exchange(true, std::memory_order_acq_rel)) state->deliver(std::move(response));
+    };
+  }
+}  // namespace
+
+/**
+ * @brief State of a connection served by a reactor. Owned by the reactor entry of its fd.
+ */
+struct TcpServer::Connection
+{
+  int fd{-1};
+  utils::EpollReactor* reactor{nullptr};
+  std::weak_ptr<utils::EpollReactor> reactor_ref;  // for completions that may outlive the server
+  utils::BlockBuffer in;
+  utils::OutputQueue out;
+  bool readable{false};
+  bool write_armed{false};
+  bool peer_closed{false};
+  bool closed{false};
+
+  // Pipelining: requests get sequence numbers, responses wait in the window until their turn
+  uint64_t next_seq{0};
+  uint64_t next_to_write{0};
+  size_t in_flight{0};
+  std::vector<std::optional<utils::Response>> window;
+
+  // Timeouts: one wheel timer re-armed when the awaited deadline changes or progress is made
+  utils::TimingWheel::TimerId timer{0};
+  Deadline deadline{Deadline::None};
+  uint64_t received{0};
+  uint64_t consumed{0};  // received bytes framed into requests, as of the last update
+  bool read_progress{false};
+  bool write_progress{false};
+
+  // Stats: when the connection was accepted and when the pending output became ready
+  std::chrono::steady_clock::time_point accepted;
+  std::chrono::steady_clock::time_point send_started;
+  bool first_byte{false};
+  bool sending{false};
+
+  Connection(int client_fd, const std::shared_ptr<utils::EpollReactor>& owner, utils::BufferPool* pool):
+      fd(client_fd), reactor(owner.get()), reactor_ref(owner), in(pool)
+  {}
+
+  ~Connection()
+  {
+    if (fd >= 0) close(fd);
+  }
+
+  size_t pending() const
+  {
+    return out.pending();
+  }
+};
+
+/**
+ * @brief State of the io_uring engine, touched only by the ring thread once started.
+ */
+struct TcpServer::UringEngine
+{
+  struct Client
+  {
+    uint32_t gen{0};
+    utils::BlockBuffer in;
+    utils::OutputQueue out;
+    iovec iov[utils::OutputQueue::kMaxIov];
+    msghdr msg{};
+    bool recv_armed{false};
+    bool parked{false};  // an asynchronous request awaits its completion
+    bool failed{false};
+
+    utils::TimingWheel::TimerId timer{0};
+    Deadline deadline{Deadline::None};
+    uint64_t received{0};
+    uint64_t consumed{0};
+    bool read_progress{false};
+    bool write_progress{false};
+
+    std::chrono::steady_clock::time_point accepted;
+    std::chrono::steady_clock::time_point send_started;
+    bool first_byte{false};
+    bool sending{false};
+
+    // File regions go to the socket through a pipe with splice, made on the first one
+    int pipe_fds[2]{-1, -1};
+    size_t pipe_size{0};
+    size_t piped{0};  // spliced into the pipe, not out of it yet
+
+    Client() = default;
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+    ~Client()
+    {
+        if (pipe_fds[0] >= 0) {
+          close(pipe_fds[0]);
+          close(pipe_fds[1]);
+      }
+    }
+  };
+
+  utils::IoUring ring;
+  int wakeup_fd{-1};
+  uint64_t wakeup_value{0};
+  bool multishot_accept{true};
+  uint32_t next_gen{0};
+  std::unordered_map<int, Client> clients;
+  std::vector<std::pair<int, uint32_t>> starved;  // recvs that found no free provided buffer
+
+  utils::TimingWheel timers;
+  // Deadline of the earliest IORING_OP_TIMEOUT in the ring
+  utils::TimingWheel::Clock::time_point timer_deadline{utils::TimingWheel::Clock::time_point::max()};
+
+  // Completions of asynchronous requests, run by the ring thread on wakeup
+  std::mutex tasks_mutex;
+  std::vector<std::function<void()>> tasks;
+  bool accepting_tasks{true};
+
+  ~UringEngine()
+  {
+    shutdown();
+    if (wakeup_fd >= 0) close(wakeup_fd);
+  }
+
+  bool post(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      if (!accepting_tasks) return false;
+      tasks.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    return write(wakeup_fd, &one, sizeof(one)) == sizeof(one);
+  }
+
+  void runTasks()
+  {
+    std::vector<std::function<void()>> ready;
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      ready.swap(tasks);
+    }
+    for (auto& task: ready) task();
+  }
+
+  // Late completions may keep the engine alive past stop(), the client fds must not wait for them
+  void shutdown()
+  {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      accepting_tasks = false;
+      tasks.clear();
+    }
+    for (auto& [fd, client]: clients) close(fd);
+    clients.clear();
+  }
+};
+
+/**
+ * @brief Counters of one thread. Only that thread writes them, stats() reads them from anywhere.
+ */
+struct TcpServer::ThreadStats
+{
+  std::atomic<uint64_t> accepted{0};
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> bytes_received{0};
+  std::atomic<uint64_t> bytes_sent{0};
+  std::array<std::atomic<uint64_t>, kResultCodes> errors{};
+  utils::LatencyHistogram first_byte;
+  utils::LatencyHistogram handler;
+  utils::LatencyHistogram send;
+};
+
+TcpServer::TcpServer(RqHandler callback): m_framer(std::make_shared<utils::RawFramer>()), m_running(false)
+{
+  m_handler = [callback](int socket, const utils::BufferSlice& input, std::string& response) {
+    response = callback(socket, std::string(input.view()));
+  };
+}
+
+TcpServer::TcpServer(IHandler* handler): m_framer(std::make_shared<utils::RawFramer>()), m_running(false)
+{
+  m_handler = [handler](int socket, const utils::BufferSlice& input, std::string& response) {
+    response = handler->handle(socket, std::string(input.view()));
+  };
+}
+
+TcpServer::TcpServer(FrameHandler handler, std::shared_ptr<const utils::IFramer> framer):
+    m_framer(framer ? std::move(framer) : std::make_shared<utils::RawFramer>()), m_running(false)
+{
+  m_handler = [handler = std::move(handler)](int socket, const utils::BufferSlice& input, std::string& response) {
+    response = handler(socket, input.view());
+  };
+}
+
+TcpServer::TcpServer(SliceHandler handler, std::shared_ptr<const utils::IFramer> framer):
+    m_handler(std::move(handler)), m_framer(framer ? std::move(framer) : std::make_shared<utils::RawFramer>()),
+    m_running(false)
+{}
+
+TcpServer::TcpServer(ResponseHandler handler, std::shared_ptr<const utils::IFramer> framer):
+    m_response_handler(std::move(handler)),
+    m_framer(framer ? std::move(framer) : std::make_shared<utils::RawFramer>()), m_running(false)
+{}
+
+TcpServer::TcpServer(AsyncHandler handler, std::shared_ptr<const utils::IFramer> framer):
+    m_async_handler(std::move(handler)),
+    m_framer(framer ? std::move(framer) : std::make_shared<utils::RawFramer>()), m_running(false)
+{}
+
+TcpServer::TcpServer(IAsyncHandler* handler, std::shared_ptr<const utils::IFramer> framer):
+    m_framer(framer ? std::move(framer) : std::make_shared<utils::RawFramer>()), m_running(false)
+{
+  m_async_handler = [handler](int socket, const utils::BufferSlice& input, Completion done) {
+    handler->handleAsync(socket, input, std::move(done));
+  };
+}
+
+TcpServer::TcpServer(BatchHandler handler, std::shared_ptr<const utils::IFramer> framer):
+    m_batcher(std::make_unique<utils::RequestBatcher>(std::move(handler))),
+    m_framer(framer ? std::move(framer) : std::make_shared<utils::RawFramer>()), m_running(false)
+{
+  // A request refused by a stopped batcher drops its completion, which answers it with nothing
+  m_async_handler = [batcher = m_batcher.get()](int socket, const utils::BufferSlice& input, Completion done) {
+    batcher->submit(socket, input, std::move(done));
+  };
+}
+
+TcpServer::AsyncHandler TcpServer::makeAsync(RqHandler handler, utils::ThreadPool* pool)
+{
+  auto callback = std::make_shared<RqHandler>(std::move(handler));
+  return [callback, pool](int socket, const utils::BufferSlice& input, Completion done) {
+    auto run = [callback, socket, input, done]() {
+      utils::Response response;
+      response.append((*callback)(socket, std::string(input.view())));
+      done(std::move(response));
+    };
+    // A pool that is shutting down refuses the task, it is served inline then
+    if ((pool == nullptr) || !pool->enqueue(run)) run();
+  };
+}
+
+TcpServer::~TcpServer()
+{
+  stopStatsEndpoint();
+  stop();
+}
+
+bool TcpServer::start(int port, IoMode mode)
+{
+    if ((port < 0) || (port > 65535)) {
+      UFW_LOG_ERROR("Invalid port ", port);
       return false;
   }
+  return start(utils::SocketAddress::anyIPv4(static_cast<uint16_t>(port)), mode);
+}
 
-  int enable = 1;
-    if (setsockopt(m_server_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0) {
-      std::cerr << "Failed to set socket option SO_REUSEADDR. Errno: " << strerror(errno) << std::endl;
-      close_server();
+bool TcpServer::start(std::vector<int> listeners, IoMode mode)
+{
+  std::optional<utils::SocketAddress> address;
+  if (!listeners.empty()) address = utils::SocketAddress::fromSocket(listeners.front());
+    if (m_running || !address) {
+      UFW_LOG_ERROR(m_running ? "Server is running already" : "No listening socket to inherit");
+      for (int fd: listeners) close(fd);
       return false;
   }
+    if ((listeners.size() > 1) && (mode != IoMode::Sharded)) {
+      // A listener of a SO_REUSEPORT group resets the connections queued on it when it closes,
+      // so every one of them needs a shard
+      UFW_LOG_INFO("Serving ", listeners.size(), " inherited listeners in sharded mode");
+      mode = IoMode::Sharded;
+  }
+  int reuse_port = 0;
+  socklen_t length = sizeof(reuse_port);
+    if ((mode == IoMode::Sharded) &&
+        ((getsockopt(listeners.front(), SOL_SOCKET, SO_REUSEPORT, &reuse_port, &length) < 0) || !reuse_port)) {
+      // More listeners can't join the port of one opened without SO_REUSEPORT
+      UFW_LOG_INFO("Inherited listener has no SO_REUSEPORT, serving ", address->toString(), " in reactor mode");
+      mode = IoMode::Reactor;
+  }
+  m_inherited = std::move(listeners);
+  bool started = start(*address, mode);
+  // Left over if the start failed
+  for (int fd: m_inherited) close(fd);
+  m_inherited.clear();
+  return started;
+}
+
+bool TcpServer::start(const utils::SocketAddress& address, IoMode mode)
+{
+    if (m_running) {
+      return true;  // it's already running
+  }
+  m_address = address;
+  m_mode = mode;
+    if ((m_mode == IoMode::Sharded) && m_address.isUnix()) {
+      UFW_LOG_INFO("Unix sockets have no SO_REUSEPORT, serving ", m_address.toString(), " in reactor mode");
+      m_mode = IoMode::Reactor;
+  }
+  m_running = true;
+  m_accepting = true;
+  // Up before any engine thread can submit, stopped again if the start fails
+  if (m_batcher) m_batcher->start();
+  m_listeners_released = false;
+  m_shed_connections = 0;
+  m_shed_requests = 0;
+  m_accept_pauses = 0;
+  m_connections = 0;
+  m_requests_in_flight = 0;
+  m_queue_delay_us = 0;
+  // Every thread of the previous run is gone, their counters go with them
+  m_stats.reset();
+  {
+    std::lock_guard<std::mutex> lock(m_placement_mutex);
+    m_placement.clear();
+  }
 
-  sockaddr_in server_addr{};
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_addr.s_addr = INADDR_ANY;
-  server_addr.sin_port = htons(m_port);
+  // Every inherited listener needs a shard, for this run only: setShards() stays in effect for the next
+  size_t loops = m_reactor_threads;
+  if (m_mode == IoMode::Sharded) loops = std::max(loops, m_inherited.size());
+  // One pool per loop keeps the free lists uncontended, blocking and io_uring modes share the first one
+  bool multi_loop = (m_mode == IoMode::Reactor) || (m_mode == IoMode::Sharded);
+  m_pools.clear();
+  size_t pool_count = multi_loop ? loops : 1;
+  for (size_t i = 0; i < pool_count; ++i) m_pools.push_back(std::make_unique<utils::BufferPool>(kReadChunk));
 
-    if (bind(m_server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-      std::cerr << "Bind failed. Errno: " << strerror(errno) << std::endl;
-      close_server();
+  m_server_fd = take_listener(m_mode == IoMode::Sharded);
+    if (m_server_fd < 0) {
+      m_running = false;
+      if (m_batcher) m_batcher->stop();
       return false;
   }
 
-    if (listen(m_server_fd, 15) < 0) {
-      std::cerr << "Listen failed. Errno: " << strerror(errno) << std::endl;
-      close_server();
-      return false;
+    if (m_mode == IoMode::IoUring) {
+      std::promise<bool> started;
+      auto result = started.get_future();
+      auto placement = loop_affinity().placementOf(0);
+      note_placement("io_uring", placement);
+      m_server_thread = std::thread([this, &started, placement]() {
+        // Before the ring exists, its buffers come from this thread's node
+        if (!utils::applyPlacement(placement)) UFW_LOG_WARN("Failed to move the io_uring thread to ", placement.toString());
+        bool ok = start_uring();
+        started.set_value(ok);
+        if (ok) run_uring();
+      });
+      if (result.get()) return true;
+      m_server_thread.join();
+      UFW_LOG_INFO("io_uring is not available, falling back to reactor mode");
+      m_mode = IoMode::Reactor;
+      // The ring had one pool, the loops need one each
+      while (m_pools.size() < loops) m_pools.push_back(std::make_unique<utils::BufferPool>(kReadChunk));
+      std::lock_guard<std::mutex> lock(m_placement_mutex);
+      m_placement.clear();
+  }
+    if ((m_mode == IoMode::Reactor) || (m_mode == IoMode::Sharded)) {
+        if (!start_reactors(loops)) {
+          m_running = false;
+          close_server();
+          if (m_batcher) m_batcher->stop();
+          return false;
+      }
+      return true;
   }
+  if (timeouts_enabled()) m_timer_thread = std::make_unique<utils::TimerThread>();
+  m_accept_wakeup = eventfd(0, EFD_CLOEXEC);
+  note_placement("acceptor", loop_affinity().placementOf(0));
+  note_pool_placement("client pool", kClientPoolThreads);
   m_server_thread = std::thread(&TcpServer::run, this);
   return true;
 }
 
 void TcpServer::stop()
 {
-  std::cout << "Stopping server" << std::endl;
+  UFW_LOG_INFO("Stopping server");
   m_running = false;
-    // Closing listening socket
+  // Reactors own the listener registration and their clients, stop them before closing the listener
+  stop_reactors();
+    if (m_uring) {
+      uint64_t one = 1;
+      ssize_t written = write(m_uring->wakeup_fd, &one, sizeof(one));
+      (void)written;
+  }
+  wake_acceptor();
+    // Closing listening socket, unless another process accepts on it now
     if (m_server_fd != -1) {
-      shutdown(m_server_fd, SHUT_RDWR);
+      if (!m_listeners_released) shutdown(m_server_fd, SHUT_RDWR);
       close_server();
   }
   // Closing all client sockets
@@ -76,7 +564,87 @@ void TcpServer::stop()
     if (m_server_thread.joinable()) {
       m_server_thread.join();
   }
-  std::cout << "Server stopped" << std::endl;
+  // Blocking client threads wait for their batches until the server thread's pool is gone
+  if (m_batcher) m_batcher->stop();
+    if (m_accept_wakeup >= 0) {
+      close(m_accept_wakeup);
+      m_accept_wakeup = -1;
+  }
+  // The client threads are gone with the server thread's pool
+  m_timer_thread.reset();
+    if (m_uring) {
+      m_uring->shutdown();
+      m_uring.reset();
+  }
+  UFW_LOG_INFO("Server stopped");
+}
+
+bool TcpServer::drain(std::chrono::milliseconds timeout)
+{
+  if (!m_running) return true;
+  UFW_LOG_INFO("Draining server: not accepting anymore, ", m_connections.load(), " connections open");
+  stop_accepting();
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+    while ((m_connections > 0) && (std::chrono::steady_clock::now() < deadline)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  bool drained = m_connections == 0;
+  if (!drained) UFW_LOG_WARN("Drain timed out, closing ", m_connections.load(), " connections");
+  stop();
+  return drained;
+}
+
+std::vector<int> TcpServer::listenerFds() const
+{
+  std::vector<int> fds;
+  if (!m_running || !m_accepting || (m_server_fd < 0)) return fds;
+  fds.push_back(m_server_fd);
+  fds.insert(fds.end(), m_shard_fds.begin(), m_shard_fds.end());
+  return fds;
+}
+
+void TcpServer::stop_accepting()
+{
+  // Whoever holds a copy of the listeners accepts on them from now on: no shutdown(), no unlink()
+  m_listeners_released = true;
+  m_accepting = false;
+    if (m_mode == IoMode::Blocking) {
+      // The server thread closes the listener on its way out
+      wake_acceptor();
+      return;
+  }
+
+  // The loops forget the listeners before they are closed here
+  std::vector<std::future<void>> done;
+    for (size_t i = 0; i < m_reactors.size(); ++i) {
+      int listen_fd = i == 0 ? m_server_fd : m_shard_fds[i - 1];
+      auto removed = std::make_shared<std::promise<void>>();
+      std::weak_ptr<utils::EpollReactor> loop = m_reactors[i];
+      auto task = [loop, listen_fd, removed]() {
+        if (auto reactor = loop.lock()) reactor->remove(listen_fd);
+        removed->set_value();
+      };
+      if (m_reactors[i]->post(task)) done.push_back(removed->get_future());
+      if (m_mode != IoMode::Sharded) break;
+    }
+    if (m_uring) {
+      auto cancelled = std::make_shared<std::promise<void>>();
+      auto task = [this, cancelled]() {
+        m_uring->ring.prepCancel(uring_tag(UringAccept), uring_tag(UringCancel));
+        cancelled->set_value();
+      };
+      if (m_uring->post(task)) done.push_back(cancelled->get_future());
+  }
+  for (auto& future: done) future.wait();
+  close_server();
+}
+
+void TcpServer::wake_acceptor()
+{
+  if (m_accept_wakeup < 0) return;
+  uint64_t one = 1;
+  ssize_t written = write(m_accept_wakeup, &one, sizeof(one));
+  (void)written;
 }
 
 bool TcpServer::isRunning() const
@@ -84,92 +652,1467 @@ bool TcpServer::isRunning() const
   return m_running;
 }
 
+TcpServer::IoMode TcpServer::ioMode() const
+{
+  return m_mode;
+}
+
+void TcpServer::setReactorThreads(size_t count)
+{
+  m_reactor_threads = std::max<size_t>(1, count);
+}
+
 void TcpServer::run()
 {
-  utils::ThreadPool client_pool(30);
+  // Waiting is up to poll(), a connection another process took first mustn't block accept()
+  int flags = fcntl(m_server_fd, F_GETFL, 0);
+  if (flags >= 0) fcntl(m_server_fd, F_SETFL, flags | O_NONBLOCK);
+  auto placement = loop_affinity().placementOf(0);
+  if (!utils::applyPlacement(placement)) UFW_LOG_WARN("Failed to move the accept thread to ", placement.toString());
+  utils::ThreadPool client_pool(kClientPoolThreads, m_affinity);
+  if (m_limits.max_queue_depth > 0) client_pool.set_queue_limit(m_limits.max_queue_depth);
     while (m_running) {
+      bool pausing = m_limits.policy == ShedPolicy::PauseAccept;
+        if (pausing && !admit_connection(&client_pool)) {
+          // The listen backlog holds new connections until the pool catches up
+          ++m_accept_pauses;
+          std::this_thread::sleep_for(m_limits.accept_pause);
+          continue;
+      }
+      // The listener may be shared with another process, so accept only once poll() saw a connection
+      // and leave it to the wakeup to get this thread out of the wait
+      pollfd fds[2] = {{m_server_fd, POLLIN, 0}, {m_accept_wakeup, POLLIN, 0}};
+      if ((poll(fds, m_accept_wakeup >= 0 ? 2 : 1, -1) < 0) && (errno != EINTR)) break;
+      if (!m_running || !m_accepting) break;
+      if (fds[0].revents == 0) continue;
       int client_fd = accept(m_server_fd, nullptr, nullptr);
-        if (client_fd >= 0) {
+      // accept() may block for long, so the other policies decide once the connection is there
+        if ((client_fd >= 0) && !pausing && !admit_connection(&client_pool)) {
+          shed_connection(client_fd);
+        } else if (client_fd >= 0) {
           std::lock_guard<std::mutex> lock(m_clients_mutex);
           m_clients.insert(client_fd);
-          client_pool.enqueue(&TcpServer::handle_client, this, client_fd);
+          ++m_connections;
+          utils::bump(thread_stats().accepted);
+          auto queued = std::chrono::steady_clock::now();
+          auto task = [this, client_fd, queued]() {
+            note_queue_delay(queued);
+            handle_client(client_fd, queued);
+          };
+            if (!client_pool.enqueue(std::move(task))) {
+              // Refused by the queue limit: shed it rather than leave it open and unserved
+              m_clients.erase(client_fd);
+              --m_connections;
+              shed_connection(client_fd);
+          }
           // std::thread client_thread (&TcpServer::handle_client, this, client_fd);
           // client_thread.detach ();
+        } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+          // Another process sharing the listener took the connection
+          continue;
         } else {
           auto error = errno;
-          std::cout << "Failed to accept connection. Errno: " << strerror(error) << std::endl;
+          UFW_LOG_WARN("Failed to accept connection. Errno: ", utils::Errno{error});
+          count_error(AcceptError);
             if ((error == EAGAIN) || (error == EWOULDBLOCK) || (error == EINTR) || (error == ECONNABORTED)) {
               // TODO: add errno handling
               continue;
             } else {
               // TODO: add errno handling
-              std::cout << "Fatal accepting error: " << strerror(error) << ". Server should be stopped!" << std::endl;
+              UFW_LOG_ERROR("Fatal accepting error: ", utils::Errno{error}, ". Server should be stopped!");
               break;
             }
         }
     }
   close_server();
-  std::cout << "Server thread stopped" << std::endl;
+  // Draining: the pool drops the connections it hasn't started on when it goes
+  if (m_running) client_pool.wait();
+  UFW_LOG_INFO("Server thread stopped");
 }
 
-void TcpServer::handle_client(int client_fd)
+void TcpServer::handle_client(int client_fd, std::chrono::steady_clock::time_point accepted)
 {
-  std::cout << "Client connected. sockfd = " << client_fd << std::endl;
-  char buffer[10 * 1024];
+  UFW_LOG_DEBUG("Client connected. sockfd = ", client_fd);
+  utils::BlockBuffer buffer(m_pools.front().get());
+  buffer.setGrowthLimit(m_framer->maxFrameSize());
+  utils::OutputQueue output;
+  auto& stats = thread_stats();
+  bool first_byte = false;
 
-  {
-    int enable = 1;
-      if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) < 0) {
-        std::cout << "Failed to set TCP_NODELAY" << std::endl;
-    }
+  tune_connection(client_fd);
+    if ((m_zerocopy_threshold > 0) && utils::OutputQueue::enableZeroCopy(client_fd)) {
+      output.setZeroCopyThreshold(m_zerocopy_threshold);
   }
 
+  // The timer thread shuts the socket down once the client is late, recv() and send() give up then
+  std::atomic<bool> timed_out{false};
+  utils::TimerThread::TimerId timer = 0;
+  auto arm = [&](Deadline deadline, std::chrono::milliseconds elapsed) {
+    if (!m_timer_thread) return;
+    auto timeout = timeout_of(m_timeouts, deadline);
+      if (timeout.count() == 0) {
+        if (timer != 0) m_timer_thread->cancel(timer);
+        timer = 0;
+        return;
+    }
+    timeout = std::max(timeout - elapsed, std::chrono::milliseconds(0));
+    if ((timer != 0) && m_timer_thread->restart(timer, timeout)) return;
+    timer = m_timer_thread->runAfter(timeout, [client_fd, &timed_out]() {
+      timed_out = true;
+      shutdown(client_fd, SHUT_RDWR);
+    });
+  };
+  auto request_started = utils::TimingWheel::Clock::now();
+
     while (m_running) {
-      auto bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+        if (buffer.empty()) {
+          arm(Deadline::Idle, {});
+        } else {
+          // The whole request has to arrive in time, not each piece of it
+          auto elapsed = utils::TimingWheel::Clock::now() - request_started;
+          arm(Deadline::Read, std::chrono::duration_cast<std::chrono::milliseconds>(elapsed));
+        }
+      buffer.ensureWritable(kMinReadRoom);
+      bool was_empty = buffer.empty();
+      auto bytes_read = recv(client_fd, buffer.writePtr(), buffer.writable(), 0);
         if (bytes_read <= 0) {
             if (bytes_read == 0) {
-              std::cout << "Client disconnected. sockfd = " << client_fd << " result = " << bytes_read << std::endl;
+              UFW_LOG_DEBUG("Client disconnected. sockfd = ", client_fd, " result = ", bytes_read);
               break;
           }
           auto error = errno;
             if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
-              std::cout << "Something non-critical happened while receive. Errno: " << strerror(errno) << std::endl;
+              UFW_LOG_DEBUG("Something non-critical happened while receive. Errno: ", utils::Errno{errno});
               continue;
             } else {
-              std::cout << "Fatal receive error. Closing connection. Reason: " << strerror(error) << std::endl;
+              UFW_LOG_WARN("Fatal receive error. Closing connection. Reason: ", utils::Errno{error});
+              count_error(ReceiveError);
               break;
             }
       }
-      buffer[bytes_read] = '\0';
-      std::string received(buffer);
-      std::string response = m_callback(client_fd, received);
-      std::cout << "Response: " << response << std::endl;
-      auto bytes_written = send(client_fd, response.c_str(), response.size(), 0);
-        if (bytes_written == 0) {
-          if (response.empty()) continue;  // What the fuck did you expect to see here?
+        if (!first_byte) {
+          stats.first_byte.record(nanos_since(accepted));
+          first_byte = true;
+      }
+      utils::bump(stats.bytes_received, bytes_read);
+      // Handler time doesn't count against the client
+      arm(Deadline::None, {});
+      if (was_empty) request_started = utils::TimingWheel::Clock::now();
+      buffer.commit(bytes_read);
+      size_t buffered = buffer.readable();
+
+      // Every complete frame of this read is handled, their responses go out in one gathered send
+        if (!dispatch_frames(client_fd, buffer, output)) {
+          UFW_LOG_WARN("Malformed frame. Closing connection. sockfd = ", client_fd);
+          count_error(ReceiveError);
+          break;
+      }
+      // Leftover bytes after a complete frame begin the next request
+      if (!buffer.empty() && (buffer.readable() < buffered)) request_started = utils::TimingWheel::Clock::now();
+      if (output.zeroCopyInFlight() > 0) output.reapZeroCopy(client_fd);
+      if (output.empty()) continue;
+      UFW_LOG_DEBUG("Response: ", output.pending(), " bytes");
+      arm(Deadline::Write, {});
+      // A blocking socket takes it all unless the connection fails, short writes are resumed inside
+      auto send_started = std::chrono::steady_clock::now();
+      size_t pending = output.pending();
+      auto status = output.writeTo(client_fd);
+      utils::bump(stats.bytes_sent, pending - output.pending());
+        if (status == utils::OutputQueue::Status::Error) {
+          UFW_LOG_WARN("Fatal send error. Closing connection. Reason: ", utils::Errno{errno});
+          count_error(SendError);
           break;
-        } else if (bytes_written < 0) {
-          auto error = errno;
-            if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR) {
-              std::cout << "Something non-critical happened while send. Errno: " << strerror(errno) << std::endl;
-              // TODO: add errno handling
-              continue;
-            } else {
-              std::cout << "Fatal send error. Closing connection. Reason: " << strerror(error) << std::endl;
-              // TODO: add errno handling
-              break;
-            }
       }
+      stats.send.record(nanos_since(send_started));
     }
+  if (timer != 0) m_timer_thread->cancel(timer);
+  if (timed_out) UFW_LOG_WARN("Timeout. Connection closed. sockfd = ", client_fd);
+  --m_connections;
   std::lock_guard<std::mutex> lock(m_clients_mutex);
   m_clients.erase(client_fd);
   close(client_fd);
 }
 
-void TcpServer::close_server()
+bool TcpServer::dispatch_frames(int client_fd, utils::BlockBuffer& in, utils::OutputQueue& out)
 {
-    if (m_server_fd >= 0) {
-      close(m_server_fd);
-      m_server_fd = -1;
+  // Reused by every request handled on this thread, steady state needs no allocation
+  thread_local std::string response;
+  thread_local utils::Response parts;
+  auto& stats = thread_stats();
+  utils::IFramer::Frame frame;
+    for (;;) {
+      auto status = m_framer->next(in.data(), frame);
+      if (status == utils::IFramer::Status::Incomplete) return true;
+      if (status == utils::IFramer::Status::Error) return false;
+      auto request = in.slice(frame.payload);
+      in.consume(frame.consumed);
+      utils::bump(stats.requests);
+      auto started = std::chrono::steady_clock::now();
+        if (m_async_handler || m_response_handler) {
+          parts.clear();
+            if (m_async_handler) {
+              // Only the blocking engine gets here with an asynchronous handler, it just waits
+              await_response(client_fd, request, parts);
+            } else {
+              m_response_handler(client_fd, request, parts);
+            }
+          stats.handler.record(nanos_since(started));
+          if (!encode_response(std::move(parts), out)) return false;
+        } else {
+          response.clear();
+          run_handler(client_fd, request, response);
+          stats.handler.record(nanos_since(started));
+          if (!response.empty()) m_framer->encode(response, out.buffer());
+        }
+    }
+}
+
+void TcpServer::call_handler(int client_fd, const utils::BufferSlice& request, utils::Response& response)
+{
+  auto& stats = thread_stats();
+  utils::bump(stats.requests);
+  auto started = std::chrono::steady_clock::now();
+    if (m_response_handler) {
+      m_response_handler(client_fd, request, response);
+    } else {
+      std::string body;
+      run_handler(client_fd, request, body);
+      response.append(std::move(body));
+    }
+  stats.handler.record(nanos_since(started));
+}
+
+void TcpServer::run_handler(int client_fd, const utils::BufferSlice& request, std::string& response)
+{
+    if (!m_cache) {
+      m_handler(client_fd, request, response);
+      return;
+  }
+  m_cache->get(request.view(), response,
+               [this, client_fd, &request](std::string& computed) { m_handler(client_fd, request, computed); });
+}
+
+void TcpServer::await_response(int client_fd, const utils::BufferSlice& request, utils::Response& response)
+{
+  auto promise = std::make_shared<std::promise<utils::Response>>();
+  auto result = promise->get_future();
+  m_async_handler(client_fd, request, make_completion([promise](utils::Response response) {
+    promise->set_value(std::move(response));
+  }));
+  response = result.get();
+}
+
+bool TcpServer::encode_response(utils::Response&& response, utils::OutputQueue& out) const
+{
+  if (response.empty()) return true;
+  thread_local std::string header;
+  thread_local std::string trailer;
+  header.clear();
+  trailer.clear();
+    if (m_framer->encodeEnvelope(response.size(), header, trailer)) {
+      if (!header.empty()) out.append(header);
+      out.append(std::move(response));
+      if (!trailer.empty()) out.append(trailer);
+      return true;
+  }
+  // The framing needs the whole payload at once
+  std::string payload;
+    if (!response.flattenTo(payload)) {
+      UFW_LOG_WARN("Failed to read the file region of a response");
+      return false;
   }
-}
\ No newline at end of file
+  m_framer->encode(payload, out.buffer());
+  return true;
+}
+
+void TcpServer::setBatchLimits(size_t max_size, std::chrono::microseconds max_delay)
+{
+  if (m_batcher) m_batcher->setLimits({max_size, max_delay});
+}
+
+void TcpServer::setResponseCache(std::shared_ptr<utils::ResponseCache> cache)
+{
+  m_cache = std::move(cache);
+}
+
+void TcpServer::setShards(size_t count, std::vector<int> cpus)
+{
+  m_reactor_threads = std::max<size_t>(1, count);
+  m_shard_cpus = std::move(cpus);
+}
+
+void TcpServer::setAffinity(utils::AffinityPolicy policy)
+{
+  m_affinity = std::move(policy);
+}
+
+std::vector<utils::ThreadPlacement> TcpServer::placement() const
+{
+  std::lock_guard<std::mutex> lock(m_placement_mutex);
+  return m_placement;
+}
+
+utils::AffinityPolicy TcpServer::loop_affinity() const
+{
+  if (m_affinity.enabled() || m_shard_cpus.empty()) return m_affinity;
+  return utils::AffinityPolicy::cpuSet(m_shard_cpus);
+}
+
+void TcpServer::note_placement(std::string thread, utils::CpuPlacement placement)
+{
+  if (!placement.cpus.empty()) UFW_LOG_INFO("Thread ", thread, " runs on ", placement.toString());
+  std::lock_guard<std::mutex> lock(m_placement_mutex);
+  m_placement.push_back({std::move(thread), std::move(placement)});
+}
+
+void TcpServer::note_pool_placement(const std::string& pool, size_t threads)
+{
+  // Unpinned pools are left out. A pool is one entry: the CPUs its threads share, their node if they agree on one
+  if (!m_affinity.enabled()) return;
+  utils::CpuPlacement placement = m_affinity.placementOf(0);
+    for (size_t i = 1; i < threads; ++i) {
+      auto next = m_affinity.placementOf(i);
+      placement.cpus.insert(placement.cpus.end(), next.cpus.begin(), next.cpus.end());
+      if (next.node != placement.node) placement.node = -1;
+    }
+  std::sort(placement.cpus.begin(), placement.cpus.end());
+  placement.cpus.erase(std::unique(placement.cpus.begin(), placement.cpus.end()), placement.cpus.end());
+  note_placement(pool + " (" + std::to_string(threads) + " threads)", std::move(placement));
+}
+
+utils::BufferPool::Stats TcpServer::bufferPoolStats() const
+{
+  utils::BufferPool::Stats total;
+    for (const auto& pool: m_pools) {
+      auto stats = pool->stats();
+      total.hits += stats.hits;
+      total.misses += stats.misses;
+      total.bytes_in_use += stats.bytes_in_use;
+      total.free_blocks += stats.free_blocks;
+    }
+  return total;
+}
+
+void TcpServer::setAdmissionLimits(AdmissionLimits limits)
+{
+  m_limits = std::move(limits);
+}
+
+void TcpServer::setTimeouts(Timeouts timeouts)
+{
+  m_timeouts = timeouts;
+}
+
+bool TcpServer::timeouts_enabled() const
+{
+  return (m_timeouts.idle.count() > 0) || (m_timeouts.read.count() > 0) || (m_timeouts.write.count() > 0);
+}
+
+TcpServer::AdmissionStats TcpServer::admissionStats() const
+{
+  AdmissionStats stats;
+  stats.shed_connections = m_shed_connections;
+  stats.shed_requests = m_shed_requests;
+  stats.accept_pauses = m_accept_pauses;
+  stats.connections = m_connections;
+  stats.requests_in_flight = m_requests_in_flight;
+  return stats;
+}
+
+TcpServer::ThreadStats& TcpServer::thread_stats()
+{
+  return m_stats.local();
+}
+
+void TcpServer::count_error(TcpServerResult code)
+{
+  utils::bump(thread_stats().errors[code]);
+}
+
+TcpServer::Stats TcpServer::stats() const
+{
+  Stats stats;
+  m_stats.forEach([&stats](const ThreadStats& thread) {
+    stats.connections_accepted += thread.accepted.load(std::memory_order_relaxed);
+    stats.requests += thread.requests.load(std::memory_order_relaxed);
+    stats.bytes_received += thread.bytes_received.load(std::memory_order_relaxed);
+    stats.bytes_sent += thread.bytes_sent.load(std::memory_order_relaxed);
+      for (size_t code = 0; code < kResultCodes; ++code) {
+        stats.errors[code] += thread.errors[code].load(std::memory_order_relaxed);
+      }
+    stats.first_byte.merge(thread.first_byte);
+    stats.handler.merge(thread.handler);
+    stats.send.merge(thread.send);
+  });
+  stats.admission = admissionStats();
+  if (m_batcher) stats.batch_size = m_batcher->batchSizes();
+  if (m_cache) stats.cache = m_cache->stats();
+  stats.active_connections = stats.admission.connections;
+  return stats;
+}
+
+std::string TcpServer::statsText() const
+{
+  auto snapshot = stats();
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  out << "connections_accepted " << snapshot.connections_accepted << "\n";
+  out << "connections_active " << snapshot.active_connections << "\n";
+  out << "requests " << snapshot.requests << "\n";
+  out << "requests_in_flight " << snapshot.admission.requests_in_flight << "\n";
+  out << "bytes_received " << snapshot.bytes_received << "\n";
+  out << "bytes_sent " << snapshot.bytes_sent << "\n";
+  out << "shed_connections " << snapshot.admission.shed_connections << "\n";
+  out << "shed_requests " << snapshot.admission.shed_requests << "\n";
+    for (size_t code = 1; code < kResultCodes; ++code) {
+      if (snapshot.errors[code] == 0) continue;
+      out << "errors{code=\"" << result_name(code) << "\"} " << snapshot.errors[code] << "\n";
+    }
+  write_latency(out, "first_byte", snapshot.first_byte);
+  write_latency(out, "handler", snapshot.handler);
+  write_latency(out, "send", snapshot.send);
+    if (snapshot.batch_size.count() > 0) {
+      out << "batch_size{quantile=\"0.5\"} " << snapshot.batch_size.percentile(50.0) << "\n";
+      out << "batch_size{quantile=\"0.99\"} " << snapshot.batch_size.percentile(99.0) << "\n";
+      out << "batch_size_max " << snapshot.batch_size.max() << "\n";
+      out << "batch_size_mean " << snapshot.batch_size.mean() << "\n";
+      out << "batches " << snapshot.batch_size.count() << "\n";
+  }
+    if (m_cache) {
+      out << "cache_hits " << snapshot.cache.hits << "\n";
+      out << "cache_misses " << snapshot.cache.misses << "\n";
+      out << "cache_coalesced " << snapshot.cache.coalesced << "\n";
+      out << "cache_evictions " << snapshot.cache.evictions << "\n";
+      out << "cache_expirations " << snapshot.cache.expirations << "\n";
+      out << "cache_invalidations " << snapshot.cache.invalidations << "\n";
+      out << "cache_entries " << snapshot.cache.entries << "\n";
+      out << "cache_bytes " << snapshot.cache.bytes << "\n";
+  }
+    for (const auto& [thread, placement]: placement()) {
+      out << "thread_placement{thread=\"" << thread << "\",cpus=\"";
+        for (size_t i = 0; i < placement.cpus.size(); ++i) {
+          out << (i > 0 ? "," : "") << placement.cpus[i];
+      }
+      out << "\",node=\"" << placement.node << "\"} 1\n";
+    }
+  return out.str();
+}
+
+bool TcpServer::startStatsEndpoint(int port)
+{
+  if (m_stats_server) return true;
+  // Answers whatever arrives, a request line gets the text as an HTTP response for curl and browsers
+  auto server = std::make_unique<TcpServer>([this](int, const std::string& request) {
+    auto text = statsText();
+    if (request.compare(0, 4, "GET ") != 0) return text;
+    return "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(text.size()) +
+           "\r\nConnection: close\r\n\r\n" + text;
+  });
+  server->setReactorThreads(1);
+  server->setTimeouts({std::chrono::seconds(30), std::chrono::seconds(5), std::chrono::seconds(5)});
+  if (!server->start(port, IoMode::Reactor)) return false;
+  m_stats_server = std::move(server);
+  return true;
+}
+
+void TcpServer::stopStatsEndpoint()
+{
+  if (!m_stats_server) return;
+  m_stats_server->stop();
+  m_stats_server.reset();
+}
+
+bool TcpServer::overloaded(utils::ThreadPool* queue)
+{
+  if ((m_limits.max_in_flight > 0) && (m_requests_in_flight >= m_limits.max_in_flight)) return true;
+  if ((queue == nullptr) || ((m_limits.max_queue_depth == 0) && (m_limits.max_queue_delay.count() == 0))) return false;
+
+  size_t depth = queue->get_queue_size();
+  if ((m_limits.max_queue_depth > 0) && (depth >= m_limits.max_queue_depth)) return true;
+  // The last observed wait only matters while something is still waiting, an idle queue clears it
+  auto max_delay = std::chrono::duration_cast<std::chrono::microseconds>(m_limits.max_queue_delay).count();
+  return (max_delay > 0) && (depth > 0) && (m_queue_delay_us > max_delay);
+}
+
+bool TcpServer::admit_connection(utils::ThreadPool* queue)
+{
+  if ((m_limits.max_connections > 0) && (m_connections >= m_limits.max_connections)) return false;
+  return !overloaded(queue);
+}
+
+void TcpServer::note_queue_delay(std::chrono::steady_clock::time_point queued)
+{
+  auto delay = std::chrono::steady_clock::now() - queued;
+  m_queue_delay_us = std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+}
+
+void TcpServer::shed_connection(int client_fd)
+{
+  ++m_shed_connections;
+    if ((m_limits.policy == ShedPolicy::Reject) && !m_limits.reject_response.empty()) {
+      // A fresh socket has an empty send buffer, a short message goes out without blocking
+      ssize_t sent = send(client_fd, m_limits.reject_response.data(), m_limits.reject_response.size(),
+                          MSG_DONTWAIT | MSG_NOSIGNAL);
+      (void)sent;
+  }
+  close(client_fd);
+}
+
+void TcpServer::tune_connection(int client_fd)
+{
+  // The rest came with accept() from the listener
+  if (m_address.isUnix() || !m_tuning.quick_ack) return;
+  if (!m_tuning.apply(client_fd, utils::SocketTuning::Side::Accepted)) count_error(SetSockOptError);
+}
+
+void TcpServer::setZeroCopyThreshold(size_t bytes)
+{
+  m_zerocopy_threshold = bytes;
+}
+
+void TcpServer::setSocketTuning(utils::SocketTuning tuning)
+{
+  m_tuning = std::move(tuning);
+}
+
+std::optional<ucommon::SocketOptions> TcpServer::socketOptions() const
+{
+  if (!m_running || (m_server_fd < 0)) return std::nullopt;
+  return ucommon::GetSocketOptions(m_server_fd);
+}
+
+void TcpServer::setPipelineDepth(size_t depth)
+{
+  m_pipeline_depth = std::max<size_t>(1, depth);
+}
+
+void TcpServer::setWorkerThreads(size_t count)
+{
+  m_worker_threads = std::max<size_t>(1, count);
+}
+
+void TcpServer::setFramer(std::shared_ptr<const utils::IFramer> framer)
+{
+  if (framer) m_framer = std::move(framer);
+}
+
+void TcpServer::setBacklog(int backlog)
+{
+  m_backlog = backlog > 0 ? backlog : SOMAXCONN;
+}
+
+int TcpServer::take_listener(bool reuse_port)
+{
+  int fd = -1;
+    if (m_inherited.empty()) {
+      fd = open_listener(reuse_port);
+    } else {
+      fd = m_inherited.front();
+      m_inherited.erase(m_inherited.begin());
+    }
+  // A refused option is logged and the server goes on without it
+  if ((fd >= 0) && !m_tuning.apply(fd, utils::SocketTuning::Side::Listener)) count_error(SetSockOptError);
+  return fd;
+}
+
+int TcpServer::open_listener(bool reuse_port)
+{
+  int server_fd = socket(m_address.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd < 0) {
+      UFW_LOG_ERROR("Failed to create socket. Errno: ", utils::Errno{errno});
+      return -1;
+  }
+    if (m_address.isUnix()) {
+      remove_stale_socket(m_address);
+      return bind_listener(server_fd);
+  }
+
+  int enable = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0) {
+      UFW_LOG_ERROR("Failed to set socket option SO_REUSEADDR. Errno: ", utils::Errno{errno});
+      close(server_fd);
+      return -1;
+  }
+    if (reuse_port && (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0)) {
+      UFW_LOG_ERROR("Failed to set socket option SO_REUSEPORT. Errno: ", utils::Errno{errno});
+      close(server_fd);
+      return -1;
+  }
+  int v6_only = m_address.dualStack() ? 0 : 1;
+    if ((m_address.family() == AF_INET6) &&
+        (setsockopt(server_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only)) < 0)) {
+      UFW_LOG_ERROR("Failed to set socket option IPV6_V6ONLY. Errno: ", utils::Errno{errno});
+      close(server_fd);
+      return -1;
+  }
+  return bind_listener(server_fd);
+}
+
+int TcpServer::bind_listener(int server_fd)
+{
+    if (bind(server_fd, m_address.data(), m_address.size()) < 0) {
+      UFW_LOG_ERROR("Bind to ", m_address.toString(), " failed. Errno: ", utils::Errno{errno});
+      close(server_fd);
+      return -1;
+  }
+
+    if (listen(server_fd, m_backlog) < 0) {
+      UFW_LOG_ERROR("Listen failed. Errno: ", utils::Errno{errno});
+      close(server_fd);
+      return -1;
+  }
+  return server_fd;
+}
+
+void TcpServer::close_server()
+{
+    if (m_server_fd >= 0) {
+      close(m_server_fd);
+      m_server_fd = -1;
+      // The socket file outlives the listener, nobody else would remove it unless the listener was handed over
+      if (!m_listeners_released && !m_address.path().empty()) unlink(m_address.path().c_str());
+  }
+  for (int fd: m_shard_fds) close(fd);
+  m_shard_fds.clear();
+}
+
+bool TcpServer::start_reactors(size_t count)
+{
+    if ((m_pipeline_depth > 1) && !m_async_handler) {
+      m_workers = std::make_unique<utils::ThreadPool>(m_worker_threads, m_affinity);
+      note_pool_placement("workers", m_worker_threads);
+  }
+  for (size_t i = 0; i < count; ++i) m_reactors.push_back(std::make_shared<utils::EpollReactor>());
+
+    for (size_t i = 0; i < m_reactors.size(); ++i) {
+      auto* reactor = m_reactors[i].get();
+      int listen_fd = m_server_fd;
+        if ((m_mode == IoMode::Sharded) && (i > 0)) {
+          listen_fd = take_listener(true);
+            if (listen_fd < 0) {
+              stop_reactors();
+              return false;
+          }
+          m_shard_fds.push_back(listen_fd);
+      }
+      int flags = fcntl(listen_fd, F_GETFL, 0);
+        if ((flags < 0) || (fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+          UFW_LOG_ERROR("Failed to make listening socket non-blocking. Errno: ", utils::Errno{errno});
+          stop_reactors();
+          return false;
+      }
+      // Listeners are level-triggered, so a burst bigger than kMaxAcceptsPerWakeup is drained over several wakeups
+        if (!reactor->add(listen_fd, EPOLLIN, [this, i, listen_fd](uint32_t) { on_accept(i, listen_fd); })) {
+          stop_reactors();
+          return false;
+      }
+      // Reactor mode accepts on the first loop only and spreads clients over all of them
+      if (m_mode != IoMode::Sharded) break;
+    }
+
+  auto affinity = loop_affinity();
+    for (size_t i = 0; i < m_reactors.size(); ++i) {
+      // The loop allocates its pool's blocks itself, after it moved
+      m_reactors[i]->setPlacement(affinity.placementOf(i));
+      note_placement((m_mode == IoMode::Sharded ? "shard " : "reactor ") + std::to_string(i), affinity.placementOf(i));
+        if (!m_reactors[i]->start()) {
+          UFW_LOG_ERROR("Failed to start reactor thread");
+          stop_reactors();
+          return false;
+      }
+    }
+  return true;
+}
+
+void TcpServer::stop_reactors()
+{
+  for (auto& reactor: m_reactors) reactor->stop();
+  // Workers post completions to the reactors: join them while the reactor objects still exist
+  m_workers.reset();
+  m_reactors.clear();
+}
+
+void TcpServer::on_accept(size_t acceptor, int listen_fd)
+{
+    for (int i = 0; i < kMaxAcceptsPerWakeup; ++i) {
+      bool admit = admit_connection(m_workers.get());
+      if (!admit && (m_limits.policy == ShedPolicy::PauseAccept) && pause_accept(acceptor, listen_fd)) return;
+      int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+          auto error = errno;
+          if ((error == EAGAIN) || (error == EWOULDBLOCK)) return;
+          if ((error == EINTR) || (error == ECONNABORTED)) continue;
+          UFW_LOG_WARN("Failed to accept connection. Errno: ", utils::Errno{error});
+          count_error(AcceptError);
+          return;
+      }
+        if (!admit) {
+          shed_connection(client_fd);
+          continue;
+      }
+      ++m_connections;
+      utils::bump(thread_stats().accepted);
+      auto accepted = std::chrono::steady_clock::now();
+
+        if (m_mode == IoMode::Sharded) {
+          // Connections stay on the shard whose listener the kernel picked
+          attach_client(acceptor, client_fd, accepted);
+          continue;
+      }
+      size_t index = m_next_reactor++ % m_reactors.size();
+      auto attach = [this, index, client_fd, accepted]() { attach_client(index, client_fd, accepted); };
+        if (index == acceptor) {
+          attach();
+        } else if (!m_reactors[index]->post(attach)) {
+          --m_connections;
+          close(client_fd);
+        }
+    }
+}
+
+void TcpServer::attach_client(size_t index, int client_fd, std::chrono::steady_clock::time_point accepted)
+{
+  auto* reactor = m_reactors[index].get();
+  tune_connection(client_fd);
+
+  auto conn = std::make_shared<Connection>(client_fd, m_reactors[index], m_pools[index].get());
+  conn->in.setGrowthLimit(m_framer->maxFrameSize());
+  conn->accepted = accepted;
+    if ((m_zerocopy_threshold > 0) && utils::OutputQueue::enableZeroCopy(client_fd)) {
+      conn->out.setZeroCopyThreshold(m_zerocopy_threshold);
+  }
+  // On failure conn goes out of scope and closes the fd
+    if (!reactor->add(client_fd, kClientEvents, [this, conn](uint32_t events) { on_client_event(conn, events); })) {
+      --m_connections;
+      return;
+  }
+  update_deadline(conn);
+}
+
+void TcpServer::on_client_event(const std::shared_ptr<Connection>& conn, uint32_t events)
+{
+    if (events & EPOLLERR) {
+      // Zero-copy completions arrive through the error queue and raise EPOLLERR as well
+      bool zero_copy = conn->out.zeroCopyInFlight() > 0;
+        if (!zero_copy || !conn->out.reapZeroCopy(conn->fd) || (socket_error(conn->fd) != 0)) {
+          close_client(*conn);
+          return;
+      }
+  }
+  if (events & EPOLLOUT) flush_client(*conn);
+  if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) conn->readable = true;
+
+  bool resume = false;
+    do {
+      // A full pipeline window stops reading too, the socket buffer pushes back on the client
+      while (conn->readable && !conn->closed && (conn->pending() < kMaxPendingOutput) &&
+             (conn->in_flight < m_pipeline_depth)) {
+        conn->in.ensureWritable(kMinReadRoom);
+        auto bytes_read = recv(conn->fd, conn->in.writePtr(), conn->in.writable(), 0);
+          if (bytes_read > 0) {
+            auto& stats = thread_stats();
+              if (!conn->first_byte) {
+                stats.first_byte.record(nanos_since(conn->accepted));
+                conn->first_byte = true;
+            }
+            utils::bump(stats.bytes_received, bytes_read);
+            conn->in.commit(bytes_read);
+            conn->received += bytes_read;
+            conn->read_progress = true;
+              if (!process_input(conn)) {
+                UFW_LOG_WARN("Malformed frame. Closing connection. sockfd = ", conn->fd);
+                count_error(ReceiveError);
+                close_client(*conn);
+                return;
+            }
+            continue;
+        }
+          if (bytes_read == 0) {
+            conn->peer_closed = true;
+            conn->readable = false;
+            break;
+        }
+        auto error = errno;
+        if (error == EINTR) continue;
+          if ((error == EAGAIN) || (error == EWOULDBLOCK)) {
+            conn->readable = false;
+            break;
+        }
+        UFW_LOG_WARN("Fatal receive error. Closing connection. Reason: ", utils::Errno{error});
+        count_error(ReceiveError);
+        close_client(*conn);
+        return;
+      }
+      if (!conn->closed && (conn->pending() > 0)) flush_client(*conn);
+      // Reading stopped at the output limit and the flush took everything: no new edge comes for what
+      // the socket holds already
+      resume = !conn->closed && conn->readable && (conn->pending() < kMaxPendingOutput) &&
+               (conn->in_flight < m_pipeline_depth);
+    } while (resume);
+  if (!conn->closed && conn->peer_closed && (conn->pending() == 0) && (conn->in_flight == 0)) close_client(*conn);
+  update_deadline(conn);
+}
+
+bool TcpServer::process_input(const std::shared_ptr<Connection>& conn)
+{
+  if ((m_pipeline_depth <= 1) && !m_async_handler) return dispatch_frames(conn->fd, conn->in, conn->out);
+
+  if (conn->window.empty()) conn->window.resize(m_pipeline_depth);
+  utils::IFramer::Frame frame;
+    while (conn->in_flight < m_pipeline_depth) {
+      auto status = m_framer->next(conn->in.data(), frame);
+      if (status == utils::IFramer::Status::Incomplete) break;
+      if (status == utils::IFramer::Status::Error) return false;
+
+      // The slice keeps the block alive while the request is in flight, no copy is made
+      auto request = conn->in.slice(frame.payload);
+      conn->in.consume(frame.consumed);
+      uint64_t seq = conn->next_seq++;
+      ++conn->in_flight;
+        if (overloaded(m_workers.get())) {
+          if (!shed_request(conn, seq)) return true;
+          continue;
+      }
+      ++m_requests_in_flight;
+
+        if (m_async_handler) {
+          std::weak_ptr<utils::EpollReactor> reactor = conn->reactor_ref;
+          utils::bump(thread_stats().requests);
+          auto started = std::chrono::steady_clock::now();
+          auto done = [this, conn, seq, reactor, started](utils::Response response) {
+            auto loop = reactor.lock();
+            if (!loop) return;
+            // Recorded by the loop, completing threads may outlive the run
+            loop->post([this, conn, seq, started, response = std::move(response)]() mutable {
+              thread_stats().handler.record(nanos_since(started));
+              complete_request(conn, seq, std::move(response));
+            });
+          };
+          m_async_handler(conn->fd, request, make_completion(std::move(done)));
+          continue;
+      }
+
+      auto queued = std::chrono::steady_clock::now();
+      auto task = [this, conn, seq, queued, request = std::move(request)]() {
+        note_queue_delay(queued);
+        utils::Response response;
+        call_handler(conn->fd, request, response);
+        conn->reactor->post([this, conn, seq, response = std::move(response)]() mutable {
+          complete_request(conn, seq, std::move(response));
+        });
+      };
+        if (!m_workers->enqueue(std::move(task))) {
+          // Queue limit reached or pool shutting down: keep the window consistent
+          --m_requests_in_flight;
+          if (!shed_request(conn, seq)) return true;
+      }
+    }
+  return true;
+}
+
+bool TcpServer::shed_request(const std::shared_ptr<Connection>& conn, uint64_t seq)
+{
+  ++m_shed_requests;
+    if ((m_limits.policy == ShedPolicy::Close) || m_limits.reject_response.empty()) {
+      close_client(*conn);
+      return false;
+  }
+  // The rejection takes the request's place in the window, so responses stay in order
+  utils::Response response;
+  response.append(std::string_view(m_limits.reject_response));
+  conn->window[seq % conn->window.size()] = std::move(response);
+  return drain_window(*conn);
+}
+
+bool TcpServer::drain_window(Connection& conn)
+{
+    while (conn.in_flight > 0) {
+      auto& slot = conn.window[conn.next_to_write % conn.window.size()];
+      if (!slot) break;
+      bool encoded = encode_response(std::move(*slot), conn.out);
+      slot.reset();
+      ++conn.next_to_write;
+      --conn.in_flight;
+        if (!encoded) {
+          close_client(conn);
+          return false;
+      }
+    }
+  return true;
+}
+
+void TcpServer::complete_request(const std::shared_ptr<Connection>& conn, uint64_t seq, utils::Response response)
+{
+  --m_requests_in_flight;
+  if (conn->closed) return;
+  conn->window[seq % conn->window.size()] = std::move(response);
+  if (!drain_window(*conn)) return;
+
+  // Frames held back by a full window go out now, then reading resumes where it stopped
+    if (!process_input(conn)) {
+      UFW_LOG_WARN("Malformed frame. Closing connection. sockfd = ", conn->fd);
+      count_error(ReceiveError);
+      close_client(*conn);
+      return;
+  }
+  on_client_event(conn, 0);
+}
+
+void TcpServer::flush_client(Connection& conn)
+{
+  size_t pending = conn.out.pending();
+    if (!conn.sending && (pending > 0)) {
+      conn.send_started = std::chrono::steady_clock::now();
+      conn.sending = true;
+  }
+  auto status = conn.out.writeTo(conn.fd);
+  auto& stats = thread_stats();
+    if (conn.out.pending() < pending) {
+      conn.write_progress = true;
+      utils::bump(stats.bytes_sent, pending - conn.out.pending());
+  }
+    if (conn.sending && (conn.out.pending() == 0)) {
+      stats.send.record(nanos_since(conn.send_started));
+      conn.sending = false;
+  }
+    if (status == utils::OutputQueue::Status::WouldBlock) {
+        if (!conn.write_armed) {
+          conn.write_armed = conn.reactor->modify(conn.fd, kClientEvents | EPOLLOUT);
+      }
+      return;
+  }
+    if (status == utils::OutputQueue::Status::Error) {
+      UFW_LOG_WARN("Fatal send error. Closing connection. Reason: ", utils::Errno{errno});
+      count_error(SendError);
+      close_client(conn);
+      return;
+  }
+
+    if (conn.write_armed) {
+      conn.reactor->modify(conn.fd, kClientEvents);
+      conn.write_armed = false;
+  }
+}
+
+void TcpServer::close_client(Connection& conn)
+{
+  if (conn.closed) return;
+  conn.closed = true;
+  --m_connections;
+  if (conn.timer != 0) conn.reactor->cancelTimer(conn.timer);
+  // The reactor releases the entry after the current batch, the Connection destructor closes the fd
+  conn.reactor->remove(conn.fd);
+}
+
+void TcpServer::update_deadline(const std::shared_ptr<Connection>& conn)
+{
+  if (conn->closed || !timeouts_enabled()) return;
+
+  Deadline deadline = Deadline::Idle;
+    if (conn->pending() > 0) {
+      deadline = Deadline::Write;
+    } else if (conn->in_flight > 0) {
+      deadline = Deadline::None;
+    } else if (!conn->in.empty()) {
+      deadline = Deadline::Read;
+    }
+  // Read restarts only when a new request begins, so a request trickling in byte by byte still expires
+  uint64_t consumed = conn->received - conn->in.readable();
+  bool restart = (deadline != conn->deadline) || ((deadline == Deadline::Write) && conn->write_progress) ||
+                 ((deadline == Deadline::Read) && (consumed != conn->consumed)) ||
+                 ((deadline == Deadline::Idle) && conn->read_progress);
+  conn->consumed = consumed;
+  conn->read_progress = conn->write_progress = false;
+  if (!restart) return;
+
+  conn->deadline = deadline;
+  auto timeout = timeout_of(m_timeouts, deadline);
+    if (timeout.count() == 0) {
+      if (conn->timer != 0) conn->reactor->cancelTimer(conn->timer);
+      conn->timer = 0;
+      return;
+  }
+  if ((conn->timer != 0) && conn->reactor->restartTimer(conn->timer, timeout)) return;
+  std::weak_ptr<Connection> weak = conn;
+  conn->timer = conn->reactor->runAfter(timeout, [this, weak]() {
+    auto conn = weak.lock();
+    if (!conn || conn->closed) return;
+    conn->timer = 0;
+    UFW_LOG_WARN(deadline_name(conn->deadline), " timeout. Closing connection. sockfd = ", conn->fd);
+    close_client(*conn);
+  });
+}
+
+bool TcpServer::pause_accept(size_t acceptor, int listen_fd)
+{
+  auto* reactor = m_reactors[acceptor].get();
+  auto timer = std::make_shared<ScopedFd>();
+  timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer->fd < 0) return false;
+
+  itimerspec pause{};
+  // A zero timespec would disarm the timer, pause for at least a millisecond
+  int64_t pause_ns = std::max<int64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(m_limits.accept_pause).count(), 1000000);
+  pause.it_value.tv_sec = pause_ns / 1000000000;
+  pause.it_value.tv_nsec = pause_ns % 1000000000;
+  if (timerfd_settime(timer->fd, 0, &pause, nullptr) < 0) return false;
+  if (!reactor->modify(listen_fd, 0)) return false;
+
+  // Connections wait in the listen backlog until the timer turns the listener back on
+  std::weak_ptr<utils::EpollReactor> loop = m_reactors[acceptor];
+  bool armed = reactor->add(timer->fd, EPOLLIN, [this, loop, listen_fd, timer](uint32_t) {
+    auto reactor = loop.lock();
+    if (!reactor) return;
+    reactor->remove(timer->fd);
+    // drain() removes and closes the listener meanwhile, its fd number may belong to a client by now
+    if (m_accepting) reactor->modify(listen_fd, EPOLLIN);
+  });
+    if (!armed) {
+      reactor->modify(listen_fd, EPOLLIN);
+      return false;
+  }
+  ++m_accept_pauses;
+  return true;
+}
+
+bool TcpServer::start_uring()
+{
+  if (!utils::IoUring::isSupported()) return false;
+
+  auto engine = std::make_unique<UringEngine>();
+    if (!engine->ring.init(kUringEntries)) {
+      UFW_LOG_ERROR("io_uring_setup failed. Errno: ", utils::Errno{errno});
+      return false;
+  }
+    if (!engine->ring.setupBufferRing(kUringBufferGroup, kUringBufferCount, kUringBufferSize)) {
+      UFW_LOG_ERROR("Failed to register io_uring provided buffers");
+      return false;
+  }
+  engine->wakeup_fd = eventfd(0, EFD_CLOEXEC);
+  if (engine->wakeup_fd < 0) return false;
+
+  engine->ring.prepAccept(m_server_fd, uring_tag(UringAccept), engine->multishot_accept);
+  engine->ring.prepRead(engine->wakeup_fd, &engine->wakeup_value, sizeof(engine->wakeup_value),
+                        uring_tag(UringWakeup));
+  m_uring = std::move(engine);
+  return true;
+}
+
+void TcpServer::run_uring()
+{
+  auto& ring = m_uring->ring;
+  auto& timers = m_uring->timers;
+    while (m_running) {
+        if (!timers.empty()) {
+          // A single kernel timeout covers the whole wheel, an earlier deadline adds another one
+          auto now = utils::TimingWheel::Clock::now();
+          int timeout = timers.nextTimeoutMs(now);
+          auto deadline = now + std::chrono::milliseconds(timeout);
+            if ((deadline < m_uring->timer_deadline) && ring.prepTimeout(timeout, uring_tag(UringTimer))) {
+              m_uring->timer_deadline = deadline;
+          }
+      }
+      int ret = ring.submitAndWait(1);
+        if ((ret < 0) && (ret != -EINTR) && (ret != -EBUSY)) {
+          UFW_LOG_ERROR("Fatal io_uring error: ", utils::Errno{-ret}, ". Server should be stopped!");
+          break;
+      }
+
+      ring.forEachCompletion([this](const utils::IoUring::Completion& completion) {
+        auto op = static_cast<UringOp>(completion.user_data >> 56);
+        auto gen = static_cast<uint32_t>((completion.user_data >> 32) & 0xFFFFFF);
+        auto fd = static_cast<int>(completion.user_data & 0xFFFFFFFF);
+          switch (op) {
+            case UringAccept: on_uring_accept(completion.res, completion.flags); break;
+            case UringRecv:
+              on_uring_recv(fd, gen, completion.res, completion.flags);
+              update_uring_deadline(fd, gen);
+              break;
+            case UringSend:
+              on_uring_send(fd, gen, completion.res);
+              update_uring_deadline(fd, gen);
+              break;
+            case UringSpliceIn: on_uring_splice_in(fd, gen, completion.res); break;
+            case UringSpliceOut:
+              on_uring_splice_out(fd, gen, completion.res);
+              update_uring_deadline(fd, gen);
+              break;
+            case UringTimer: m_uring->timer_deadline = utils::TimingWheel::Clock::time_point::max(); break;
+            case UringWakeup:
+              m_uring->runTasks();
+              if (m_running) {
+                m_uring->ring.prepRead(m_uring->wakeup_fd, &m_uring->wakeup_value, sizeof(m_uring->wakeup_value),
+                                       uring_tag(UringWakeup));
+              }
+              break;
+            case UringCancel: break;
+          }
+      });
+
+      if (!timers.empty()) timers.advance(utils::TimingWheel::Clock::now());
+      // Buffers recycled by the completions above can serve the starved receives now
+      auto starved = std::move(m_uring->starved);
+      m_uring->starved.clear();
+      for (auto& [fd, gen]: starved) ring.prepRecv(fd, kUringBufferGroup, uring_tag(UringRecv, fd, gen));
+    }
+  cancel_uring_accept();
+  UFW_LOG_INFO("Server thread stopped");
+}
+
+void TcpServer::cancel_uring_accept()
+{
+  // The pending accept holds a reference to the listener. Closing it doesn't release a unix socket's
+  // name then, a restart binding the same abstract name right after stop() would fail.
+  auto& ring = m_uring->ring;
+  if (!ring.prepCancel(uring_tag(UringAccept), uring_tag(UringCancel))) return;
+  bool cancelled = false;
+  bool accept_done = false;
+    while (!cancelled || !accept_done) {
+      int ret = ring.submitAndWait(1);
+      if ((ret < 0) && (ret != -EINTR) && (ret != -EBUSY)) return;
+      ring.forEachCompletion([&](const utils::IoUring::Completion& completion) {
+        auto op = static_cast<UringOp>(completion.user_data >> 56);
+          if (op == UringCancel) {
+            cancelled = true;
+            if (completion.res == -ENOENT) accept_done = true;
+          } else if (op == UringAccept) {
+            if (completion.res >= 0) close(completion.res);
+            if (!(completion.flags & IORING_CQE_F_MORE)) accept_done = true;
+          }
+      });
+    }
+}
+
+void TcpServer::on_uring_accept(int32_t res, uint32_t flags)
+{
+  if (!m_running) return;
+    if ((res >= 0) && !admit_connection(nullptr)) {
+      // A multishot accept can't be paused, so PauseAccept sheds here like Close does
+      shed_connection(res);
+    } else if (res >= 0) {
+      ++m_connections;
+      utils::bump(thread_stats().accepted);
+      tune_connection(res);
+      auto& client = m_uring->clients[res];
+      client.accepted = std::chrono::steady_clock::now();
+      client.in.setPool(m_pools.front().get());
+      client.in.setGrowthLimit(m_framer->maxFrameSize());
+      client.gen = ++m_uring->next_gen;
+      client.recv_armed = true;
+      m_uring->ring.prepRecv(res, kUringBufferGroup, uring_tag(UringRecv, res, client.gen));
+      update_uring_deadline(res, client.gen & 0xFFFFFF);
+    } else if ((res == -EINVAL) && m_uring->multishot_accept) {
+      // Kernel before 5.19: keep re-arming single-shot accepts
+      m_uring->multishot_accept = false;
+    } else if ((res != -ECONNABORTED) && (res != -EINTR) && (res != -EAGAIN) && (res != -ECANCELED)) {
+      UFW_LOG_WARN("Failed to accept connection. Errno: ", utils::Errno{-res});
+      count_error(AcceptError);
+    }
+    if (!(flags & IORING_CQE_F_MORE) && m_accepting) {
+      m_uring->ring.prepAccept(m_server_fd, uring_tag(UringAccept), m_uring->multishot_accept);
+  }
+}
+
+void TcpServer::on_uring_recv(int client_fd, uint32_t gen, int32_t res, uint32_t flags)
+{
+  auto& ring = m_uring->ring;
+  bool has_buffer = flags & IORING_CQE_F_BUFFER;
+  auto bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+  auto it = m_uring->clients.find(client_fd);
+    if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen)) {
+      if (has_buffer) ring.recycleBuffer(bid);
+      return;
+  }
+  auto& client = it->second;
+  // Starved receives are re-armed by run_uring()
+  client.recv_armed = (res == -ENOBUFS);
+
+    if (res > 0) {
+      auto& stats = thread_stats();
+        if (!client.first_byte) {
+          stats.first_byte.record(nanos_since(client.accepted));
+          client.first_byte = true;
+      }
+      utils::bump(stats.bytes_received, res);
+      // Provided buffers go back to the kernel right away, frames live on in a pooled block
+      client.in.append(std::string_view(ring.buffer(bid), res));
+      client.received += res;
+      client.read_progress = true;
+      ring.recycleBuffer(bid);
+        if (m_async_handler) {
+          process_uring_input(client_fd);
+          return;
+      }
+        if (!dispatch_frames(client_fd, client.in, client.out)) {
+          UFW_LOG_WARN("Malformed frame. Closing connection. sockfd = ", client_fd);
+          count_error(ReceiveError);
+          close_uring_client(client_fd);
+          return;
+      }
+        if (client.out.empty()) {
+          client.recv_armed = true;
+          ring.prepRecv(client_fd, kUringBufferGroup, uring_tag(UringRecv, client_fd, gen));
+          return;
+      }
+      send_uring_output(client_fd);
+      return;
+  }
+  if (has_buffer) ring.recycleBuffer(bid);
+
+    if (res == -ENOBUFS) {
+      m_uring->starved.emplace_back(client_fd, gen);
+      return;
+  }
+    if ((res == -ECANCELED) && !client.failed && !client.out.empty()) {
+      // Short send broke the link, push the rest of the response
+      send_uring_output(client_fd);
+      return;
+  }
+    if ((res < 0) && (res != -ECANCELED) && (res != -ECONNRESET)) {
+      UFW_LOG_WARN("Fatal receive error. Closing connection. Reason: ", utils::Errno{-res});
+      count_error(ReceiveError);
+  }
+  close_uring_client(client_fd);
+}
+
+void TcpServer::on_uring_send(int client_fd, uint32_t gen, int32_t res)
+{
+  auto it = m_uring->clients.find(client_fd);
+  if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen)) return;
+  auto& client = it->second;
+    if (res < 0) {
+      UFW_LOG_WARN("Fatal send error. Closing connection. Reason: ", utils::Errno{-res});
+      count_error(SendError);
+      client.failed = true;
+      // A linked recv gets -ECANCELED and closes the connection, otherwise nobody else will
+      if (!client.recv_armed) close_uring_client(client_fd);
+      return;
+  }
+  client.out.advance(res);
+    if (res > 0) {
+      client.write_progress = true;
+      utils::bump(thread_stats().bytes_sent, res);
+  }
+    if (client.sending && client.out.empty()) {
+      thread_stats().send.record(nanos_since(client.send_started));
+      client.sending = false;
+  }
+  // Output that didn't fit in one gather goes on before anything else is read
+  if (!client.recv_armed) send_uring_output(client_fd);
+}
+
+void TcpServer::send_uring_output(int client_fd)
+{
+  auto& client = m_uring->clients[client_fd];
+  uint32_t gen = client.gen & 0xFFFFFF;
+    if (client.out.empty()) {
+      client.recv_armed = true;
+      m_uring->ring.prepRecv(client_fd, kUringBufferGroup, uring_tag(UringRecv, client_fd, gen));
+      return;
+  }
+
+    if (!client.sending) {
+      client.send_started = std::chrono::steady_clock::now();
+      client.sending = true;
+  }
+  int file_fd = -1;
+  off_t offset = 0;
+  size_t length = 0;
+    if ((client.piped > 0) || client.out.frontFile(file_fd, offset, length)) {
+      splice_uring_output(client_fd, file_fd, offset, length);
+      return;
+  }
+  size_t count = client.out.gather(client.iov, utils::OutputQueue::kMaxIov);
+  size_t gathered = 0;
+  for (size_t i = 0; i < count; ++i) gathered += client.iov[i].iov_len;
+  client.msg.msg_iov = client.iov;
+  client.msg.msg_iovlen = count;
+
+  // The next recv starts only after the response is fully sent: one submission per round trip
+  bool last = (gathered == client.out.pending());
+  m_uring->ring.prepSendmsg(client_fd, &client.msg, uring_tag(UringSend, client_fd, gen), last);
+    if (last) {
+      client.recv_armed = true;
+      m_uring->ring.prepRecv(client_fd, kUringBufferGroup, uring_tag(UringRecv, client_fd, gen));
+  }
+}
+
+void TcpServer::splice_uring_output(int client_fd, int file_fd, off_t offset, size_t length)
+{
+  auto& client = m_uring->clients[client_fd];
+  uint32_t gen = client.gen & 0xFFFFFF;
+    if (client.piped > 0) {
+      // What the socket didn't take last time goes first, the file position is past it already
+      m_uring->ring.prepSplice(client.pipe_fds[0], -1, client_fd, client.piped,
+                               uring_tag(UringSpliceOut, client_fd, gen), false);
+      return;
+  }
+    if (client.pipe_fds[0] < 0) {
+        if (pipe2(client.pipe_fds, O_CLOEXEC) < 0) {
+          UFW_LOG_WARN("Failed to create a pipe for a file response. Errno: ", utils::Errno{errno});
+          client.pipe_fds[0] = client.pipe_fds[1] = -1;
+          count_error(SendError);
+          close_uring_client(client_fd);
+          return;
+      }
+      fcntl(client.pipe_fds[1], F_SETPIPE_SZ, kSplicePipeSize);
+      int size = fcntl(client.pipe_fds[1], F_GETPIPE_SZ);
+      client.pipe_size = size > 0 ? static_cast<size_t>(size) : 64 * 1024;
+  }
+  // One pipe-full per round: into the pipe and, linked, out of it into the socket
+  size_t chunk = std::min(length, client.pipe_size);
+  m_uring->ring.prepSplice(file_fd, offset, client.pipe_fds[1], chunk, uring_tag(UringSpliceIn, client_fd, gen), true);
+  m_uring->ring.prepSplice(client.pipe_fds[0], -1, client_fd, chunk, uring_tag(UringSpliceOut, client_fd, gen), false);
+}
+
+void TcpServer::on_uring_splice_in(int client_fd, uint32_t gen, int32_t res)
+{
+  auto it = m_uring->clients.find(client_fd);
+  if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen)) return;
+  auto& client = it->second;
+    if (res <= 0) {
+      // 0: the file is shorter than the region announced in the response
+      UFW_LOG_WARN("Failed to read the file region of a response. Reason: ", utils::Errno{res < 0 ? -res : EIO});
+      count_error(SendError);
+      close_uring_client(client_fd);
+      return;
+  }
+  // A short splice cancelled the linked one, which goes on with what is in the pipe
+  client.piped += res;
+}
+
+void TcpServer::on_uring_splice_out(int client_fd, uint32_t gen, int32_t res)
+{
+  auto it = m_uring->clients.find(client_fd);
+  if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen)) return;
+  auto& client = it->second;
+    if (res == -ECANCELED) {
+      if (!client.recv_armed) send_uring_output(client_fd);
+      return;
+  }
+  if ((res == 0) && (client.piped > 0)) res = -EPIPE;
+  if (res > 0) client.piped -= std::min<size_t>(client.piped, res);
+  on_uring_send(client_fd, gen, res);
+}
+
+void TcpServer::process_uring_input(int client_fd)
+{
+  auto& client = m_uring->clients[client_fd];
+  if (client.parked) return;
+
+  // Requests of one connection are served one at a time, nothing is read while one is parked
+  utils::IFramer::Frame frame;
+    while (true) {
+      auto status = m_framer->next(client.in.data(), frame);
+        if (status == utils::IFramer::Status::Error) {
+          UFW_LOG_WARN("Malformed frame. Closing connection. sockfd = ", client_fd);
+          count_error(ReceiveError);
+          close_uring_client(client_fd);
+          return;
+      }
+        if (status == utils::IFramer::Status::Incomplete) {
+          // Everything read so far is answered: send it, the next recv is linked behind
+          send_uring_output(client_fd);
+          return;
+      }
+      auto request = client.in.slice(frame.payload);
+      client.in.consume(frame.consumed);
+
+        if (overloaded(nullptr)) {
+          ++m_shed_requests;
+            if ((m_limits.policy == ShedPolicy::Close) || m_limits.reject_response.empty()) {
+              close_uring_client(client_fd);
+              return;
+          }
+          m_framer->encode(m_limits.reject_response, client.out.buffer());
+          continue;
+      }
+      client.parked = true;
+      ++m_requests_in_flight;
+      utils::bump(thread_stats().requests);
+
+      uint32_t gen = client.gen & 0xFFFFFF;
+      std::weak_ptr<UringEngine> engine = m_uring;
+      auto started = std::chrono::steady_clock::now();
+      auto done = [this, engine, client_fd, gen, started](utils::Response response) {
+        auto uring = engine.lock();
+        if (!uring) return;
+        uring->post([this, client_fd, gen, started, response = std::move(response)]() mutable {
+          thread_stats().handler.record(nanos_since(started));
+          complete_uring_request(client_fd, gen, std::move(response));
+        });
+      };
+      m_async_handler(client_fd, request, make_completion(std::move(done)));
+      return;
+    }
+}
+
+void TcpServer::complete_uring_request(int client_fd, uint32_t gen, utils::Response response)
+{
+  --m_requests_in_flight;
+  auto it = m_uring->clients.find(client_fd);
+  if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen)) return;
+  it->second.parked = false;
+    if (!encode_response(std::move(response), it->second.out)) {
+      close_uring_client(client_fd);
+      return;
+  }
+  process_uring_input(client_fd);
+  update_uring_deadline(client_fd, gen);
+}
+
+void TcpServer::close_uring_client(int client_fd)
+{
+  close(client_fd);
+  auto it = m_uring->clients.find(client_fd);
+  if (it == m_uring->clients.end()) return;
+  if (it->second.timer != 0) m_uring->timers.cancel(it->second.timer);
+  m_uring->clients.erase(it);
+  --m_connections;
+}
+
+void TcpServer::update_uring_deadline(int client_fd, uint32_t gen)
+{
+  if (!timeouts_enabled()) return;
+  auto it = m_uring->clients.find(client_fd);
+  if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen) || it->second.failed) return;
+  auto& client = it->second;
+
+  // Same rules as update_deadline(), a parked client waits for its handler
+  Deadline deadline = Deadline::Idle;
+    if (!client.out.empty()) {
+      deadline = Deadline::Write;
+    } else if (client.parked) {
+      deadline = Deadline::None;
+    } else if (!client.in.empty()) {
+      deadline = Deadline::Read;
+    }
+  uint64_t consumed = client.received - client.in.readable();
+  bool restart = (deadline != client.deadline) || ((deadline == Deadline::Write) && client.write_progress) ||
+                 ((deadline == Deadline::Read) && (consumed != client.consumed)) ||
+                 ((deadline == Deadline::Idle) && client.read_progress);
+  client.consumed = consumed;
+  client.read_progress = client.write_progress = false;
+  if (!restart) return;
+
+  client.deadline = deadline;
+  auto timeout = timeout_of(m_timeouts, deadline);
+    if (timeout.count() == 0) {
+      if (client.timer != 0) m_uring->timers.cancel(client.timer);
+      client.timer = 0;
+      return;
+  }
+  if ((client.timer != 0) && m_uring->timers.reschedule(client.timer, timeout)) return;
+  client.timer = m_uring->timers.schedule(timeout, [this, client_fd, gen]() {
+    auto it = m_uring->clients.find(client_fd);
+    if ((it == m_uring->clients.end()) || ((it->second.gen & 0xFFFFFF) != gen)) return;
+    auto& client = it->second;
+    client.timer = 0;
+    client.failed = true;
+    UFW_LOG_WARN(deadline_name(client.deadline), " timeout. Closing connection. sockfd = ", client_fd);
+    // The pending recv or send completes with an error and closes the connection
+    shutdown(client_fd, SHUT_RDWR);
+  });
+}
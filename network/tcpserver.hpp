@@ -3,6 +3,8 @@
  * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
  * @brief Simple TCP server implementation for network communications
  * @brief Provides multi-client TCP socket operations with thread pool support and request handling functionality
+ * @brief Connections are served by blocking pool threads, edge-triggered epoll reactors or an io_uring ring
+ * @brief Listens on IPv4, IPv6 (dual-stack) or unix domain stream sockets
  * @version 0.1
  * @date 2017-11-23
  *
@@ -13,12 +15,30 @@
 #ifndef UFW_SIMPLETCPSERVER_HPP
 #define UFW_SIMPLETCPSERVER_HPP
 
+#include "affinity.hpp"
+#include "batcher.hpp"
+#include "bufferpool.hpp"
+#include "epollreactor.hpp"
+#include "framer.hpp"
 #include "ihandler.hpp"
+#include "response.hpp"
+#include "responsecache.hpp"
+#include "socketaddress.hpp"
+#include "sockettuning.hpp"
+#include "sockutils.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
+#include "timingwheel.hpp"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
@@ -42,41 +62,431 @@ public:
     NotRunning = 9,
     InvalidPort = 10
   };
+  static constexpr size_t kResultCodes = InvalidPort + 1;
 
-  using RqHandler = std::function<std::string(int, const std::string&)>;
+  /**
+   * @brief I/O engine used to serve accepted connections.
+   *
+   * - Blocking: every connection occupies one pool thread blocked in `recv()`.
+   * - Reactor: non-blocking sockets multiplexed by a few edge-triggered epoll loops,
+   *   the handler is called on the loop thread only when data is ready.
+   * - Sharded: one reactor per shard, each with its own SO_REUSEPORT listener. The kernel
+   *   spreads incoming connections over the listeners and a connection never leaves its shard.
+   * - IoUring: one ring thread with multishot accept, provided-buffer recv and send SQEs
+   *   linked to the next recv. Falls back to Reactor when the kernel has no io_uring.
+   */
+  enum class IoMode
+  {
+    Blocking,
+    Reactor,
+    IoUring,
+    Sharded
+  };
 
-  TcpServer(RqHandler callback): m_callback(callback), m_running(false) {}
+  /**
+   * @brief What happens to connections and requests arriving while the server is over one of its limits.
+   *
+   * A shed request is answered with AdmissionLimits::reject_response without calling the handler,
+   * or its connection is closed if the policy is Close or there is no reject response.
+   */
+  enum class ShedPolicy
+  {
+    Reject,      // a shed connection gets the reject response (unframed), then it is closed
+    Close,       // a shed connection is closed right after accept
+    PauseAccept  // listeners stop accepting for accept_pause, the backlog holds the connections meanwhile
+  };
 
-  TcpServer(IHandler* handler): m_running(false)
+  /**
+   * @brief Overload thresholds, 0 disables a limit.
+   */
+  struct AdmissionLimits
   {
-    m_callback = [handler](int socket, const std::string& input) {
-      return handler->handle(socket, input);
-    };
-  }
+    size_t max_connections{0};  // open connections
+    /**
+     * Work waiting for a thread: accepted connections in the Blocking pool queue, or pipelined
+     * requests in the worker pool queue.
+     */
+    size_t max_queue_depth{0};
+    size_t max_in_flight{0};  // requests handed to workers or async handlers and not completed yet
+    std::chrono::milliseconds max_queue_delay{0};  // how long queued work may wait for a thread
+    ShedPolicy policy{ShedPolicy::Close};
+    std::string reject_response;
+    std::chrono::milliseconds accept_pause{100};
+  };
 
-  ~TcpServer()
+  struct AdmissionStats
   {
-    stop();
-  }
+    uint64_t shed_connections{0};
+    uint64_t shed_requests{0};
+    uint64_t accept_pauses{0};
+    uint64_t connections{0};
+    uint64_t requests_in_flight{0};
+  };
 
-  bool start(int port);
+  /**
+   * @brief Per-connection deadlines, 0 disables one. An expired connection is closed.
+   */
+  struct Timeouts
+  {
+    std::chrono::milliseconds idle{0};  // no request arrives and nothing is being answered
+    std::chrono::milliseconds read{0};  // a request that started arriving isn't complete yet
+    std::chrono::milliseconds write{0};  // pending response bytes make no progress
+  };
+
+  /**
+   * @brief Traffic counters and latency distributions merged from every thread of the server.
+   * Latencies are in nanoseconds.
+   */
+  struct Stats
+  {
+    uint64_t connections_accepted{0};
+    uint64_t active_connections{0};
+    uint64_t requests{0};
+    uint64_t bytes_received{0};
+    uint64_t bytes_sent{0};
+    std::array<uint64_t, kResultCodes> errors{};  // indexed by TcpServerResult
+    utils::LatencyHistogram first_byte;  // accept until the first byte of the connection arrives
+    utils::LatencyHistogram handler;  // handler call, or until an asynchronous handler's response is back
+    utils::LatencyHistogram send;  // response ready until its last byte is handed to the kernel
+    AdmissionStats admission;
+    utils::LatencyHistogram batch_size;  // requests per BatchHandler call, a count rather than nanoseconds
+    utils::ResponseCache::Stats cache;  // all zero without a response cache
+  };
+
+  using RqHandler = std::function<std::string(int, const std::string&)>;
+  /**
+   * @brief Handler getting every complete frame as a view into the connection buffer.
+   * The view is valid for the duration of the call only. An empty result sends nothing back.
+   */
+  using FrameHandler = std::function<std::string(int, std::string_view)>;
+  /**
+   * @brief Allocation-free handler: the request is a slice of a pooled receive block that may be kept
+   * after the call without copying, the response is written into a reused string.
+   */
+  using SliceHandler = std::function<void(int, const utils::BufferSlice&, std::string&)>;
+  /**
+   * @brief Handler building a scatter-gather response: owned bytes, slices, shared buffers and file
+   * regions are written with one sendmsg()/sendfile() sequence and never joined into one string.
+   */
+  using ResponseHandler = std::function<void(int, const utils::BufferSlice&, utils::Response&)>;
+  /**
+   * @brief Delivers the response of an asynchronous request. May be called from any thread, once,
+   * copies refer to the same request. Dropping every copy uncalled answers with an empty response.
+   */
+  using Completion = IAsyncHandler::Completion;
+  /**
+   * @brief Handler answering through a Completion. Its connection is parked (not read) until the
+   * response arrives while the calling loop goes on serving others, so a few threads can keep
+   * thousands of slow requests in flight. The blocking engine waits for the completion.
+   */
+  using AsyncHandler = std::function<void(int, const utils::BufferSlice&, Completion)>;
+  /**
+   * @brief Handler serving requests of many connections in one call, for backends where a batch
+   * costs about as much as a single request (lookups, writes). Fills in the response of every
+   * utils::BatchRequest. Batches are cut by setBatchLimits() and handled one at a time on a thread
+   * of their own, the connections are parked meanwhile as with an AsyncHandler.
+   */
+  using BatchHandler = utils::RequestBatcher::Handler;
+
+  TcpServer(RqHandler callback);
+  TcpServer(IHandler* handler);
+  TcpServer(FrameHandler handler, std::shared_ptr<const utils::IFramer> framer);
+  TcpServer(SliceHandler handler, std::shared_ptr<const utils::IFramer> framer);
+  TcpServer(ResponseHandler handler, std::shared_ptr<const utils::IFramer> framer);
+  TcpServer(AsyncHandler handler, std::shared_ptr<const utils::IFramer> framer);
+  TcpServer(IAsyncHandler* handler, std::shared_ptr<const utils::IFramer> framer = nullptr);
+  TcpServer(BatchHandler handler, std::shared_ptr<const utils::IFramer> framer = nullptr);
+  ~TcpServer();
+
+  /**
+   * @brief Adapts a synchronous handler to AsyncHandler.
+   * @param pool Runs the handler there, so it doesn't block the loops. nullptr runs it inline.
+   */
+  static AsyncHandler makeAsync(RqHandler handler, utils::ThreadPool* pool = nullptr);
+
+  /**
+   * @brief Listens on @p port of every IPv4 address.
+   */
+  bool start(int port, IoMode mode = IoMode::Blocking);
+  /**
+   * @brief Listens on any stream socket address, see utils::SocketAddress.
+   *
+   * A unix socket file left behind by a dead process is replaced, stop() removes it. Unix sockets
+   * have no SO_REUSEPORT, IoMode::Sharded falls back to Reactor for them.
+   */
+  bool start(const utils::SocketAddress& address, IoMode mode = IoMode::Blocking);
+  /**
+   * @brief Serves listening sockets inherited from another process (see utils::ListenerHandoff)
+   * instead of opening new ones, connections queued on them are kept. Takes ownership of @p listeners.
+   *
+   * Sharded mode serves every listener on a shard of its own, at least as many shards as listeners.
+   * Several listeners (a sharded predecessor) switch other modes to Sharded, closing any of them
+   * would reset the connections queued on it.
+   */
+  bool start(std::vector<int> listeners, IoMode mode = IoMode::Blocking);
   void stop();
+  /**
+   * @brief Graceful stop after the listeners were handed over: stops accepting, serves the open
+   * connections until they are closed or @p timeout passes, then stops.
+   *
+   * The listening sockets are closed without shutdown() and a unix socket file is left in place,
+   * so a process holding copies of them goes on accepting without a single refused connection.
+   * @return false if connections were still open at the timeout.
+   */
+  bool drain(std::chrono::milliseconds timeout);
+  /**
+   * @brief Listening sockets of the running server to hand over, the first one first, then those of
+   * the other shards. They stay owned by the server.
+   */
+  [[nodiscard]]
+  std::vector<int> listenerFds() const;
 
   [[nodiscard]]
   bool isRunning() const;
 
+  /**
+   * @brief Engine actually serving connections, differs from the requested one after a fallback.
+   */
+  [[nodiscard]]
+  IoMode ioMode() const;
+
+  /**
+   * @brief Sets the number of epoll loops used in IoMode::Reactor. Takes effect on the next start().
+   */
+  void setReactorThreads(size_t count);
+  /**
+   * @brief Sets the number of shards used in IoMode::Sharded. Takes effect on the next start().
+   * @param cpus CPUs to pin the shard loops to, shard `i` goes to `cpus[i % cpus.size()]`. Empty disables pinning.
+   */
+  void setShards(size_t count, std::vector<int> cpus = {});
+  /**
+   * @brief Where the server's threads run: loop `i` (reactor or shard), the io_uring or accept
+   * thread as loop 0, and worker `i` of the pipeline or blocking client pool at `policy.placementOf(i)`.
+   *
+   * Every loop moves itself before it allocates, and its buffer pool fills on the loop thread, so
+   * with utils::AffinityPolicy::spreadNodes() each loop works on memory of its own node. Overrides
+   * the CPUs given to setShards(). Unset by default. Takes effect on the next start().
+   */
+  void setAffinity(utils::AffinityPolicy policy);
+  /**
+   * @brief Placement chosen on start(): an entry per loop or accept thread, one per pinned pool
+   * covering its threads. Pinned entries are logged, all of them are part of statsText().
+   */
+  [[nodiscard]]
+  std::vector<utils::ThreadPlacement> placement() const;
+  /**
+   * @brief Sets the listen() backlog of every listening socket. Takes effect on the next start().
+   */
+  void setBacklog(int backlog);
+  /**
+   * @brief Sets how the byte stream is split into requests and how responses are framed.
+   * Defaults to utils::RawFramer (one request per read). Must be set before start().
+   */
+  void setFramer(std::shared_ptr<const utils::IFramer> framer);
+  /**
+   * @brief Maximum number of requests of one connection handled concurrently (Reactor and Sharded modes).
+   *
+   * With a depth above 1 the frames of a connection are handed to a worker pool as they arrive and
+   * the handler may run for several of them at once, so it must be thread-safe. Responses are still
+   * written in request order. Reading from a connection pauses while its window is full.
+   * Defaults to 1: the handler runs on the loop thread. Takes effect on the next start().
+   * For an AsyncHandler this is the number of requests of one connection awaiting completion,
+   * no worker pool is involved.
+   */
+  void setPipelineDepth(size_t depth);
+  /**
+   * @brief Size of the worker pool serving pipelined requests. Takes effect on the next start().
+   */
+  void setWorkerThreads(size_t count);
+  /**
+   * @brief Sends response pieces of at least @p bytes with MSG_ZEROCOPY (Blocking, Reactor and Sharded modes).
+   *
+   * Pays off for payloads of tens of kilobytes and more, below that the page pinning and completion
+   * notifications cost more than the copy. 0 (default) disables it. Takes effect for new connections.
+   */
+  void setZeroCopyThreshold(size_t bytes);
+  /**
+   * @brief When a batch of a BatchHandler is cut: once it holds @p max_size requests or its oldest
+   * request waited @p max_delay. 64 requests and 500 us by default. Takes effect with the next batch.
+   */
+  void setBatchLimits(size_t max_size, std::chrono::microseconds max_delay);
+  /**
+   * @brief Answers requests seen before from @p cache instead of calling the handler, for handlers
+   * whose response depends on the request bytes alone. Serves handlers returning a string
+   * (RqHandler, IHandler, FrameHandler, SliceHandler). Invalidate through the cache when the data
+   * behind it changes. Must be set before start(), nullptr removes it.
+   */
+  void setResponseCache(std::shared_ptr<utils::ResponseCache> cache);
+  /**
+   * @brief Sets the socket options of the listeners, accepted connections inherit them.
+   * utils::SocketTuning::defaults() (TCP_NODELAY) unless set. Takes effect on the next start().
+   */
+  void setSocketTuning(utils::SocketTuning tuning);
+  /**
+   * @brief Options in effect on the first listener, std::nullopt while not listening.
+   */
+  [[nodiscard]]
+  std::optional<ucommon::SocketOptions> socketOptions() const;
+
+  /**
+   * @brief Sets the idle, request read and write stall timeouts. Must be set before start().
+   *
+   * Time spent in the handler or waiting for a completion never counts. The loops keep the
+   * deadlines in their timing wheel, re-arming one on activity costs no syscall. The blocking
+   * engine shares one timer thread that shuts a late socket down, its write timeout covers the
+   * whole response.
+   */
+  void setTimeouts(Timeouts timeouts);
+
+  /**
+   * @brief Sets the overload thresholds and what is shed past them. Must be set before start().
+   *
+   * Connections are checked on accept against every limit. Requests are checked where they can
+   * queue up: before they go to the worker pool (pipelining) or to an asynchronous handler.
+   * The io_uring engine can't pause its multishot accept and closes shed connections instead.
+   */
+  void setAdmissionLimits(AdmissionLimits limits);
+  /**
+   * @brief Shedding counters and current load of the current (or last) run.
+   */
+  [[nodiscard]]
+  AdmissionStats admissionStats() const;
+
+  /**
+   * @brief Receive block pool counters summed over all loops of the current (or last) run.
+   */
+  [[nodiscard]]
+  utils::BufferPool::Stats bufferPoolStats() const;
+
+  /**
+   * @brief Snapshot of the current (or last) run. Every thread records into its own copy,
+   * they are merged here, so taking a snapshot never slows the loops down.
+   */
+  [[nodiscard]]
+  Stats stats() const;
+  /**
+   * @brief stats() as `name value` lines, latencies as microsecond quantiles (p50 to p999).
+   */
+  [[nodiscard]]
+  std::string statsText() const;
+  /**
+   * @brief Serves statsText() on a separate port, to `curl host:port` or any line sent by netcat.
+   * Runs a small reactor of its own, independent of start() and stop().
+   */
+  bool startStatsEndpoint(int port);
+  void stopStatsEndpoint();
+
 private:
-  int m_port{-1};
+  struct Connection;
+  struct UringEngine;
+  struct ThreadStats;
+
+  utils::SocketAddress m_address;
   int m_server_fd{-1};
-  RqHandler m_callback;
+  SliceHandler m_handler;
+  ResponseHandler m_response_handler;
+  AsyncHandler m_async_handler;
+  std::unique_ptr<utils::RequestBatcher> m_batcher;  // feeds a BatchHandler, m_async_handler submits to it
+  std::shared_ptr<utils::ResponseCache> m_cache;  // in front of m_handler
+  std::shared_ptr<const utils::IFramer> m_framer;
   std::unordered_set<int> m_clients;
   std::mutex m_clients_mutex;
   std::thread m_server_thread;
-  bool m_running{false};
+  std::atomic<bool> m_running{false};
+  std::atomic<bool> m_accepting{false};
+  std::atomic<bool> m_listeners_released{false};  // drain(): another process accepts on the listeners
+  std::vector<int> m_inherited;  // listeners passed to start(), taken before any new one is opened
+  int m_accept_wakeup{-1};  // eventfd getting the Blocking mode accept loop out of poll()
+
+  IoMode m_mode{IoMode::Blocking};
+  int m_backlog{SOMAXCONN};
+  size_t m_reactor_threads{2};
+  std::vector<int> m_shard_cpus;
+  utils::AffinityPolicy m_affinity;
+  mutable std::mutex m_placement_mutex;
+  std::vector<utils::ThreadPlacement> m_placement;
+  std::vector<int> m_shard_fds;
+  std::vector<std::shared_ptr<utils::EpollReactor>> m_reactors;
+  std::atomic<size_t> m_next_reactor{0};
+
+  size_t m_zerocopy_threshold{0};
+  utils::SocketTuning m_tuning{utils::SocketTuning::defaults()};
+  size_t m_pipeline_depth{1};
+  size_t m_worker_threads{std::max(1u, std::thread::hardware_concurrency())};
+  std::unique_ptr<utils::ThreadPool> m_workers;
+  std::vector<std::unique_ptr<utils::BufferPool>> m_pools;
+
+  std::shared_ptr<UringEngine> m_uring;
+
+  Timeouts m_timeouts;
+  std::unique_ptr<utils::TimerThread> m_timer_thread;  // Blocking mode
+
+  AdmissionLimits m_limits;
+  std::atomic<uint64_t> m_shed_connections{0};
+  std::atomic<uint64_t> m_shed_requests{0};
+  std::atomic<uint64_t> m_accept_pauses{0};
+  std::atomic<uint64_t> m_connections{0};
+  std::atomic<uint64_t> m_requests_in_flight{0};
+  std::atomic<int64_t> m_queue_delay_us{0};  // wait of the work most recently taken off a queue
+
+  utils::PerThread<ThreadStats> m_stats;
+  std::unique_ptr<TcpServer> m_stats_server;
 
   void run();
-  void handle_client(int client_fd);
+  void handle_client(int client_fd, std::chrono::steady_clock::time_point accepted);
   void close_server();
+  void stop_accepting();
+  void wake_acceptor();
+  int take_listener(bool reuse_port);
+  int open_listener(bool reuse_port);
+  int bind_listener(int server_fd);
+  bool dispatch_frames(int client_fd, utils::BlockBuffer& in, utils::OutputQueue& out);
+  void call_handler(int client_fd, const utils::BufferSlice& request, utils::Response& response);
+  void run_handler(int client_fd, const utils::BufferSlice& request, std::string& response);
+  bool encode_response(utils::Response&& response, utils::OutputQueue& out) const;
+  void await_response(int client_fd, const utils::BufferSlice& request, utils::Response& response);
+
+  bool overloaded(utils::ThreadPool* queue);
+  bool admit_connection(utils::ThreadPool* queue);
+  void note_queue_delay(std::chrono::steady_clock::time_point queued);
+  void shed_connection(int client_fd);
+  void tune_connection(int client_fd);
+  bool timeouts_enabled() const;
+  ThreadStats& thread_stats();
+  void count_error(TcpServerResult code);
+
+  utils::AffinityPolicy loop_affinity() const;
+  void note_placement(std::string thread, utils::CpuPlacement placement);
+  void note_pool_placement(const std::string& pool, size_t threads);
+
+  bool start_reactors(size_t count);
+  void stop_reactors();
+  void on_accept(size_t acceptor, int listen_fd);
+  void attach_client(size_t index, int client_fd, std::chrono::steady_clock::time_point accepted);
+  void on_client_event(const std::shared_ptr<Connection>& conn, uint32_t events);
+  bool process_input(const std::shared_ptr<Connection>& conn);
+  void complete_request(const std::shared_ptr<Connection>& conn, uint64_t seq, utils::Response response);
+  bool shed_request(const std::shared_ptr<Connection>& conn, uint64_t seq);
+  bool drain_window(Connection& conn);
+  bool pause_accept(size_t acceptor, int listen_fd);
+  void flush_client(Connection& conn);
+  void close_client(Connection& conn);
+  void update_deadline(const std::shared_ptr<Connection>& conn);
+
+  bool start_uring();
+  void run_uring();
+  void cancel_uring_accept();
+  void on_uring_accept(int32_t res, uint32_t flags);
+  void on_uring_recv(int client_fd, uint32_t gen, int32_t res, uint32_t flags);
+  void on_uring_send(int client_fd, uint32_t gen, int32_t res);
+  void send_uring_output(int client_fd);
+  void splice_uring_output(int client_fd, int file_fd, off_t offset, size_t length);
+  void on_uring_splice_in(int client_fd, uint32_t gen, int32_t res);
+  void on_uring_splice_out(int client_fd, uint32_t gen, int32_t res);
+  void process_uring_input(int client_fd);
+  void complete_uring_request(int client_fd, uint32_t gen, utils::Response response);
+  void close_uring_client(int client_fd);
+  void update_uring_deadline(int client_fd, uint32_t gen);
 };
 
 #endif  // UFW_SIMPLETCPSERVER_HPP
\ No newline at end of file
@@ -26,10 +26,16 @@ namespace utils
     add_threads(threads);
   }
 
+  ThreadPool::ThreadPool(size_t threads, AffinityPolicy affinity) : m_affinity(std::move(affinity))
+  {
+    add_threads(threads);
+  }
+
   void ThreadPool::add_threads(size_t count)
   {
       for (size_t i = 0; i < count; ++i) {
-        workers.emplace_back([this] {
+        workers.emplace_back([this, placement = m_affinity.placementOf(workers.size())] {
+          applyPlacement(placement);
           for (;;) {
             std::function<void()> task;
 
@@ -12,6 +12,8 @@
 #ifndef UFW_THREADPOOL_UTILS_HPP
 #define UFW_THREADPOOL_UTILS_HPP
 
+#include "affinity.hpp"
+
 #include <condition_variable>
 #include <functional>
 #include <future>
@@ -29,6 +31,10 @@ namespace utils
   {
   public:
     explicit ThreadPool(size_t);
+    /**
+     * @brief Worker `i` runs at `affinity.placementOf(i)`, threads added later included.
+     */
+    ThreadPool(size_t threads, AffinityPolicy affinity);
     ~ThreadPool();
 
     template<class F, class... Args>
@@ -74,6 +80,7 @@ namespace utils
     size_t stop_workers = 0;  // Workers to kill
 
     size_t m_queue_limit = std::numeric_limits<size_t>::max();
+    AffinityPolicy m_affinity;
   };
 
 }  // namespace utils
@@ -0,0 +1,324 @@
+/**
+ * @file timingwheel.cpp
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "timingwheel.hpp"
+
+#include <algorithm>
+#include <climits>
+
+namespace utils
+{
+  namespace
+  {
+    inline uint64_t rotate_right(uint64_t bits, unsigned shift) noexcept
+    {
+      shift &= 63;
+      return shift == 0 ? bits : (bits >> shift) | (bits << (64 - shift));
+    }
+  }  // namespace
+
+  TimingWheel::TimingWheel(std::chrono::milliseconds tick, Clock::time_point start):
+      m_origin(start), m_tick(std::max<Clock::duration>(tick, std::chrono::milliseconds(1)))
+  {
+    std::fill(std::begin(m_heads), std::end(m_heads), kNil);
+  }
+
+  TimingWheel::TimerId TimingWheel::schedule(std::chrono::milliseconds delay, Callback callback)
+  {
+    uint32_t index;
+      if (!m_free.empty()) {
+        index = m_free.back();
+        m_free.pop_back();
+      } else {
+        index = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+      }
+    auto& node = m_nodes[index];
+    node.expires = expiry_after(delay);
+    node.armed = true;
+    node.callback = std::move(callback);
+    link(index);
+    ++m_size;
+    return (static_cast<uint64_t>(node.gen) << 32) | (index + 1);
+  }
+
+  bool TimingWheel::reschedule(TimerId id, std::chrono::milliseconds delay)
+  {
+    auto* node = find(id);
+    if (node == nullptr) return false;
+    auto index = static_cast<uint32_t>(node - m_nodes.data());
+    unlink(index);
+    node->expires = expiry_after(delay);
+    link(index);
+    return true;
+  }
+
+  bool TimingWheel::cancel(TimerId id)
+  {
+    auto* node = find(id);
+    if (node == nullptr) return false;
+    auto index = static_cast<uint32_t>(node - m_nodes.data());
+    unlink(index);
+    release(index);
+    return true;
+  }
+
+  bool TimingWheel::isPending(TimerId id) const noexcept
+  {
+    return find(id) != nullptr;
+  }
+
+  void TimingWheel::clear()
+  {
+      for (uint32_t index = 0; index < m_nodes.size(); ++index) {
+        if (m_nodes[index].armed) release(index);
+      }
+    std::fill(std::begin(m_heads), std::end(m_heads), kNil);
+    std::fill(std::begin(m_occupied), std::end(m_occupied), 0);
+  }
+
+  size_t TimingWheel::advance(Clock::time_point now)
+  {
+    return expire(now, [](TimerId, Callback&& callback) { callback(); });
+  }
+
+  size_t TimingWheel::collect(Clock::time_point now, std::vector<std::pair<TimerId, Callback>>& expired)
+  {
+    return expire(now, [&expired](TimerId id, Callback&& callback) { expired.emplace_back(id, std::move(callback)); });
+  }
+
+  int TimingWheel::nextTimeoutMs(Clock::time_point now) const
+  {
+    uint64_t due = next_due();
+    if (due == UINT64_MAX) return -1;
+    auto deadline = m_origin + m_tick * static_cast<Clock::rep>(due);
+    if (deadline <= now) return 0;
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+    return static_cast<int>(std::min<int64_t>(wait, INT_MAX));
+  }
+
+  TimingWheel::Node* TimingWheel::find(TimerId id) noexcept
+  {
+    return const_cast<Node*>(static_cast<const TimingWheel*>(this)->find(id));
+  }
+
+  const TimingWheel::Node* TimingWheel::find(TimerId id) const noexcept
+  {
+    uint64_t index = (id & 0xFFFFFFFF) - 1;
+    if (index >= m_nodes.size()) return nullptr;
+    const auto& node = m_nodes[index];
+    if (!node.armed || (node.gen != static_cast<uint32_t>(id >> 32))) return nullptr;
+    return &node;
+  }
+
+  uint64_t TimingWheel::ticks_until(Clock::time_point time) const noexcept
+  {
+    if (time <= m_origin) return 0;
+    return static_cast<uint64_t>((time - m_origin) / m_tick);
+  }
+
+  uint64_t TimingWheel::expiry_after(std::chrono::milliseconds delay) const noexcept
+  {
+    // Counted from the clock rather than m_now, which lags while the owner is busy, and rounded up
+    auto deadline = Clock::now() + std::max(delay, std::chrono::milliseconds(0));
+    uint64_t expires = ticks_until(deadline);
+    if (m_origin + m_tick * static_cast<Clock::rep>(expires) < deadline) ++expires;
+    return std::max(expires, m_now + 1);
+  }
+
+  void TimingWheel::link(uint32_t index)
+  {
+    auto& node = m_nodes[index];
+    uint64_t expires = std::max(node.expires, m_now);
+    uint64_t delta = expires - m_now;
+    unsigned level = 0;
+    while ((level + 1 < kLevels) && (delta >= (uint64_t(1) << (kLevelBits * (level + 1))))) ++level;
+    // Out of range: park it in the last slot the top level reaches, it is linked again from there
+    uint64_t range = uint64_t(1) << (kLevelBits * kLevels);
+    if (delta >= range) expires = m_now + range - 1;
+
+    unsigned index_in_level = (expires >> (kLevelBits * level)) & (kSlots - 1);
+    node.slot = static_cast<uint16_t>(level * kSlots + index_in_level);
+    node.prev = kNil;
+    node.next = m_heads[node.slot];
+    if (node.next != kNil) m_nodes[node.next].prev = index;
+    m_heads[node.slot] = index;
+    m_occupied[level] |= uint64_t(1) << index_in_level;
+  }
+
+  void TimingWheel::unlink(uint32_t index)
+  {
+    auto& node = m_nodes[index];
+      if (node.prev != kNil) {
+        m_nodes[node.prev].next = node.next;
+      } else {
+        m_heads[node.slot] = node.next;
+      }
+    if (node.next != kNil) m_nodes[node.next].prev = node.prev;
+    if (m_heads[node.slot] == kNil) m_occupied[node.slot / kSlots] &= ~(uint64_t(1) << (node.slot % kSlots));
+    node.prev = node.next = kNil;
+  }
+
+  void TimingWheel::release(uint32_t index)
+  {
+    auto& node = m_nodes[index];
+    node.armed = false;
+    node.callback = nullptr;
+    ++node.gen;  // stale ids of this node stop matching
+    m_free.push_back(index);
+    --m_size;
+  }
+
+  void TimingWheel::cascade()
+  {
+      for (unsigned level = 1; level < kLevels; ++level) {
+        unsigned index_in_level = (m_now >> (kLevelBits * level)) & (kSlots - 1);
+        unsigned slot = level * kSlots + index_in_level;
+        uint32_t index = m_heads[slot];
+        m_heads[slot] = kNil;
+        m_occupied[level] &= ~(uint64_t(1) << index_in_level);
+          while (index != kNil) {
+            uint32_t next = m_nodes[index].next;
+            link(index);
+            index = next;
+          }
+        // A level moves down only when the one below has wrapped around
+        if (index_in_level != 0) break;
+      }
+  }
+
+  uint64_t TimingWheel::next_due() const noexcept
+  {
+    if (m_size == 0) return UINT64_MAX;
+    uint64_t due = UINT64_MAX;
+    // Level 0 slots map to the ticks (m_now, m_now + 64), the bitmap finds the first one in use
+    uint64_t ahead = rotate_right(m_occupied[0], static_cast<unsigned>((m_now + 1) & (kSlots - 1)));
+    if (ahead != 0) due = m_now + 1 + __builtin_ctzll(ahead);
+      for (unsigned level = 1; level < kLevels; ++level) {
+          if (m_occupied[level] != 0) {
+            due = std::min(due, (m_now | (kSlots - 1)) + 1);
+            break;
+        }
+      }
+    return due;
+  }
+
+  template<typename F>
+  size_t TimingWheel::expire(Clock::time_point now, F&& fire)
+  {
+    uint64_t target = ticks_until(now);
+    size_t fired = 0;
+      while (m_now < target) {
+        uint64_t due = next_due();
+          if (due > target) {
+            // Nothing is due in between, jump straight there
+            m_now = target;
+            break;
+        }
+        m_now = due;
+        if ((m_now & (kSlots - 1)) == 0) cascade();
+
+        unsigned slot = m_now & (kSlots - 1);
+          // Timers fired here may cancel the others of the slot, so take them one by one
+          while (m_heads[slot] != kNil) {
+            uint32_t index = m_heads[slot];
+            unlink(index);
+            auto& node = m_nodes[index];
+              if (node.expires > m_now) {
+                link(index);
+                continue;
+            }
+            TimerId id = (static_cast<uint64_t>(node.gen) << 32) | (index + 1);
+            Callback callback = std::move(node.callback);
+            release(index);
+            ++fired;
+            fire(id, std::move(callback));
+          }
+      }
+    return fired;
+  }
+
+  TimerThread::TimerThread(std::chrono::milliseconds tick): m_wheel(tick)
+  {
+    m_thread = std::thread(&TimerThread::loop, this);
+  }
+
+  TimerThread::~TimerThread()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wakeup.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+  }
+
+  TimerThread::TimerId TimerThread::runAfter(std::chrono::milliseconds delay, Callback callback)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto id = m_wheel.schedule(delay, std::move(callback));
+    wake_before(delay);
+    return id;
+  }
+
+  bool TimerThread::restart(TimerId id, std::chrono::milliseconds delay)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_wheel.reschedule(id, delay)) return false;
+    wake_before(delay);
+    return true;
+  }
+
+  bool TimerThread::cancel(TimerId id)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_wheel.cancel(id)) return true;
+    if (std::this_thread::get_id() == m_thread.get_id()) return false;
+    m_fired.wait(lock, [this, id]() { return std::find(m_firing.begin(), m_firing.end(), id) == m_firing.end(); });
+    return false;
+  }
+
+  TimerThread& TimerThread::shared()
+  {
+    static TimerThread instance;
+    return instance;
+  }
+
+  void TimerThread::wake_before(std::chrono::milliseconds delay)
+  {
+    // The thread sleeps until the wheel's next tick, only an earlier deadline has to wake it
+    if (TimingWheel::Clock::now() + delay < m_wake_at) m_wakeup.notify_one();
+  }
+
+  void TimerThread::loop()
+  {
+    std::vector<std::pair<TimerId, Callback>> expired;
+    std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stop) {
+        auto now = TimingWheel::Clock::now();
+          if (m_wheel.collect(now, expired) > 0) {
+            for (auto& timer: expired) m_firing.push_back(timer.first);
+            lock.unlock();
+            for (auto& timer: expired) timer.second();
+            expired.clear();
+            lock.lock();
+            m_firing.clear();
+            m_fired.notify_all();
+            continue;
+        }
+        int timeout = m_wheel.nextTimeoutMs(now);
+          if (timeout < 0) {
+            m_wake_at = TimingWheel::Clock::time_point::max();
+            m_wakeup.wait(lock);
+          } else {
+            m_wake_at = now + std::chrono::milliseconds(timeout);
+            m_wakeup.wait_until(lock, m_wake_at);
+          }
+        m_wake_at = TimingWheel::Clock::now();
+      }
+  }
+
+}  // namespace utils
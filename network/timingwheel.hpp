@@ -0,0 +1,190 @@
+/**
+ * @file timingwheel.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Hierarchical timing wheel with O(1) arm, re-arm and cancel
+ * @brief Provides the wheel itself for event loops and a thread driving a shared wheel for blocking code
+ * @version 0.1
+ * @date 2024-12-21
+ *
+ * @copyright Copyright (c) 2024 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_TIMINGWHEEL_HPP
+#define UFW_TIMINGWHEEL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+  /**
+   * @class TimingWheel
+   * @brief Timers of one event loop kept in 4 levels of 64 slots.
+   *
+   * Level 0 holds timers due within 64 ticks, each next level covers 64 times more and is moved
+   * down one level whenever the level below wraps around. Arming links a node into a slot and
+   * cancelling unlinks it, so both cost the same whatever the number of timers. A timer fires on
+   * the first tick boundary at or after its delay, i.e. up to one tick late, never early.
+   * Delays beyond 64^4 ticks are parked in the top level until they come within range.
+   * Not thread-safe: owned by the thread calling advance().
+   */
+  class TimingWheel
+  {
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    /**
+     * @brief Handle of an armed timer, 0 is never returned. Stays unique after the timer is gone.
+     */
+    using TimerId = uint64_t;
+
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10),
+                         Clock::time_point start = Clock::now());
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    /**
+     * @brief Arms a one-shot timer firing once @p delay has passed.
+     */
+    TimerId schedule(std::chrono::milliseconds delay, Callback callback);
+    /**
+     * @brief Moves an armed timer to @p delay from now, keeping its callback.
+     * @return false if the timer has already fired or was cancelled.
+     */
+    bool reschedule(TimerId id, std::chrono::milliseconds delay);
+    /**
+     * @return false if the timer has already fired or was cancelled.
+     */
+    bool cancel(TimerId id);
+    bool isPending(TimerId id) const noexcept;
+    /**
+     * @brief Cancels every timer.
+     */
+    void clear();
+
+    /**
+     * @brief Moves the wheel to @p now and runs the callbacks of the timers due by then.
+     * Callbacks may arm, re-arm and cancel timers, including the ones due in the same call.
+     * @return number of callbacks run.
+     */
+    size_t advance(Clock::time_point now);
+    /**
+     * @brief Like advance() but hands the due timers over instead of running them.
+     */
+    size_t collect(Clock::time_point now, std::vector<std::pair<TimerId, Callback>>& expired);
+
+    /**
+     * @brief Time until the wheel has to be advanced next, for epoll_wait() and friends.
+     * @return -1 if no timer is armed.
+     */
+    int nextTimeoutMs(Clock::time_point now) const;
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+    bool empty() const noexcept
+    {
+      return m_size == 0;
+    }
+
+  private:
+    static constexpr unsigned kLevelBits = 6;
+    static constexpr unsigned kSlots = 1u << kLevelBits;
+    static constexpr unsigned kLevels = 4;
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Node
+    {
+      uint64_t expires{0};  // tick
+      uint32_t prev{kNil};
+      uint32_t next{kNil};
+      uint32_t gen{1};
+      uint16_t slot{0};  // level * kSlots + index
+      bool armed{false};
+      Callback callback;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_free;
+    uint32_t m_heads[kLevels * kSlots];
+    uint64_t m_occupied[kLevels]{};  // non-empty slots of each level
+    size_t m_size{0};
+
+    Clock::time_point m_origin;
+    Clock::duration m_tick;
+    uint64_t m_now{0};  // ticks since m_origin
+
+    Node* find(TimerId id) noexcept;
+    const Node* find(TimerId id) const noexcept;
+    uint64_t ticks_until(Clock::time_point time) const noexcept;
+    uint64_t expiry_after(std::chrono::milliseconds delay) const noexcept;
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade();
+    uint64_t next_due() const noexcept;
+
+    template<typename F>
+    size_t expire(Clock::time_point now, F&& fire);
+  };
+
+  /**
+   * @class TimerThread
+   * @brief Thread-safe timers driven by a background thread, for code that blocks in syscalls.
+   *
+   * A blocking recv() or send() is usually aborted by a callback calling shutdown() on the socket.
+   * Callbacks run on the timer thread and must be short.
+   */
+  class TimerThread
+  {
+  public:
+    using TimerId = TimingWheel::TimerId;
+    using Callback = TimingWheel::Callback;
+
+    explicit TimerThread(std::chrono::milliseconds tick = std::chrono::milliseconds(10));
+    ~TimerThread();
+
+    TimerThread(const TimerThread&) = delete;
+    TimerThread& operator=(const TimerThread&) = delete;
+
+    TimerId runAfter(std::chrono::milliseconds delay, Callback callback);
+    bool restart(TimerId id, std::chrono::milliseconds delay);
+    /**
+     * @brief Disarms the timer. If its callback is running right now, waits for it to return
+     * (unless called from the callback), so whatever it uses may be released afterwards.
+     * @return false if the callback has run or is running.
+     */
+    bool cancel(TimerId id);
+
+    /**
+     * @brief Process-wide instance, started on first use.
+     */
+    static TimerThread& shared();
+
+  private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_fired;
+    TimingWheel m_wheel;
+    std::vector<TimerId> m_firing;  // collected and not run to completion yet
+    TimingWheel::Clock::time_point m_wake_at{TimingWheel::Clock::time_point::max()};
+    bool m_stop{false};
+    std::thread m_thread;
+
+    void loop();
+    void wake_before(std::chrono::milliseconds delay);
+  };
+
+}  // namespace utils
+
+#endif  // UFW_TIMINGWHEEL_HPP
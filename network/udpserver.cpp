@@ -0,0 +1,500 @@
+/**
+ * @file udpserver.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "udpserver.hpp"
+
+#include "../support/logger.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  constexpr size_t kSlotSize = 64 * 1024;  // a whole datagram, or a GRO train of them
+  constexpr size_t kControlSize = CMSG_SPACE(sizeof(int));  // room for the UDP_GRO segment size
+  constexpr int kMaxBatchesPerWakeup = 16;  // then the loop gets to its timers and tasks
+  // GSO trains stay under the Ethernet MTU per datagram and the kernel's segment and size limits
+  constexpr size_t kMaxGsoSegment = 1452;
+  constexpr size_t kMaxGsoSegments = 64;
+  constexpr size_t kMaxGsoBytes = 65000;
+  constexpr size_t kMaxSendBatch = 1024;  // UIO_MAXIOV, the sendmmsg() limit
+
+  bool same_peer(const mmsghdr& left, const mmsghdr& right)
+  {
+    return (left.msg_hdr.msg_namelen == right.msg_hdr.msg_namelen) &&
+           (std::memcmp(left.msg_hdr.msg_name, right.msg_hdr.msg_name, left.msg_hdr.msg_namelen) == 0);
+  }
+}  // namespace
+
+struct UdpServer::Shard
+{
+  struct Reply
+  {
+    size_t slot;  // the request's batch slot, holds the address to answer
+    std::string data;
+  };
+
+  int fd{-1};
+  utils::EpollReactor reactor;
+  bool gro{false};
+  bool gso{false};
+
+  std::unique_ptr<char[]> buffers;
+  std::unique_ptr<char[]> control;
+  std::vector<sockaddr_storage> peers;
+  std::vector<iovec> recv_iov;
+  std::vector<mmsghdr> recv_msgs;
+
+  std::vector<Reply> replies;
+  std::vector<mmsghdr> send_msgs;
+  std::vector<iovec> send_iov;
+  std::unique_ptr<char[]> send_control;
+  size_t send_control_slots{0};
+  std::vector<size_t> msg_segments;
+  std::vector<size_t> msg_bytes;
+
+  std::atomic<uint64_t> datagrams_received{0};
+  std::atomic<uint64_t> datagrams_sent{0};
+  std::atomic<uint64_t> bytes_received{0};
+  std::atomic<uint64_t> bytes_sent{0};
+  std::atomic<uint64_t> receive_calls{0};
+  std::atomic<uint64_t> send_calls{0};
+  std::atomic<uint64_t> gro_datagrams{0};
+  std::atomic<uint64_t> gso_datagrams{0};
+  std::atomic<uint64_t> truncated{0};
+  std::atomic<uint64_t> malformed{0};
+  std::atomic<uint64_t> send_drops{0};
+  std::atomic<uint64_t> send_errors{0};
+
+  explicit Shard(size_t batch):
+      buffers(new char[batch * kSlotSize]),
+      control(new char[batch * kControlSize]),
+      peers(batch),
+      recv_iov(batch),
+      recv_msgs(batch)
+  {
+      for (size_t slot = 0; slot < batch; ++slot) {
+        recv_iov[slot] = {buffers.get() + slot * kSlotSize, kSlotSize};
+        auto& header = recv_msgs[slot].msg_hdr;
+        header.msg_name = &peers[slot];
+        header.msg_iov = &recv_iov[slot];
+        header.msg_iovlen = 1;
+      }
+  }
+};
+
+UdpServer::UdpServer(RqHandler callback)
+{
+  m_handler = [callback](int socket, std::string_view input) { return callback(socket, std::string(input)); };
+}
+
+UdpServer::UdpServer(IHandler* handler)
+{
+  m_handler = [handler](int socket, std::string_view input) { return handler->handle(socket, std::string(input)); };
+}
+
+UdpServer::UdpServer(DatagramHandler handler): m_handler(std::move(handler)) {}
+
+UdpServer::~UdpServer()
+{
+  stop();
+}
+
+bool UdpServer::start(int port)
+{
+    if ((port < 0) || (port > 65535)) {
+      UFW_LOG_ERROR("Invalid port ", port);
+      return false;
+  }
+  return start(utils::SocketAddress::anyIPv4(static_cast<uint16_t>(port)));
+}
+
+bool UdpServer::start(const utils::SocketAddress& address)
+{
+  if (m_running) return true;
+    if ((address.family() != AF_INET) && (address.family() != AF_INET6)) {
+      UFW_LOG_ERROR("UDP server needs an IPv4 or IPv6 address, got ", address.toString());
+      return false;
+  }
+  m_address = address;
+  m_shards.clear();
+  {
+    std::lock_guard<std::mutex> lock(m_placement_mutex);
+    m_placement.clear();
+  }
+  m_running = true;
+
+    for (size_t i = 0; i < m_shard_count; ++i) {
+      auto shard = std::make_unique<Shard>(m_batch_size);
+      shard->fd = open_socket(m_shard_count > 1);
+        if (shard->fd < 0) {
+          stop();
+          return false;
+      }
+      if (m_offload) enable_offload(*shard);
+      auto* raw = shard.get();
+      // Level-triggered: a wakeup may leave datagrams behind after kMaxBatchesPerWakeup batches
+        if (!shard->reactor.add(shard->fd, EPOLLIN, [this, raw](uint32_t) { on_readable(*raw); })) {
+          close(shard->fd);
+          stop();
+          return false;
+      }
+      m_shards.push_back(std::move(shard));
+    }
+
+  auto affinity = loop_affinity();
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+      auto placement = affinity.placementOf(i);
+      if (!placement.cpus.empty()) UFW_LOG_INFO("Thread UDP shard ", i, " runs on ", placement.toString());
+      m_shards[i]->reactor.setPlacement(placement);
+      {
+        std::lock_guard<std::mutex> lock(m_placement_mutex);
+        m_placement.push_back({"shard " + std::to_string(i), std::move(placement)});
+      }
+        if (!m_shards[i]->reactor.start()) {
+          UFW_LOG_ERROR("Failed to start UDP shard thread");
+          stop();
+          return false;
+      }
+    }
+  UFW_LOG_INFO("UDP server listening on ", m_address.toString(), " with ", m_shards.size(), " shards, GRO ",
+               m_shards.front()->gro, ", GSO ", m_shards.front()->gso);
+  return true;
+}
+
+void UdpServer::stop()
+{
+  if (!m_running.exchange(false)) return;
+  UFW_LOG_INFO("Stopping UDP server");
+    for (auto& shard: m_shards) {
+      shard->reactor.stop();
+        if (shard->fd >= 0) {
+          close(shard->fd);
+          shard->fd = -1;
+      }
+    }
+  UFW_LOG_INFO("UDP server stopped");
+}
+
+bool UdpServer::isRunning() const
+{
+  return m_running;
+}
+
+void UdpServer::setShards(size_t count, std::vector<int> cpus)
+{
+  m_shard_count = std::max<size_t>(1, count);
+  m_shard_cpus = std::move(cpus);
+}
+
+void UdpServer::setAffinity(utils::AffinityPolicy policy)
+{
+  m_affinity = std::move(policy);
+}
+
+std::vector<utils::ThreadPlacement> UdpServer::placement() const
+{
+  std::lock_guard<std::mutex> lock(m_placement_mutex);
+  return m_placement;
+}
+
+utils::AffinityPolicy UdpServer::loop_affinity() const
+{
+  if (m_affinity.enabled() || m_shard_cpus.empty()) return m_affinity;
+  return utils::AffinityPolicy::cpuSet(m_shard_cpus);
+}
+
+void UdpServer::setBatchSize(size_t count)
+{
+  m_batch_size = std::clamp<size_t>(count, 1, kMaxSendBatch);
+}
+
+size_t UdpServer::batchSize() const
+{
+  return m_batch_size;
+}
+
+void UdpServer::setOffload(bool enable)
+{
+  m_offload = enable;
+}
+
+void UdpServer::setReceiveBuffer(int bytes)
+{
+  m_receive_buffer = std::max(0, bytes);
+}
+
+void UdpServer::setFramer(std::shared_ptr<const utils::IFramer> framer)
+{
+  m_framer = std::move(framer);
+}
+
+UdpServer::Stats UdpServer::stats() const
+{
+  Stats total;
+    for (const auto& shard: m_shards) {
+      total.datagrams_received += shard->datagrams_received.load(std::memory_order_relaxed);
+      total.datagrams_sent += shard->datagrams_sent.load(std::memory_order_relaxed);
+      total.bytes_received += shard->bytes_received.load(std::memory_order_relaxed);
+      total.bytes_sent += shard->bytes_sent.load(std::memory_order_relaxed);
+      total.receive_calls += shard->receive_calls.load(std::memory_order_relaxed);
+      total.send_calls += shard->send_calls.load(std::memory_order_relaxed);
+      total.gro_datagrams += shard->gro_datagrams.load(std::memory_order_relaxed);
+      total.gso_datagrams += shard->gso_datagrams.load(std::memory_order_relaxed);
+      total.truncated += shard->truncated.load(std::memory_order_relaxed);
+      total.malformed += shard->malformed.load(std::memory_order_relaxed);
+      total.send_drops += shard->send_drops.load(std::memory_order_relaxed);
+      total.send_errors += shard->send_errors.load(std::memory_order_relaxed);
+    }
+  return total;
+}
+
+int UdpServer::open_socket(bool reuse_port)
+{
+  int fd = socket(m_address.family(), SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      UFW_LOG_ERROR("Failed to create UDP socket. Errno: ", utils::Errno{errno});
+      return -1;
+  }
+  int enable = 1;
+    if (reuse_port && (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0)) {
+      UFW_LOG_ERROR("Failed to set socket option SO_REUSEPORT. Errno: ", utils::Errno{errno});
+      close(fd);
+      return -1;
+  }
+  int v6_only = m_address.dualStack() ? 0 : 1;
+    if ((m_address.family() == AF_INET6) &&
+        (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only)) < 0)) {
+      UFW_LOG_ERROR("Failed to set socket option IPV6_V6ONLY. Errno: ", utils::Errno{errno});
+      close(fd);
+      return -1;
+  }
+    if ((m_receive_buffer > 0) &&
+        (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &m_receive_buffer, sizeof(m_receive_buffer)) < 0)) {
+      UFW_LOG_WARN("Failed to set socket option SO_RCVBUF. Errno: ", utils::Errno{errno});
+  }
+    if (bind(fd, m_address.data(), m_address.size()) < 0) {
+      UFW_LOG_ERROR("Bind to ", m_address.toString(), " failed. Errno: ", utils::Errno{errno});
+      close(fd);
+      return -1;
+  }
+  return fd;
+}
+
+void UdpServer::enable_offload(Shard& shard)
+{
+  int enable = 1;
+  shard.gro = setsockopt(shard.fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+  // Only asking for the segment size tells whether the kernel knows UDP_SEGMENT (4.18+)
+  int segment = 0;
+  socklen_t length = sizeof(segment);
+  shard.gso = getsockopt(shard.fd, SOL_UDP, UDP_SEGMENT, &segment, &length) == 0;
+  if (!shard.gro || !shard.gso) UFW_LOG_DEBUG("UDP offload: GRO ", shard.gro, ", GSO ", shard.gso);
+}
+
+void UdpServer::on_readable(Shard& shard)
+{
+  auto batch = static_cast<unsigned>(shard.recv_msgs.size());
+    for (int round = 0; (round < kMaxBatchesPerWakeup) && m_running; ++round) {
+        // recvmmsg() overwrites the lengths and flags of every slot it fills
+        for (unsigned slot = 0; slot < batch; ++slot) {
+          auto& header = shard.recv_msgs[slot].msg_hdr;
+          header.msg_namelen = sizeof(sockaddr_storage);
+          header.msg_control = shard.gro ? shard.control.get() + slot * kControlSize : nullptr;
+          header.msg_controllen = shard.gro ? kControlSize : 0;
+          header.msg_flags = 0;
+        }
+      int received = recvmmsg(shard.fd, shard.recv_msgs.data(), batch, MSG_DONTWAIT, nullptr);
+        if (received < 0) {
+          if (errno == EINTR) continue;
+          if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) UFW_LOG_WARN("UDP receive failed. Errno: ", utils::Errno{errno});
+          return;
+      }
+      utils::bump(shard.receive_calls);
+      handle_batch(shard, static_cast<unsigned>(received));
+      send_batch(shard);
+      // A short batch means the queue is empty
+      if (static_cast<unsigned>(received) < batch) return;
+    }
+}
+
+void UdpServer::handle_batch(Shard& shard, unsigned received)
+{
+  shard.replies.clear();
+    for (unsigned slot = 0; slot < received; ++slot) {
+      const auto& header = shard.recv_msgs[slot].msg_hdr;
+      size_t length = shard.recv_msgs[slot].msg_len;
+        if (header.msg_flags & MSG_TRUNC) {
+          utils::bump(shard.truncated);
+          continue;
+      }
+      // GRO hands a train of datagrams over as one, all of the segment size but the last one
+      size_t segment = length;
+      auto* header_ptr = const_cast<msghdr*>(&header);
+        for (auto* cmsg = CMSG_FIRSTHDR(header_ptr); cmsg != nullptr; cmsg = CMSG_NXTHDR(header_ptr, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+              int size = 0;
+              std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+              if (size > 0) segment = static_cast<size_t>(size);
+          }
+        }
+
+      const char* data = shard.buffers.get() + slot * kSlotSize;
+      size_t datagrams = 0;
+      size_t offset = 0;
+        while ((offset < length) || (datagrams == 0)) {
+          size_t size = std::min(segment, length - offset);
+          handle_datagram(shard, slot, std::string_view(data + offset, size));
+          offset += size;
+          ++datagrams;
+          if (size == 0) break;
+        }
+      utils::bump(shard.datagrams_received, datagrams);
+      utils::bump(shard.bytes_received, length);
+      if (datagrams > 1) utils::bump(shard.gro_datagrams, datagrams);
+    }
+}
+
+void UdpServer::handle_datagram(Shard& shard, unsigned slot, std::string_view datagram)
+{
+    if (!m_framer) {
+      auto response = m_handler(shard.fd, datagram);
+      if (!response.empty()) shard.replies.push_back({slot, std::move(response)});
+      return;
+  }
+  utils::IFramer::Frame frame;
+    if ((m_framer->next(datagram, frame) != utils::IFramer::Status::Complete) ||
+        (frame.consumed != datagram.size())) {
+      utils::bump(shard.malformed);
+      return;
+  }
+  auto response = m_handler(shard.fd, frame.payload);
+  if (response.empty()) return;
+  std::string encoded;
+  m_framer->encode(response, encoded);
+  shard.replies.push_back({slot, std::move(encoded)});
+}
+
+void UdpServer::send_batch(Shard& shard)
+{
+  auto& replies = shard.replies;
+  if (replies.empty()) return;
+  // Pointers into these are handed to the kernel, nothing may reallocate while the messages are built
+  shard.send_iov.resize(replies.size());
+  shard.send_msgs.clear();
+  shard.msg_segments.clear();
+  shard.msg_bytes.clear();
+  shard.send_msgs.reserve(replies.size());
+    if (shard.send_control_slots < replies.size()) {
+      shard.send_control.reset(new char[replies.size() * kControlSize]);
+      shard.send_control_slots = replies.size();
+  }
+
+  size_t next = 0;
+    while (next < replies.size()) {
+      size_t first = next;
+      size_t segment = replies[first].data.size();
+      size_t bytes = segment;
+      shard.send_iov[next] = {replies[next].data.data(), replies[next].data.size()};
+      ++next;
+        if (shard.gso && (segment <= kMaxGsoSegment)) {
+            while ((next < replies.size()) && (next - first < kMaxGsoSegments)) {
+              size_t size = replies[next].data.size();
+              const auto& peer = shard.recv_msgs[replies[next].slot];
+              if ((size > segment) || (bytes + size > kMaxGsoBytes)) break;
+              if (!same_peer(peer, shard.recv_msgs[replies[first].slot])) break;
+              shard.send_iov[next] = {replies[next].data.data(), size};
+              bytes += size;
+              ++next;
+              // Only the last datagram of a train may be shorter
+              if (size < segment) break;
+            }
+      }
+
+      mmsghdr message{};
+      const auto& request = shard.recv_msgs[replies[first].slot].msg_hdr;
+      message.msg_hdr.msg_name = request.msg_name;
+      message.msg_hdr.msg_namelen = request.msg_namelen;
+      message.msg_hdr.msg_iov = &shard.send_iov[first];
+      message.msg_hdr.msg_iovlen = next - first;
+        if (next - first > 1) {
+          char* control = shard.send_control.get() + shard.send_msgs.size() * kControlSize;
+          std::memset(control, 0, kControlSize);
+          message.msg_hdr.msg_control = control;
+          message.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+          auto* cmsg = CMSG_FIRSTHDR(&message.msg_hdr);
+          cmsg->cmsg_level = SOL_UDP;
+          cmsg->cmsg_type = UDP_SEGMENT;
+          cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+          auto size = static_cast<uint16_t>(segment);
+          std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+      }
+      shard.send_msgs.push_back(message);
+      shard.msg_segments.push_back(next - first);
+      shard.msg_bytes.push_back(bytes);
+    }
+
+  size_t sent = 0;
+    while (sent < shard.send_msgs.size()) {
+      auto count = static_cast<unsigned>(std::min(shard.send_msgs.size() - sent, kMaxSendBatch));
+      int result = sendmmsg(shard.fd, shard.send_msgs.data() + sent, count, MSG_DONTWAIT);
+      utils::bump(shard.send_calls);
+        if (result > 0) {
+            for (size_t message = sent; message < sent + static_cast<size_t>(result); ++message) {
+              utils::bump(shard.datagrams_sent, shard.msg_segments[message]);
+              utils::bump(shard.bytes_sent, shard.msg_bytes[message]);
+              if (shard.msg_segments[message] > 1) utils::bump(shard.gso_datagrams, shard.msg_segments[message]);
+            }
+          sent += static_cast<size_t>(result);
+          continue;
+      }
+      int error = errno;
+      if (error == EINTR) continue;
+        if ((error == EAGAIN) || (error == EWOULDBLOCK) || (error == ENOBUFS)) {
+          // The send buffer is full: what's left of the batch is lost like on a congested link
+            for (size_t message = sent; message < shard.send_msgs.size(); ++message) {
+              utils::bump(shard.send_drops, shard.msg_segments[message]);
+            }
+          return;
+      }
+        if ((shard.msg_segments[sent] > 1) && ((error == EINVAL) || (error == EMSGSIZE) || (error == EIO))) {
+          // The route or the device can't segment (small MTU, no checksum offload): stop asking
+          UFW_LOG_WARN("UDP GSO send failed, sending datagrams one by one from now on. Errno: ", utils::Errno{error});
+          shard.gso = false;
+          send_unsegmented(shard, sent);
+          ++sent;
+          continue;
+      }
+      // One datagram the kernel refuses (e.g. an unreachable address) mustn't hold the others back
+      UFW_LOG_DEBUG("UDP send to a client failed. Errno: ", utils::Errno{error});
+      utils::bump(shard.send_errors, shard.msg_segments[sent]);
+      ++sent;
+    }
+}
+
+void UdpServer::send_unsegmented(Shard& shard, size_t message)
+{
+  const auto& header = shard.send_msgs[message].msg_hdr;
+    for (size_t i = 0; i < header.msg_iovlen; ++i) {
+      const auto& iov = header.msg_iov[i];
+      ssize_t result = sendto(shard.fd, iov.iov_base, iov.iov_len, MSG_DONTWAIT,
+                              static_cast<const sockaddr*>(header.msg_name), header.msg_namelen);
+      utils::bump(shard.send_calls);
+        if (result < 0) {
+          utils::bump(shard.send_errors);
+          continue;
+      }
+      utils::bump(shard.datagrams_sent);
+      utils::bump(shard.bytes_sent, iov.iov_len);
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * @file udpserver.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Datagram server answering every request datagram to its sender
+ * @brief Receives and replies in batches with recvmmsg()/sendmmsg(), shards over SO_REUSEPORT sockets
+ *        and uses UDP GRO/GSO where the kernel has them
+ * @version 0.1
+ * @date 2025-01-18
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_UDPSERVER_HPP
+#define UFW_UDPSERVER_HPP
+
+#include "affinity.hpp"
+#include "epollreactor.hpp"
+#include "framer.hpp"
+#include "ihandler.hpp"
+#include "socketaddress.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class UdpServer
+ * @brief Serves datagrams with the handler style of TcpServer: one datagram in, at most one out.
+ *
+ * Every shard owns a socket bound to the same address with SO_REUSEPORT and an epoll loop. The
+ * kernel spreads senders over the sockets by their address, so one sender always lands on the same
+ * shard. A wakeup drains the socket with recvmmsg() calls of up to batchSize() datagrams, calls the
+ * handler for each and sends the responses of the batch with one sendmmsg().
+ *
+ * With GRO the kernel hands several datagrams of one sender over as one buffer, they are split back
+ * before the handler sees them. With GSO the responses of a batch going to the same sender with the
+ * same size (the last one may be shorter) leave as one message the kernel segments. Both are probed
+ * on start() and skipped if the kernel rejects them.
+ *
+ * A response that doesn't fit into the socket's send buffer right away is dropped, like the network
+ * would drop it, and counted in Stats::send_drops.
+ */
+class UdpServer
+{
+public:
+  using RqHandler = std::function<std::string(int, const std::string&)>;
+  /**
+   * @brief Handler getting the datagram as a view into the receive buffer, valid for the call only.
+   * An empty result sends nothing back.
+   */
+  using DatagramHandler = std::function<std::string(int, std::string_view)>;
+
+  /**
+   * @brief Counters summed over the shards of the current (or last) run.
+   * Datagrams per call show how well the batching works.
+   */
+  struct Stats
+  {
+    uint64_t datagrams_received{0};
+    uint64_t datagrams_sent{0};
+    uint64_t bytes_received{0};
+    uint64_t bytes_sent{0};
+    uint64_t receive_calls{0};  // recvmmsg() calls that returned datagrams
+    uint64_t send_calls{0};  // sendmmsg() calls
+    uint64_t gro_datagrams{0};  // datagrams that arrived coalesced by GRO
+    uint64_t gso_datagrams{0};  // datagrams that left segmented by GSO
+    uint64_t truncated{0};  // datagrams longer than the receive buffer, dropped
+    uint64_t malformed{0};  // datagrams the framer rejected, dropped
+    uint64_t send_drops{0};
+    uint64_t send_errors{0};
+  };
+
+  UdpServer(RqHandler callback);
+  UdpServer(IHandler* handler);
+  UdpServer(DatagramHandler handler);
+  ~UdpServer();
+
+  UdpServer(const UdpServer&) = delete;
+  UdpServer& operator=(const UdpServer&) = delete;
+
+  /**
+   * @brief Listens on @p port of every IPv4 address.
+   */
+  bool start(int port);
+  /**
+   * @brief Listens on an IPv4 or IPv6 address, "::" is dual-stack. Unix addresses aren't supported.
+   */
+  bool start(const utils::SocketAddress& address);
+  void stop();
+
+  [[nodiscard]]
+  bool isRunning() const;
+
+  /**
+   * @brief Sets the number of shards. Takes effect on the next start().
+   * @param cpus CPUs to pin the shard loops to, shard `i` goes to `cpus[i % cpus.size()]`. Empty disables pinning.
+   */
+  void setShards(size_t count, std::vector<int> cpus = {});
+  /**
+   * @brief Where the shard loops run: shard `i` at `policy.placementOf(i)`, as TcpServer::setAffinity().
+   * A loop moves itself before its first receive, so the pages of its batch buffers come from its
+   * node. Overrides the CPUs given to setShards(). Unset by default. Takes effect on the next start().
+   */
+  void setAffinity(utils::AffinityPolicy policy);
+  /**
+   * @brief Placement chosen on start(), an entry per shard. Pinned entries are logged.
+   */
+  [[nodiscard]]
+  std::vector<utils::ThreadPlacement> placement() const;
+  /**
+   * @brief Sets the maximum number of datagrams per recvmmsg()/sendmmsg() call, 32 by default.
+   * Every slot of a batch holds a 64 KiB receive buffer. Takes effect on the next start().
+   */
+  void setBatchSize(size_t count);
+  [[nodiscard]]
+  size_t batchSize() const;
+  /**
+   * @brief Enables UDP GRO and GSO where the kernel supports them (default). Takes effect on the next start().
+   */
+  void setOffload(bool enable);
+  /**
+   * @brief SO_RCVBUF of every shard socket, 0 keeps the system default. Takes effect on the next start().
+   */
+  void setReceiveBuffer(int bytes);
+  /**
+   * @brief Decodes every datagram with @p framer and encodes the responses with it, e.g. a
+   * utils::CodecPipeline checking a checksum. A datagram must hold exactly one frame, others are
+   * dropped and counted in Stats::malformed. nullptr (default) hands datagrams over as they are.
+   * Must be set before start().
+   */
+  void setFramer(std::shared_ptr<const utils::IFramer> framer);
+
+  [[nodiscard]]
+  Stats stats() const;
+
+private:
+  struct Shard;
+
+  DatagramHandler m_handler;
+  std::shared_ptr<const utils::IFramer> m_framer;
+  utils::SocketAddress m_address;
+  std::atomic<bool> m_running{false};
+  size_t m_shard_count{1};
+  std::vector<int> m_shard_cpus;
+  utils::AffinityPolicy m_affinity;
+  mutable std::mutex m_placement_mutex;
+  std::vector<utils::ThreadPlacement> m_placement;
+  size_t m_batch_size{32};
+  bool m_offload{true};
+  int m_receive_buffer{0};
+  std::vector<std::unique_ptr<Shard>> m_shards;
+
+  utils::AffinityPolicy loop_affinity() const;
+  int open_socket(bool reuse_port);
+  void enable_offload(Shard& shard);
+  void on_readable(Shard& shard);
+  void handle_batch(Shard& shard, unsigned received);
+  void handle_datagram(Shard& shard, unsigned slot, std::string_view datagram);
+  void send_batch(Shard& shard);
+  void send_unsegmented(Shard& shard, size_t message);
+};
+
+#endif  // UFW_UDPSERVER_HPP
@@ -0,0 +1,300 @@
+/**
+ * @file logger.cpp
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ * Licensed under MIT License
+ */
+
+#include "logger.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace utils
+{
+  namespace
+  {
+    // The writer polls often while messages come in and backs off to the longer period when idle
+    constexpr auto kWriterPeriod = std::chrono::milliseconds(5);
+    constexpr auto kIdlePeriod = std::chrono::milliseconds(100);
+
+    const char* level_name(LogLevel level)
+    {
+        switch (level) {
+          case LogLevel::Trace: return "TRACE";
+          case LogLevel::Debug: return "DEBUG";
+          case LogLevel::Info: return "INFO ";
+          case LogLevel::Warn: return "WARN ";
+          case LogLevel::Error: return "ERROR";
+          default: return "?    ";
+        }
+    }
+
+    void default_sink(LogLevel level, std::string_view line)
+    {
+      FILE* out = level >= LogLevel::Warn ? stderr : stdout;
+      fwrite(line.data(), 1, line.size(), out);
+      fputc('\n', out);
+    }
+
+    template<typename T>
+    T read(const char*& pos)
+    {
+      T value;
+      std::memcpy(&value, pos, sizeof(T));
+      pos += sizeof(T);
+      return value;
+    }
+
+    // The owner thread's ring stays registered after the thread is gone until it is drained
+    struct RingHolder
+    {
+      std::atomic<bool>* orphaned{nullptr};
+
+      ~RingHolder();
+    };
+
+    // Plain thread_locals: still readable while the thread's other thread_locals are being destroyed
+    thread_local void* t_ring = nullptr;
+    thread_local bool t_exited = false;
+
+    RingHolder::~RingHolder()
+    {
+      t_ring = nullptr;
+      t_exited = true;
+      if (orphaned != nullptr) orphaned->store(true, std::memory_order_release);
+    }
+  }  // namespace
+
+  Logger& Logger::instance()
+  {
+    // Never destroyed: objects torn down at exit may still log, shutdown() drains the rest at exit
+    static Logger* logger = []() {
+      auto* instance = new Logger();
+      std::atexit([]() { Logger::instance().shutdown(); });
+      return instance;
+    }();
+    return *logger;
+  }
+
+  Logger::Logger()
+  {
+    m_writer = std::thread(&Logger::loop, this);
+  }
+
+  void Logger::setSink(Sink sink)
+  {
+    std::lock_guard<std::mutex> lock(m_sink_mutex);
+    m_sink = std::move(sink);
+  }
+
+  void Logger::flush()
+  {
+    if (!m_stopped.load(std::memory_order_acquire)) drain();
+  }
+
+  bool Logger::Ring::push(const char* record, size_t size) noexcept
+  {
+    uint64_t write = head.load(std::memory_order_relaxed);
+    uint64_t read = tail.load(std::memory_order_acquire);
+    if (kRingSize - (write - read) < size) return false;
+    size_t offset = static_cast<size_t>(write & (kRingSize - 1));
+    size_t first = std::min(size, kRingSize - offset);
+    std::memcpy(data.get() + offset, record, first);
+    std::memcpy(data.get(), record + first, size - first);
+    head.store(write + size, std::memory_order_release);
+    return true;
+  }
+
+  void Logger::Ring::copyOut(uint64_t pos, char* out, size_t size) const noexcept
+  {
+    size_t offset = static_cast<size_t>(pos & (kRingSize - 1));
+    size_t first = std::min(size, kRingSize - offset);
+    std::memcpy(out, data.get() + offset, first);
+    std::memcpy(out + first, data.get(), size - first);
+  }
+
+  void Logger::push(LogLevel level, const char* record, size_t size)
+  {
+    Ring* ring = m_stopped.load(std::memory_order_acquire) ? nullptr : local_ring();
+      if (ring == nullptr) {
+        // Exiting thread or process: nobody drains anymore, write it out here
+        write_now(level, record, size);
+        return;
+    }
+      if (!ring->push(record, size)) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        m_dropped_total.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // The writer comes by every few milliseconds anyway, only urgent or piling up records wake it early
+    if ((level >= LogLevel::Warn) || (ring->used() > kRingSize / 2)) m_wakeup.notify_one();
+  }
+
+  Logger::Ring* Logger::local_ring()
+  {
+    if (t_ring != nullptr) return static_cast<Ring*>(t_ring);
+    if (t_exited) return nullptr;
+    thread_local RingHolder holder;
+    auto ring = std::make_shared<Ring>();
+    {
+      std::lock_guard<std::mutex> lock(m_rings_mutex);
+      m_rings.push_back(ring);
+    }
+    holder.orphaned = &ring->orphaned;
+    t_ring = ring.get();
+    return ring.get();
+  }
+
+  void Logger::write_now(LogLevel level, const char* record, size_t size)
+  {
+    std::string line;
+    format(record, size, line);
+    emit(level, line);
+  }
+
+  void Logger::emit(LogLevel level, std::string_view line)
+  {
+    std::lock_guard<std::mutex> lock(m_sink_mutex);
+      if (m_sink) {
+        m_sink(level, line);
+      } else {
+        default_sink(level, line);
+      }
+  }
+
+  size_t Logger::drain()
+  {
+    std::lock_guard<std::mutex> lock(m_drain_mutex);
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+      std::lock_guard<std::mutex> rings_lock(m_rings_mutex);
+      rings = m_rings;
+    }
+
+    char record[kMaxRecord];
+      for (auto& ring: rings) {
+        uint64_t read = ring->tail.load(std::memory_order_relaxed);
+        uint64_t write = ring->head.load(std::memory_order_acquire);
+          while (read < write) {
+            uint32_t size;
+            ring->copyOut(read, reinterpret_cast<char*>(&size), sizeof(size));
+            ring->copyOut(read, record, size);
+            read += size;
+            Entry entry;
+            entry.level = static_cast<LogLevel>(static_cast<uint8_t>(record[sizeof(uint32_t)]));
+            std::memcpy(&entry.time, record + sizeof(uint32_t) + sizeof(uint8_t), sizeof(entry.time));
+            format(record, size, entry.line);
+            m_entries.push_back(std::move(entry));
+          }
+        ring->tail.store(read, std::memory_order_release);
+
+        uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+          if (dropped > 0) {
+            Entry entry;
+            entry.level = LogLevel::Warn;
+            entry.time = m_entries.empty() ? 0 : m_entries.back().time;
+            entry.line = "[logger] " + std::to_string(dropped) + " messages dropped, the ring of a thread was full";
+            m_entries.push_back(std::move(entry));
+        }
+      }
+
+    // Each ring is in order already, interleave the threads by time
+    std::stable_sort(m_entries.begin(), m_entries.end(),
+                     [](const Entry& left, const Entry& right) { return left.time < right.time; });
+    for (auto& entry: m_entries) emit(entry.level, entry.line);
+    size_t written = m_entries.size();
+    m_entries.clear();
+      if (written > 0) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    // Rings of finished threads go once they are empty
+    std::lock_guard<std::mutex> rings_lock(m_rings_mutex);
+    m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+                                 [](const std::shared_ptr<Ring>& ring) {
+                                   return ring->orphaned.load(std::memory_order_acquire) && (ring->used() == 0);
+                                 }),
+                  m_rings.end());
+    return written;
+  }
+
+  void Logger::loop()
+  {
+    auto period = kWriterPeriod;
+    std::unique_lock<std::mutex> lock(m_wakeup_mutex);
+      while (!m_stop) {
+        lock.unlock();
+        period = drain() > 0 ? kWriterPeriod : std::min<std::chrono::milliseconds>(period * 2, kIdlePeriod);
+        lock.lock();
+        m_wakeup.wait_for(lock, period);
+      }
+  }
+
+  void Logger::shutdown()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+      if (m_stop) return;
+      m_stop = true;
+    }
+    m_wakeup.notify_one();
+    if (m_writer.joinable()) m_writer.join();
+    // Records pushed from now on are written by their threads
+    m_stopped.store(true, std::memory_order_release);
+    drain();
+  }
+
+  void Logger::format(const char* record, size_t size, std::string& line)
+  {
+    const char* pos = record + sizeof(uint32_t) + sizeof(uint8_t);
+    const char* end = record + size;
+    auto time = read<int64_t>(pos);
+    auto level = static_cast<LogLevel>(static_cast<uint8_t>(record[sizeof(uint32_t)]));
+
+    std::time_t seconds = static_cast<std::time_t>(time / 1000000000);
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    char prefix[48];
+    int length = snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%06d %s ", local.tm_hour, local.tm_min,
+                          local.tm_sec, static_cast<int>(time % 1000000000 / 1000), level_name(level));
+    line.assign(prefix, length > 0 ? static_cast<size_t>(length) : 0);
+
+    char number[32];
+      while (pos < end) {
+        auto type = static_cast<ArgType>(read<uint8_t>(pos));
+          switch (type) {
+            case ArgType::Int: line += std::to_string(read<int64_t>(pos)); break;
+            case ArgType::UInt: line += std::to_string(read<uint64_t>(pos)); break;
+            case ArgType::Double:
+              snprintf(number, sizeof(number), "%g", read<double>(pos));
+              line += number;
+              break;
+            case ArgType::Bool: line += read<uint8_t>(pos) ? "true" : "false"; break;
+            case ArgType::Char: line += read<char>(pos); break;
+            case ArgType::String: {
+              auto length = read<uint32_t>(pos);
+              line.append(pos, length);
+              pos += length;
+              break;
+            }
+            case ArgType::Errno: {
+              char buffer[128];
+              line += strerror_r(read<int>(pos), buffer, sizeof(buffer));
+              break;
+            }
+            case ArgType::Pointer:
+              snprintf(number, sizeof(number), "0x%" PRIx64, read<uint64_t>(pos));
+              line += number;
+              break;
+            case ArgType::Truncated:
+            default:
+              line += "...";
+              return;
+          }
+      }
+  }
+
+}  // namespace utils
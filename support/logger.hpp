@@ -0,0 +1,309 @@
+/**
+ * @file logger.hpp
+ * @author Dmitrii Donskikh (deedonskihdev@gmail.com)
+ * @brief Asynchronous logger: per-thread lock-free rings drained by one writer thread
+ * @brief Arguments are copied into the ring as they are and formatted by the writer, levels below
+ *        UFW_LOG_LEVEL compile to nothing
+ * @version 0.1
+ * @date 2025-01-04
+ *
+ * @copyright Copyright (c) 2025 Dmitrii Donskikh
+ *            Licensed under MIT License (https://opensource.org/licenses/MIT)
+ */
+#ifndef UFW_LOGGER_HPP
+#define UFW_LOGGER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define UFW_LOG_LEVEL_TRACE 0
+#define UFW_LOG_LEVEL_DEBUG 1
+#define UFW_LOG_LEVEL_INFO 2
+#define UFW_LOG_LEVEL_WARN 3
+#define UFW_LOG_LEVEL_ERROR 4
+#define UFW_LOG_LEVEL_OFF 5
+
+// Messages below this level are compiled out, arguments included
+#ifndef UFW_LOG_LEVEL
+#define UFW_LOG_LEVEL UFW_LOG_LEVEL_INFO
+#endif
+
+namespace utils
+{
+
+  enum class LogLevel : uint8_t
+  {
+    Trace = UFW_LOG_LEVEL_TRACE,
+    Debug = UFW_LOG_LEVEL_DEBUG,
+    Info = UFW_LOG_LEVEL_INFO,
+    Warn = UFW_LOG_LEVEL_WARN,
+    Error = UFW_LOG_LEVEL_ERROR,
+    Off = UFW_LOG_LEVEL_OFF
+  };
+
+  /**
+   * @brief errno value logged as its strerror() text, looked up by the writer thread.
+   */
+  struct Errno
+  {
+    int code;
+  };
+
+  /**
+   * @class Logger
+   * @brief Process-wide logger that keeps formatting and I/O off the calling threads.
+   *
+   * A message is a list of values concatenated like a `std::ostream <<` chain. log() copies them
+   * into the calling thread's ring (integers, floats, strings, Errno) without locking, allocating
+   * or formatting anything. The writer thread wakes up every few milliseconds (right away for
+   * warnings and errors), formats the records of all rings in time order and hands the lines to
+   * the sink. A full ring drops the message instead of blocking, drops are reported in the output.
+   * Strings are cut at 1 KiB.
+   */
+  class Logger
+  {
+  public:
+    /**
+     * @brief Receives formatted lines without the trailing newline, on the writer thread.
+     */
+    using Sink = std::function<void(LogLevel, std::string_view)>;
+
+    static Logger& instance();
+
+    static bool enabled(LogLevel level) noexcept
+    {
+      return static_cast<uint8_t>(level) >= s_level.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Runtime threshold on top of UFW_LOG_LEVEL, defaults to Info.
+     */
+    static void setLevel(LogLevel level) noexcept
+    {
+      s_level.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Replaces the default sink (stdout, warnings and errors to stderr). nullptr restores it.
+     */
+    void setSink(Sink sink);
+    /**
+     * @brief Writes out everything logged before the call.
+     */
+    void flush();
+    /**
+     * @brief Messages lost to full rings so far.
+     */
+    uint64_t dropped() const noexcept
+    {
+      return m_dropped_total.load(std::memory_order_relaxed);
+    }
+
+    template<typename... Args>
+    void log(LogLevel level, const Args&... args)
+    {
+      char record[kMaxRecord];
+      Encoder encoder{record, record, record + kMaxRecord};
+      encoder.header(level);
+      (encoder.put(args), ...);
+      encoder.finish();
+      push(level, record, static_cast<size_t>(encoder.pos - record));
+    }
+
+  private:
+    static constexpr size_t kRingSize = 64 * 1024;  // power of two
+    static constexpr size_t kMaxRecord = 4 * 1024;
+    static constexpr size_t kMaxString = 1024;
+
+    enum class ArgType : uint8_t
+    {
+      Int,
+      UInt,
+      Double,
+      Bool,
+      Char,
+      String,
+      Errno,
+      Pointer,
+      Truncated  // the arguments from here on didn't fit into the record
+    };
+
+    // Single-producer single-consumer byte ring of one thread
+    struct Ring
+    {
+      std::unique_ptr<char[]> data{new char[kRingSize]};
+      alignas(64) std::atomic<uint64_t> head{0};  // written by the owner thread
+      alignas(64) std::atomic<uint64_t> tail{0};  // written by the writer thread
+      std::atomic<uint64_t> dropped{0};
+      std::atomic<bool> orphaned{false};  // the owner thread has exited
+
+      bool push(const char* record, size_t size) noexcept;
+      void copyOut(uint64_t pos, char* out, size_t size) const noexcept;
+      size_t used() const noexcept
+      {
+        return static_cast<size_t>(head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed));
+      }
+    };
+
+    // Appends a record to a fixed buffer: [size:4][level:1][time:8] then [type:1][value] per argument
+    struct Encoder
+    {
+      char* begin;
+      char* pos;
+      char* end;
+      bool truncated{false};
+
+      template<typename T>
+      void raw(const T& value) noexcept
+      {
+        std::memcpy(pos, &value, sizeof(T));
+        pos += sizeof(T);
+      }
+
+      bool room(size_t size) noexcept
+      {
+        if (truncated) return false;
+        // Keep a byte for the Truncated marker
+        if (static_cast<size_t>(end - pos) >= size + 1) return true;
+        *pos++ = static_cast<char>(ArgType::Truncated);
+        truncated = true;
+        return false;
+      }
+
+      void header(LogLevel level) noexcept
+      {
+        pos += sizeof(uint32_t);
+        raw(static_cast<uint8_t>(level));
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        raw(static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()));
+      }
+
+      void finish() noexcept
+      {
+        auto size = static_cast<uint32_t>(pos - begin);
+        std::memcpy(begin, &size, sizeof(size));
+      }
+
+      void string(std::string_view text) noexcept
+      {
+        constexpr size_t kPrefix = 1 + sizeof(uint32_t);
+        if (!room(kPrefix)) return;
+        // room() left at least one byte beyond the prefix for a later Truncated marker
+        size_t length = std::min(text.size(), kMaxString);
+        length = std::min(length, static_cast<size_t>(end - pos) - kPrefix - 1);
+        raw(static_cast<uint8_t>(ArgType::String));
+        raw(static_cast<uint32_t>(length));
+        std::memcpy(pos, text.data(), length);
+        pos += length;
+      }
+
+      template<typename T>
+      void put(const T& value) noexcept
+      {
+          if constexpr (std::is_same_v<T, bool>) {
+            if (!room(2)) return;
+            raw(static_cast<uint8_t>(ArgType::Bool));
+            raw(static_cast<uint8_t>(value));
+          } else if constexpr (std::is_same_v<T, char>) {
+            if (!room(2)) return;
+            raw(static_cast<uint8_t>(ArgType::Char));
+            raw(value);
+          } else if constexpr (std::is_same_v<T, Errno>) {
+            if (!room(1 + sizeof(int))) return;
+            raw(static_cast<uint8_t>(ArgType::Errno));
+            raw(value.code);
+          } else if constexpr (std::is_enum_v<T>) {
+            put(static_cast<std::underlying_type_t<T>>(value));
+          } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            if (!room(1 + sizeof(int64_t))) return;
+            raw(static_cast<uint8_t>(ArgType::Int));
+            raw(static_cast<int64_t>(value));
+          } else if constexpr (std::is_integral_v<T>) {
+            if (!room(1 + sizeof(uint64_t))) return;
+            raw(static_cast<uint8_t>(ArgType::UInt));
+            raw(static_cast<uint64_t>(value));
+          } else if constexpr (std::is_floating_point_v<T>) {
+            if (!room(1 + sizeof(double))) return;
+            raw(static_cast<uint8_t>(ArgType::Double));
+            raw(static_cast<double>(value));
+          } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+            const char* text = value;
+            string(text != nullptr ? std::string_view(text) : std::string_view("(null)"));
+          } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            string(std::string_view(value));
+          } else if constexpr (std::is_pointer_v<T>) {
+            if (!room(1 + sizeof(uint64_t))) return;
+            raw(static_cast<uint8_t>(ArgType::Pointer));
+            raw(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+          } else {
+            static_assert(sizeof(T) == 0, "Logger can't copy this type, log a string or a number");
+          }
+      }
+    };
+
+    struct Entry
+    {
+      int64_t time;
+      LogLevel level;
+      std::string line;
+    };
+
+    inline static std::atomic<uint8_t> s_level{static_cast<uint8_t>(LogLevel::Info)};
+
+    std::mutex m_rings_mutex;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    std::mutex m_drain_mutex;  // one drain at a time: the writer thread or flush()
+    std::mutex m_sink_mutex;
+    Sink m_sink;
+    std::mutex m_wakeup_mutex;
+    std::condition_variable m_wakeup;
+    std::atomic<bool> m_stopped{false};
+    bool m_stop{false};
+    std::atomic<uint64_t> m_dropped_total{0};
+    std::vector<Entry> m_entries;
+    std::thread m_writer;
+
+    Logger();
+
+    void push(LogLevel level, const char* record, size_t size);
+    Ring* local_ring();
+    void write_now(LogLevel level, const char* record, size_t size);
+    size_t drain();
+    void emit(LogLevel level, std::string_view line);
+    void loop();
+    void shutdown();
+    static void format(const char* record, size_t size, std::string& line);
+  };
+
+}  // namespace utils
+
+/**
+ * @brief Logs the concatenation of the arguments, e.g. `UFW_LOG_WARN("Failed to bind port ", port, ": ", utils::Errno{errno})`.
+ * Neither the arguments nor the runtime check are compiled in below UFW_LOG_LEVEL, the arguments
+ * aren't evaluated below the runtime level.
+ */
+#define UFW_LOG(level, ...)                                                                                            \
+  do {                                                                                                                 \
+      if constexpr (static_cast<int>(level) >= UFW_LOG_LEVEL) {                                                        \
+        if (::utils::Logger::enabled(level)) ::utils::Logger::instance().log(level, __VA_ARGS__);                      \
+    }                                                                                                                  \
+  } while (0)
+
+#define UFW_LOG_TRACE(...) UFW_LOG(::utils::LogLevel::Trace, __VA_ARGS__)
+#define UFW_LOG_DEBUG(...) UFW_LOG(::utils::LogLevel::Debug, __VA_ARGS__)
+#define UFW_LOG_INFO(...) UFW_LOG(::utils::LogLevel::Info, __VA_ARGS__)
+#define UFW_LOG_WARN(...) UFW_LOG(::utils::LogLevel::Warn, __VA_ARGS__)
+#define UFW_LOG_ERROR(...) UFW_LOG(::utils::LogLevel::Error, __VA_ARGS__)
+
+#endif  // UFW_LOGGER_HPP